@@ -0,0 +1,29 @@
+#!/bin/sh
+# Plays the GIFs in corpus/gifs through the native build and compares every
+# composed frame and the per-GIF budgets with corpus/golden.txt. Then replays
+# the decode times in corpus/timings-esp32.txt through the frame pacer.
+#
+#   corpus/check.sh            check, exits non-zero on any difference
+#   corpus/check.sh --record   rewrite golden.txt after an intended change
+#
+# Further arguments go to the program. The golden file is recorded with the
+# defaults (colour curve, brightness, scaling), so check with them too.
+set -e
+cd "$(dirname "$0")/.."
+
+mode=--check
+if [ "$1" = "--record" ]; then
+    mode=--record
+    shift
+fi
+
+pio run -e native
+
+# A fresh card each run, so no playlist index or cache from an earlier run is reused
+card=$(mktemp -d)
+trap 'rm -rf "$card"' EXIT
+mkdir "$card/gifs"
+cp corpus/gifs/*.gif "$card/gifs/"
+
+.pio/build/native/program "$card" $mode corpus/golden.txt "$@"
+.pio/build/native/program --replay-pacing corpus/timings-esp32.txt
@@ -0,0 +1,194 @@
+#!/usr/bin/env python3
+"""Writes the GIF corpus the native build's golden check plays (corpus/gifs).
+
+Every GIF is generated, so what each one covers is written down here rather
+than hidden in a binary. Palette colours are multiples of 8 in red and blue
+and of 4 in green, so RGB565 holds them exactly and the decoder's palette
+conversion cannot round them differently.
+
+    python3 corpus/make_corpus.py [out dir]
+"""
+
+import os
+import struct
+import sys
+
+
+def lzw_encode(indices, min_code_size):
+    """GIF LZW as giflib writes it: variable-width codes packed LSB first."""
+    clear = 1 << min_code_size
+    eoi = clear + 1
+    out = bytearray()
+    state = {"bits": 0, "nbits": 0, "size": min_code_size + 1, "next": eoi + 1}
+
+    def emit(code):
+        state["bits"] |= code << state["nbits"]
+        state["nbits"] += state["size"]
+        while state["nbits"] >= 8:
+            out.append(state["bits"] & 0xFF)
+            state["bits"] >>= 8
+            state["nbits"] -= 8
+        if state["next"] >= (1 << state["size"]) and state["size"] < 12:
+            state["size"] += 1
+
+    def reset():
+        state["size"] = min_code_size + 1
+        state["next"] = eoi + 1
+        return {(i,): i for i in range(clear)}
+
+    table = reset()
+    emit(clear)
+    prefix = (indices[0],)
+    for index in indices[1:]:
+        candidate = prefix + (index,)
+        if candidate in table:
+            prefix = candidate
+            continue
+        emit(table[prefix])
+        prefix = (index,)
+        if state["next"] >= 4095:
+            emit(clear)
+            table = reset()
+        else:
+            table[candidate] = state["next"]
+            state["next"] += 1
+    emit(table[prefix])
+    emit(eoi)
+    if state["nbits"]:
+        out.append(state["bits"] & 0xFF)
+    return bytes(out)
+
+
+def sub_blocks(data):
+    out = bytearray()
+    for i in range(0, len(data), 255):
+        chunk = data[i:i + 255]
+        out.append(len(chunk))
+        out += chunk
+    out.append(0)
+    return bytes(out)
+
+
+def palette_bytes(colors):
+    size = 2
+    while size < len(colors):
+        size *= 2
+    padded = list(colors) + [(0, 0, 0)] * (size - len(colors))
+    bits = size.bit_length() - 2  # 2 colours -> 0
+    return bytes(c for rgb in padded for c in rgb), bits
+
+
+class Frame:
+    def __init__(self, x, y, w, h, pixels, delay_ms=50, disposal=1, transparent=None, palette=None):
+        self.x, self.y, self.w, self.h = x, y, w, h
+        self.pixels = pixels
+        self.delay_ms = delay_ms
+        self.disposal = disposal
+        self.transparent = transparent
+        self.palette = palette
+
+
+def write_gif(path, width, height, palette, frames, background=0):
+    table, bits = palette_bytes(palette)
+    out = bytearray(b"GIF89a")
+    out += struct.pack("<HHBBB", width, height, 0x80 | 0x70 | bits, background, 0)
+    out += table
+    if len(frames) > 1:
+        out += b"\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00"  # Loop forever
+    for f in frames:
+        packed = (f.disposal << 2) | (1 if f.transparent is not None else 0)
+        out += struct.pack("<BBBBHBB", 0x21, 0xF9, 4, packed, f.delay_ms // 10,
+                           f.transparent or 0, 0)
+        local = 0
+        local_table = b""
+        code_bits = max(bits + 1, 2)
+        if f.palette is not None:
+            local_table, local_bits = palette_bytes(f.palette)
+            local = 0x80 | local_bits
+            code_bits = max(local_bits + 1, 2)
+        out += struct.pack("<BHHHHB", 0x2C, f.x, f.y, f.w, f.h, local)
+        out += local_table
+        assert len(f.pixels) == f.w * f.h
+        out.append(code_bits)
+        out += sub_blocks(lzw_encode(f.pixels, code_bits))
+    out.append(0x3B)
+    with open(path, "wb") as fh:
+        fh.write(out)
+
+
+# 16 colours, exact in RGB565, with dark levels the colour curve must keep
+PALETTE16 = [
+    (0, 0, 0), (248, 252, 248), (248, 0, 0), (0, 252, 0),
+    (0, 0, 248), (248, 252, 0), (0, 252, 248), (248, 0, 248),
+    (16, 16, 16), (32, 32, 32), (48, 48, 48), (128, 128, 128),
+    (16, 0, 0), (0, 16, 0), (0, 0, 16), (200, 100, 40),
+]
+
+
+def pattern(w, h, seed, colors=16):
+    return [((x // 4) + (y // 4) * 3 + seed) % colors for y in range(h) for x in range(w)]
+
+
+def corpus(out):
+    os.makedirs(out, exist_ok=True)
+    gifs = {}
+
+    # Full panel frames, global palette
+    gifs["full-frames.gif"] = (128, 32, PALETTE16,
+                               [Frame(0, 0, 128, 32, pattern(128, 32, i), delay_ms=40) for i in range(4)])
+
+    # Sub-rectangles left in place (disposal 1) over a full first frame
+    frames = [Frame(0, 0, 128, 32, pattern(128, 32, 0), delay_ms=60)]
+    for i in range(5):
+        frames.append(Frame(10 + i * 20, 4 + i * 2, 16, 12, [(i + 2) % 16] * (16 * 12), delay_ms=60))
+    gifs["sub-rects.gif"] = (128, 32, PALETTE16, frames)
+
+    # Transparent pixels show the frame underneath
+    frames = [Frame(0, 0, 128, 32, pattern(128, 32, 3), delay_ms=50)]
+    for i in range(4):
+        px = [5 if (x + y + i) % 3 else 15 for y in range(20) for x in range(40)]
+        frames.append(Frame(20 + i * 10, 6, 40, 20, px, delay_ms=50, transparent=15))
+    gifs["transparency.gif"] = (128, 32, PALETTE16, frames)
+
+    # Disposal 2: transparent pixels of the frame become the background colour
+    frames = [Frame(0, 0, 128, 32, pattern(128, 32, 5), delay_ms=70, disposal=2)]
+    for i in range(4):
+        px = [2 if (x // 2 + i) % 2 else 14 for y in range(16) for x in range(48)]
+        frames.append(Frame(8 + i * 16, 8, 48, 16, px, delay_ms=70, disposal=2, transparent=14))
+    gifs["disposal2.gif"] = (128, 32, PALETTE16, frames, 11)
+
+    # A local palette per frame
+    frames = []
+    for i in range(3):
+        local = [((i * 64 + c * 8) & 0xF8, (c * 16) & 0xFC, (255 - c * 8) & 0xF8) for c in range(16)]
+        frames.append(Frame(0, 0, 128, 32, pattern(128, 32, i), delay_ms=80, palette=local))
+    gifs["local-palettes.gif"] = (128, 32, PALETTE16, frames)
+
+    # Wider and taller than the panel, scaled down
+    gifs["wide-256x32.gif"] = (256, 32, PALETTE16,
+                               [Frame(0, 0, 256, 32, pattern(256, 32, i), delay_ms=50) for i in range(3)])
+    frames = [Frame(0, 0, 320, 128, pattern(320, 128, 0), delay_ms=100)]
+    frames.append(Frame(100, 40, 120, 48, pattern(120, 48, 3), delay_ms=100, transparent=0))
+    frames.append(Frame(0, 0, 320, 128, pattern(320, 128, 9), delay_ms=100, disposal=2))
+    gifs["wide-320x128.gif"] = (320, 128, PALETTE16, frames)
+
+    # Smaller than the panel, scaled up
+    gifs["small-32x16.gif"] = (32, 16, PALETTE16,
+                               [Frame(0, 0, 32, 16, pattern(32, 16, i), delay_ms=90) for i in range(3)])
+
+    # A still image and a long animation of small changes
+    gifs["still.gif"] = (128, 32, PALETTE16, [Frame(0, 0, 128, 32, pattern(128, 32, 2), delay_ms=1000)])
+    frames = [Frame(0, 0, 128, 32, [0] * (128 * 32), delay_ms=30)]
+    for i in range(29):
+        frames.append(Frame((i * 4) % 124, (i * 3) % 28, 4, 4, [1 + i % 15] * 16, delay_ms=30))
+    gifs["many-frames.gif"] = (128, 32, PALETTE16, frames)
+
+    for name, spec in gifs.items():
+        write_gif(os.path.join(out, name), *spec)
+    return sorted(gifs)
+
+
+if __name__ == "__main__":
+    target = sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(os.path.abspath(__file__)), "gifs")
+    for name in corpus(target):
+        print(os.path.join(target, name))
@@ -3,6 +3,7 @@
 class PixelMatrixApp {
 
     baseUrl = '';
+    connected = undefined;
 
     constructor() {
         // Determine the base URL based on whether it's running on ESP or locally
@@ -123,6 +124,49 @@ class PixelMatrixApp {
         }
     }
 
+    // Update the UI from a status object: the whole of it, or just the fields that changed
+    applyStatus(data) {
+        const ssidElement = document.getElementById('ssid');
+        if (ssidElement && data.ssid !== undefined) {
+            ssidElement.textContent = data.ssid;
+        }
+
+        const ipElement = document.getElementById('ip');
+        if (ipElement && data.ip !== undefined) {
+            ipElement.textContent = data.ip;
+        }
+
+        const currentGifElement = document.getElementById('current-gif');
+        if (currentGifElement && data.current_gif) {
+            currentGifElement.textContent = data.current_gif;
+        }
+
+        const brightnessElement = document.getElementById('brightness');
+        if (brightnessElement && data.brightness !== undefined) {
+            brightnessElement.textContent = data.brightness;
+        }
+
+        // Update GIF playback status
+        if (data.gif_playback_enabled !== undefined) {
+            this.updateGifPlaybackStatus(data.gif_playback_enabled);
+        }
+    }
+
+    // Show "Connected" or "Disconnected" in the status bar when that changes
+    setConnected(connected) {
+        if (this.connected === connected) return;
+        this.connected = connected;
+        this.showConnection();
+    }
+
+    showConnection() {
+        if (this.connected) {
+            this.showMessage('Connected', 'connected', true); // Use 'connected' type for green
+        } else {
+            this.showMessage('Disconnected', 'error', true); // Use 'error' type for yellow
+        }
+    }
+
     // Get device status and update UI
     async updateStatus() {
         try {
@@ -130,45 +174,56 @@ class PixelMatrixApp {
             const data = await response.json();
             
             if (data.status === 'connected') {
-                // Update dynamic content
-                const ssidElement = document.getElementById('ssid');
-                if (ssidElement && data.ssid) {
-                    ssidElement.textContent = data.ssid;
-                }
-
-                const ipElement = document.getElementById('ip');
-                if (ipElement && data.ip) {
-                    ipElement.textContent = data.ip;
-                }
-
-                const currentGifElement = document.getElementById('current-gif');
-                if (currentGifElement && data.current_gif) {
-                    currentGifElement.textContent = data.current_gif;
-                }
-                
-                const brightnessElement = document.getElementById('brightness');
-                if (brightnessElement && data.brightness) {
-                    brightnessElement.textContent = data.brightness;
-                }
-                
-                // Update GIF playback status
-                this.updateGifPlaybackStatus(data.gif_playback_enabled);
-                
-                // Update the status bar as well
-                this.showMessage('Connected', 'connected', true); // Use 'connected' type for green
+                this.applyStatus(data);
+                this.setConnected(true);
                 console.log('Status updated:', data);
             } else {
-                this.showMessage('Disconnected', 'error', true); // Use 'error' type for yellow
+                this.setConnected(false);
             }
         } catch (error) {
             console.error('Status update failed:', error);
-            this.showMessage('Disconnected', 'error', true); // Show disconnected if status update fails
+            this.setConnected(false); // Show disconnected if status update fails
         }
     }
 
-    // Start periodic status updates
+    // Follow device status. The device pushes changes on /api/events; where
+    // that is not available, poll /api/status every 10 seconds instead.
     startStatusUpdates() {
-        // Update status every 10 seconds
+        if (!window.EventSource) {
+            this.startPolling();
+            return;
+        }
+
+        const events = new EventSource(this.baseUrl + '/api/events');
+        let opened = false;
+        let lastEvent = 0;
+        const onStatus = (event) => {
+            opened = true;
+            lastEvent = Date.now();
+            this.applyStatus(JSON.parse(event.data));
+            this.setConnected(true);
+        };
+        events.addEventListener('status', onStatus); // Whole state, on every (re)connect
+        events.addEventListener('change', onStatus);
+        events.addEventListener('ping', () => { lastEvent = Date.now(); });
+        events.onerror = () => {
+            this.setConnected(false);
+            if (!opened || events.readyState === EventSource.CLOSED) {
+                // Never got through, e.g. an older firmware, or the browser gave up: fall back to polling
+                events.close();
+                opened = false;
+                this.startPolling();
+            } // Otherwise the browser reconnects by itself
+        };
+
+        // The device pings every 15 seconds; a channel silent for much longer is gone
+        setInterval(() => {
+            if (opened && Date.now() - lastEvent > 45000) this.setConnected(false);
+        }, 5000);
+    }
+
+    // Poll status every 10 seconds
+    startPolling() {
         setInterval(() => {
             this.updateStatus();
         }, 10000);
@@ -304,8 +359,8 @@ class PixelMatrixApp {
             // If it's a transient message (not a continuous status update), remove it after a delay
             if (!isStatusBarUpdate) {
                 setTimeout(() => {
-                    // Reset to "Connected" or last known good status after transient message
-                    this.updateStatus(); // Re-fetch current status to display
+                    // Reset to "Connected" or "Disconnected" after transient message
+                    this.showConnection();
                 }, 5000); // Message disappears after 5 seconds
             }
         }
@@ -0,0 +1,15 @@
+#ifndef BLIT_H
+#define BLIT_H
+
+#include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
+
+// Runs of identical colour at least this long are written with one
+// drawFastHLine() call instead of one drawPixel() per pixel.
+#define BLIT_HLINE_MIN_RUN 3
+
+// Write a contiguous RGB565 span to row y, starting at column x
+void blitRow565(MatrixPanel_I2S_DMA *display, int x, int y, const uint16_t *span, int count);
+// Write a whole row-major RGB565 frame to the top-left of the panel
+void blitFrame565(MatrixPanel_I2S_DMA *display, const uint16_t *pixels, int width, int height);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef CACHEARENA_H
+#define CACHEARENA_H
+
+#include <Arduino.h>
+
+// A byte arena keyed by path, shared by the frame cache (framecache.h) and the
+// file cache (filecache.h). One block is allocated at boot, in PSRAM when the
+// board has it. Each entry is stored contiguously: the NUL-terminated path
+// (padded to 4 bytes) followed by its payload. Space is made by evicting
+// entries and sliding the survivors down, so free space is always at the end.
+//
+// Only one task (the decode task) may allocate, evict or read payloads. Other
+// tasks can only flag entries stale, and the owner drops those on its next
+// lookup.
+struct CacheArenaEntry {
+    bool used;
+    bool stale;         // File changed on the card, drop on next lookup
+    uint32_t pathHash;
+    uint32_t offset;    // Start of the entry in the arena
+    uint32_t bytes;     // Path plus payload
+    uint32_t lastUsed;  // Value of useClock at the last use
+};
+
+struct CacheArena {
+    uint8_t *base;
+    uint32_t size;
+    bool inPsram;
+    bool sizeWeighted;          // Evict by age * size, so big and old entries go first, not by age alone
+    CacheArenaEntry *entries;
+    int maxEntries;
+    int pinned;                 // Entry still being filled: not evicted, not found; -1 if none
+    uint32_t useClock;
+    uint32_t evictions;
+};
+
+// Function declarations
+bool cacheArenaInit(CacheArena &arena, const char *name, CacheArenaEntry *entries, int maxEntries,
+                    uint32_t psramBudget, uint32_t heapBudget);
+uint32_t cacheArenaPathBytes(const char *path);
+int cacheArenaFind(CacheArena &arena, const char *path);
+bool cacheArenaHas(CacheArena &arena, const char *path);
+void cacheArenaDropStale(CacheArena &arena);
+int cacheArenaAlloc(CacheArena &arena, const char *path, uint32_t payloadBytes);
+void cacheArenaFree(CacheArena &arena, int i);
+void cacheArenaTrim(CacheArena &arena, int i, uint32_t payloadBytes);
+void cacheArenaTouch(CacheArena &arena, int i);
+uint8_t *cacheArenaPayload(CacheArena &arena, int i);
+uint32_t cacheArenaPayloadBytes(CacheArena &arena, int i);
+void cacheArenaInvalidate(CacheArena &arena, const char *path);
+void cacheArenaInvalidateAll(CacheArena &arena);
+uint32_t cacheArenaEntryCount(CacheArena &arena);
+uint32_t cacheArenaBytesUsed(CacheArena &arena);
+
+#endif
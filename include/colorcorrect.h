@@ -0,0 +1,41 @@
+#ifndef COLORCORRECT_H
+#define COLORCORRECT_H
+
+#include <Arduino.h>
+
+// Colour correction applied to GIF palettes instead of pixels. The panel
+// library keeps its CIE 1931 table, so frames hold perceptual values and the
+// 5 and 6 bits of RGB565 are spent evenly across lightness; in linear light
+// they would leave no level between black and about 3% red. Under any other
+// curve or white balance, each palette entry is decoded to linear light
+// through the curve, multiplied by the white balance matrix and encoded as
+// the RGB565 value whose CIE 1931 light is nearest, once per frame. GIFDraw()
+// then looks pixels up in the corrected palette exactly as before. The curve
+// tables are generated at compile time.
+typedef enum {
+    COLOR_CURVE_OFF = 0,   // Channel values drive the LEDs linearly
+    COLOR_CURVE_CIE1931,   // Perceptual lightness, the panel library's own curve
+    COLOR_CURVE_GAMMA22,
+    COLOR_CURVE_GAMMA28,
+    COLOR_CURVE_COUNT
+} color_curve_t;
+
+#define COLOR_CURVE_DEFAULT COLOR_CURVE_CIE1931
+
+// White balance in linear light, rows are output R, G, B; Q12 (4096 = 1.0).
+// Identity leaves the panel's own white point alone.
+#define COLOR_WHITE_BALANCE { \
+    {4096, 0, 0},             \
+    {0, 4096, 0},             \
+    {0, 0, 4096},             \
+}
+
+extern color_curve_t colorCurve;
+
+// Function declarations
+const uint16_t *colorCorrectPalette(const uint16_t *palette, color_curve_t curve, uint16_t *corrected);
+uint8_t colorPanelDuty(uint8_t value);
+const char *colorCurveName(color_curve_t curve);
+bool parseColorCurve(const String &name, color_curve_t *curve);
+
+#endif
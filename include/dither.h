@@ -0,0 +1,52 @@
+#ifndef DITHER_H
+#define DITHER_H
+
+#include <Arduino.h>
+#include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
+
+// Temporal ordered dithering for low brightness. Dimming the panel shortens
+// every bit plane's on time, and the lowest planes stop showing, so a dim
+// panel shows fewer levels per channel than the RGB565 frame holds. The
+// planes hold LED duty, after the panel library's CIE table
+// (colorPanelDuty()), so for each channel code the presenter knows the duty
+// that survives and the next code up that shows one level more. It picks one
+// of the two per pixel by a 4x4 Bayer threshold, in proportion to the duty
+// lost, and rotates the thresholds on every refresh so each pixel averages
+// out to its true light over four refreshes.
+//
+// Per brightness level the code picked for every channel value and threshold
+// is a precomputed table, so a pixel costs one lookup per channel.
+//
+// A refresh is dithering the frame and writing all of it to the panel. The
+// write is most of the cost, so the budget, the boot benchmark and the stats
+// all cover both. Refreshes are spaced so the present task idles at least
+// DITHER_IDLE_FACTOR times as long as a refresh took.
+#define DITHER_DEFAULT_ENABLED true
+#define DITHER_PHASES 4                // Refreshes per threshold cycle
+#define DITHER_REFRESH_US 5000         // Redraw the shown frame at most this often while it is up
+#define DITHER_IDLE_FACTOR 2           // Refreshes take at most a third of the present task's time
+#define DITHER_REFRESH_BUDGET_US 2500  // One 128x32 refresh on the ESP32, so a cycle stays under 30 ms
+#define DITHER_BENCH_FRAMES 32
+
+struct DitherStats {
+    uint8_t lostBits;       // Low bits of an 8-bit channel the brightness and colour depth hide
+    bool active;            // Frames are being dithered right now
+    bool overBudget;        // The boot benchmark was too slow, dithering stays off
+    uint32_t refreshes;     // Frames drawn, re-draws of a frame while it is up included
+    uint32_t lastFrameUs;   // Time the last refresh took, dither and panel write
+    uint32_t maxFrameUs;
+    uint32_t intervalUs;    // Time between refreshes now
+    uint32_t benchFrameUs;  // ditherBenchmark() result per refresh, 0 if not run
+};
+
+extern bool ditherEnabled; // Persisted
+
+// Function declarations
+bool ditherActive();
+void ditherPresent(MatrixPanel_I2S_DMA *display, const uint16_t *pixels);
+bool ditherRefreshDue();
+void ditherRefresh(MatrixPanel_I2S_DMA *display);
+uint32_t ditherBenchmark(MatrixPanel_I2S_DMA *display, int frames);
+DitherStats getDitherStats();
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <Arduino.h>
+
+// Whole GIF files kept in RAM so repeat plays decode from memory instead of
+// the card. GIFs at most FILE_CACHE_MAX_FILE_SIZE bytes are loaded on their
+// first play; the least recently played ones are evicted to fit the budget.
+#define FILE_CACHE_MAX_FILE_SIZE (64 * 1024)
+#define FILE_CACHE_MAX_ENTRIES 48
+// With PSRAM the arena takes this much of it, or half of what is free if less
+#define FILE_CACHE_PSRAM_BUDGET (1024 * 1024)
+// Without PSRAM the cache is off unless the build sets a heap budget, which
+// comes out of the panel's DMA budget (ramplan.h)
+#ifndef FILE_CACHE_HEAP_BUDGET
+#define FILE_CACHE_HEAP_BUDGET 0
+#endif
+
+struct FileCacheStats {
+    uint32_t hits;
+    uint32_t misses;      // Cacheable GIFs loaded from the card
+    uint32_t oversized;   // Plays of GIFs too large to cache
+    uint32_t evictions;
+    uint32_t entries;
+    uint32_t bytesUsed;
+    uint32_t capacity;
+    uint32_t maxFileSize; // FILE_CACHE_MAX_FILE_SIZE, or the arena if smaller
+    bool inPsram;
+};
+
+// Function declarations
+bool initFileCache();
+bool fileCacheGet(const char *path, const uint8_t **data, int32_t *size);
+bool fileCacheHas(const char *path);
+void fileCacheInvalidate(const char *path);
+void fileCacheInvalidateAll();
+FileCacheStats getFileCacheStats();
+
+#endif
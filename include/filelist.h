@@ -0,0 +1,28 @@
+#ifndef FILELIST_H
+#define FILELIST_H
+
+#include <Arduino.h>
+
+// Directory listings for /api/files, streamed as chunked JSON straight from
+// the directory iterator. A listing holds the open directory and the JSON of
+// at most one entry, so a request needs a couple of KB however large the
+// directory is. Without paging parameters the response is the bare array of
+// entries it always was. With offset, limit or cursor it is one page:
+//   {"path":"/gifs","offset":0,"entries":[...],"count":100,"next":"<cursor>"}
+// next is null on the last page. Passed back as ?cursor= it resumes the
+// listing where the page ended, without walking the directory from the start
+// the way a larger offset does.
+#define FILE_LIST_DEFAULT_LIMIT 100
+#define FILE_LIST_MAX_LIMIT 1000
+#define FILE_LIST_MAX_OPEN 2          // Listings streamed at once, more get 503
+#define FILE_LIST_TEXT_BYTES 1600     // One entry or the page head, names fully escaped
+
+struct FileListing;
+
+// Function declarations
+FileListing *fileListOpen(const char *path, bool paged, uint32_t offset, const char *cursor, uint32_t limit,
+                          int *httpStatus, const char **message);
+size_t fileListRead(FileListing *listing, uint8_t *buf, size_t maxLen);
+void fileListClose(FileListing *listing);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <Arduino.h>
+#include "globals.h"
+
+// Only GIFs with at most this many frames are cached. A GIF's frame count
+// comes from the playlist index, which learns it the first time the GIF plays
+// to the end, so a GIF is cached from its second play on and deciding costs
+// no pass over the file.
+#define FRAME_CACHE_MAX_FRAMES 20
+#define FRAME_CACHE_MAX_ENTRIES 32
+// With PSRAM the arena takes this much of it, or half of what is free if less
+#define FRAME_CACHE_PSRAM_BUDGET (2 * 1024 * 1024)
+// Without PSRAM the cache is off unless the build sets a heap budget (see
+// ramplan.h). Each cached frame is a whole panel (8 KB at 128x32), so what
+// internal RAM can spare holds only the shortest GIFs.
+#ifndef FRAME_CACHE_HEAP_BUDGET
+#define FRAME_CACHE_HEAP_BUDGET 0
+#endif
+
+struct FrameCacheStats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t entries;
+    uint32_t bytesUsed;
+    uint32_t capacity;
+    bool inPsram;
+};
+
+// Function declarations
+bool initFrameCache();
+bool frameCachePlay(const char *path, uint32_t generation);
+bool frameCacheHas(const char *path);
+bool frameCacheEnabled();
+bool frameCacheRecordBegin(const char *path, int frameCount);
+void frameCacheRecordFrame(const uint16_t *pixels, uint16_t delayMs);
+void frameCacheRecordEnd(bool complete);
+void frameCacheInvalidate(const char *path);
+void frameCacheInvalidateAll();
+FrameCacheStats getFrameCacheStats();
+
+#endif
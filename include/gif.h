@@ -2,12 +2,42 @@
 #define _GIF_
 
 #include <AnimatedGIF.h>
+#include "scale.h"
+#include "colorcorrect.h"
+
+// Decoder memory is set up once in InitMatrixGif(): AnimatedGIF keeps its LZW
+// tables and line buffers inside the global decoder object, and the turbo
+// buffer is allocated there. AnimatedGIF never calls malloc itself, only the
+// allocation callbacks it is given, so ShowGIF() counts what those hand out.
+// After GIF_HEAP_WARMUP_GIFS, decoding a GIF must leave that count as it
+// found it. Other tasks, and the converter with its own decoder, allocate
+// elsewhere and are not counted.
+#define GIF_HEAP_WARMUP_GIFS 8
+
+struct GifHeapStats {
+    bool turbo;            // Turbo buffer allocated, decoding uses it
+    uint32_t checked;      // GIFs decoded after the warm-up
+    uint32_t violations;   // Of those, GIFs whose decoder allocated or freed
+    int32_t lastDelta;     // Bytes the decoder held after minus before, of the last violation
+};
+
+// A panel-sized canvas decoded GIF lines are composed onto. Playback has one;
+// the panel animation converter keeps its own so both can decode at once.
+struct GifCanvas {
+    uint16_t *pixels;           // MATRIX_WIDTH * MATRIX_HEIGHT, RGB565
+    Scaler *scaler;
+    color_curve_t curve;        // Curve the palettes are corrected with
+    const uint16_t *palette;    // Palette of the frame being drawn, corrected
+    uint16_t correctedPalette[256];
+};
 
 void InitMatrixGif();
-void ShowGIF(const char *name);
+bool ShowGIF(const char *name, uint32_t position);
 void GIFDraw(GIFDRAW *pDraw);
+void drawGifLine(GIFDRAW *pDraw, GifCanvas &canvas);
 int32_t GIFReadFile(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen);
 void * GIFOpenFile(const char *fname, int32_t *pSize);
 void GIFCloseFile(void *pHandle);
+GifHeapStats getGifHeapStats();
 
 #endif
\ No newline at end of file
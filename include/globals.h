@@ -20,6 +20,9 @@
 #define PANEL_RES_Y 32     // Number of pixels tall of each INDIVIDUAL panel module.
 #define PANEL_CHAIN 2      // Total number of panels chained one to another horizontally only.
 
+#define MATRIX_WIDTH  (PANEL_RES_X * PANEL_CHAIN) // Width of the whole chain in pixels
+#define MATRIX_HEIGHT PANEL_RES_Y                 // Height of the whole chain in pixels
+
 #define R1_PIN 32
 #define G1_PIN 33
 #define B1_PIN 19
@@ -63,6 +66,5 @@ extern bool allowNextGif;
 extern bool queue_populate_requred;
 extern bool gifPlaybackEnabled;
 extern unsigned long total_files;
-extern String current_gif;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <stdint.h>
+#include <atomic>
+
+// What the presenter does with a frame whose display slot has already passed
+typedef enum {
+    DROP_NEVER = 0,   // Show every frame, catch up by shortening the following waits
+    DROP_LATE_FRAMES, // Skip late frames (never the last one of a GIF) to stay on schedule
+    FRAME_DROP_POLICY_COUNT
+} frame_drop_policy_t;
+
+#define DEFAULT_FRAME_DROP_POLICY DROP_LATE_FRAMES
+#define PACING_MAX_CONSECUTIVE_DROPS 4   // Show at least every 5th frame, even when late
+#define PACING_RESYNC_US 500000UL        // Further behind than this, restart the schedule from now
+
+// Timing statistics for one GIF
+struct PacingStats {
+    uint32_t frames;         // Frames presented
+    uint32_t dropped;        // Frames skipped by the drop policy
+    uint32_t resyncs;        // Schedule restarts after a long stall
+    uint32_t avgLatenessUs;  // Mean time frames went up after their deadline
+    uint32_t maxLatenessUs;
+    uint32_t jitterUs;       // Mean change in lateness between consecutive frames
+    uint32_t authoredMs;     // Sum of the GIF's frame delays
+    uint32_t actualMs;       // Measured time from first frame to the end of the last one
+};
+
+// Schedules frames against absolute deadlines built from the cumulative frame
+// delays of a GIF, so decode or blit time never accumulates as drift.
+// Times are micros() values; all comparisons are wrap-safe.
+class FramePacer {
+public:
+    FramePacer(frame_drop_policy_t policy = DEFAULT_FRAME_DROP_POLICY);
+
+    // Any task; the presenter applies it from the next frame
+    void setPolicy(frame_drop_policy_t policy) { _policy.store(policy, std::memory_order_relaxed); }
+    frame_drop_policy_t policy() const { return _policy.load(std::memory_order_relaxed); }
+
+    // Deadline for the frame at the head of the queue
+    unsigned long beginFrame(bool firstInGif, unsigned long nowUs);
+    // Whether the drop policy skips the current frame
+    bool shouldDrop(uint16_t delayMs, bool lastInGif, unsigned long nowUs) const;
+    // Account for the current frame; returns true when it completed a GIF
+    bool endFrame(uint16_t delayMs, bool lastInGif, bool dropped, unsigned long presentUs);
+    // End the GIF in progress after its last presented frame, without a frame of
+    // its own; returns true when there was one to end
+    bool endGif(unsigned long nowUs);
+    // Abandon the GIF in progress; the next frame starts a new schedule immediately
+    void abortGif();
+
+    // Deadline of the next frame, valid while a GIF is in progress
+    unsigned long nextDeadline() const { return _deadlineUs; }
+    bool inGif() const { return _inGif; }
+    const PacingStats &lastGifStats() const { return _last; }
+
+private:
+    void finishGif(unsigned long endUs);
+
+    std::atomic<frame_drop_policy_t> _policy;
+    bool _scheduled;             // _deadlineUs holds a real schedule
+    bool _inGif;
+    unsigned long _deadlineUs;   // Deadline of the current/next frame
+    unsigned long _gifStartUs;
+    uint32_t _consecutiveDrops;
+    uint32_t _prevLatenessUs;
+    uint64_t _latenessSumUs;
+    uint64_t _jitterSumUs;
+    PacingStats _cur;
+    PacingStats _last;
+};
+
+const char *frameDropPolicyName(frame_drop_policy_t policy);
+bool parseFrameDropPolicy(const char *name, frame_drop_policy_t *policy);
+
+#endif
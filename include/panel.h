@@ -0,0 +1,60 @@
+#ifndef PANEL_H
+#define PANEL_H
+
+#include <Arduino.h>
+#include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
+#include "globals.h"
+
+// Panel DMA memory and presentation. The DMA buffers hold every bit plane of
+// every row pair, so they scale with chain length and colour depth; a second
+// buffer for tear-free flips doubles that. planPanelDma() fits the request
+// into a byte budget, trading colour depth for double buffering down to
+// PANEL_MIN_DOUBLE_BUFFER_DEPTH and falling back to one buffer after that.
+//
+// Frames are drawn incrementally: each buffer keeps the rows and columns that
+// changed since it was last drawn (damage), and panelDrawFrame() rewrites only
+// those. With two buffers each one is two frames behind, so damage from every
+// frame the present task takes, shown or not, goes to both.
+#define PANEL_DOUBLE_BUFFER_DEFAULT true
+#define PANEL_COLOR_DEPTH_BITS 8          // Bit planes per colour channel
+#define PANEL_MIN_DOUBLE_BUFFER_DEPTH 6
+#define PANEL_DMA_BUDGET (80 * 1024)      // Upper bound for all panel buffers
+#define PANEL_DMA_HEADROOM (64 * 1024)    // DMA-capable RAM left for WiFi and the SD card, past ramplan.h
+#define PANEL_DMA_DESC_BYTES 12           // One lldesc_t
+#define PANEL_MIN_REFRESH_RATE 60         // Hz, also how long a flip may take to land
+
+struct PanelDmaPlan {
+    bool doubleBuffer;
+    uint8_t colorDepthBits;
+    uint32_t bufferBytes;   // Estimate for one buffer, descriptors included
+    uint32_t totalBytes;
+    uint32_t budget;
+};
+
+// Rows the present task wrote to or skipped in the DMA buffers
+struct PanelDrawStats {
+    uint32_t rowsWritten;
+    uint32_t rowsSkipped;      // Already showing the frame's pixels
+    uint32_t lastFrameRowsWritten;
+    uint32_t fullRedraws;      // After something other than a frame was drawn
+};
+
+extern bool panelDoubleBufferRequested; // Persisted; takes effect at the next boot
+extern PanelDmaPlan panelDmaPlan;       // What the panel was started with
+
+// Function declarations
+uint32_t panelDmaBufferBytes(uint8_t colorDepthBits);
+PanelDmaPlan planPanelDma(bool doubleBuffer, uint32_t budget);
+void applyPanelDmaPlan(HUB75_I2S_CFG &config, const PanelDmaPlan &plan);
+bool panelBackBufferReady();
+void panelWaitForBackBuffer();
+void panelPresent();
+void panelAttachPresentTask();
+void panelPresentStatus();
+void panelServiceFlipRequest();
+void panelAddDamage(uint32_t rows, int x0, int x1);
+void panelInvalidate();
+void panelDrawFrame(const uint16_t *pixels);
+PanelDrawStats getPanelDrawStats();
+
+#endif
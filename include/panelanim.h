@@ -0,0 +1,97 @@
+#ifndef PANELANIM_H
+#define PANELANIM_H
+
+#include <Arduino.h>
+#include "globals.h"
+
+// Panel animations: GIFs pre-rendered for this panel, so playing them needs
+// no LZW decoding, colour correction or scaling. A background task converts
+// uploaded GIFs into PANEL_ANIM_DIR, one file per GIF named after the hash of
+// its path. ShowGIF() plays a converted GIF from there and falls back to
+// decoding the GIF for the ones not converted yet.
+//
+// File layout, little endian:
+//   PanelAnimHeader
+//   source GIF path, padded to 4 bytes (told apart from hash collisions)
+//   frame 0 payload, uint32 size of frame 1 payload, frame 1 payload, ...,
+//   frame n-1 payload, uint32 0
+//   PanelAnimTableEntry per frame, at header.tableOffset
+// A frame payload is a PanelAnimFrame followed by spanCount spans, each a
+// PanelAnimSpan and its count RGB565 pixels: the runs of a row that changed
+// since the frame before, in panel coordinates. Frame 0 is diffed against a
+// black panel. Every frame read also reads the size of the next one, so the
+// player streams the file with one sequential read per frame; the offset
+// table is there for random access.
+#define PANEL_ANIM_DIR "/.panelanim"
+#define PANEL_ANIM_MAGIC 0x32414E50    // "PNA2", frames encoded for the panel's CIE table
+#define PANEL_ANIM_MAX_FILES 1024      // Converted GIFs the in-RAM index holds
+#define PANEL_ANIM_MAX_FRAMES 1024     // Longer GIFs are not converted
+#define PANEL_ANIM_QUEUE_LEN 8
+#define PANEL_ANIM_TASK_CORE 0         // Idle priority next to the decoder
+#define PANEL_ANIM_PATH_LEN 32         // PANEL_ANIM_DIR "/xxxxxxxx.pna"
+// Converting needs about 35 KB of state, a second decoder included. With
+// PSRAM it goes there; without, converting is off unless the build sets this,
+// and converted GIFs already on the card still play.
+#ifndef PANEL_ANIM_HEAP_CONVERTER
+#define PANEL_ANIM_HEAP_CONVERTER 0
+#endif
+
+struct PanelAnimHeader {
+    uint32_t magic;
+    uint16_t width, height;    // Panel size the frames were rendered for
+    uint16_t frameCount;
+    uint16_t pathBytes;        // Source path length, without padding or terminator
+    uint8_t curve, filter, fit;   // Settings rendered with; a mismatch means reconvert
+    uint8_t reserved;
+    uint32_t dataOffset;       // Frame 0 payload
+    uint32_t firstFrameBytes;
+    uint32_t tableOffset;
+    uint32_t reserved2;
+};
+static_assert(sizeof(PanelAnimHeader) == 32, "PanelAnimHeader is written as is");
+
+struct PanelAnimFrame {
+    uint16_t delayMs;
+    uint16_t spanCount;
+};
+
+struct PanelAnimSpan {
+    uint16_t y, x0, count;
+};
+
+struct PanelAnimTableEntry {
+    uint32_t offset;           // Frame payload
+    uint16_t bytes;
+    uint16_t delayMs;
+};
+
+// Largest frame payload: every row changed end to end
+#define PANEL_ANIM_MAX_FRAME_BYTES \
+    (sizeof(PanelAnimFrame) + MATRIX_HEIGHT * (sizeof(PanelAnimSpan) + MATRIX_WIDTH * sizeof(uint16_t)))
+
+struct PanelAnimStats {
+    uint32_t converted;      // Files written since boot
+    uint32_t failed;         // Conversions given up, unreadable and too long GIFs included
+    uint32_t pending;        // Jobs waiting for the converter
+    bool converting;         // A conversion is running now
+    uint32_t jobsStarted;    // Conversions started since boot
+    uint32_t indexed;        // Converted GIFs on the card
+    uint32_t plays;          // GIFs played from a panel animation
+    uint32_t framesPlayed;
+    uint32_t fallbacks;      // Converted GIFs decoded anyway: stale settings or a bad file
+    uint32_t lastConvertMs;
+    uint32_t workBytes;      // Converter state, allocated with the first job and kept
+};
+
+// Function declarations
+bool initPanelAnim();
+uint32_t panelAnimWorkBytes();
+bool panelAnimPlay(const char *gifPath, uint32_t generation, bool *complete);
+bool panelAnimHas(const char *gifPath);
+const char *panelAnimResolve(const char *gifPath, char *buf, size_t len);
+bool panelAnimQueue(const char *gifPath);
+void panelAnimInvalidate(const char *gifPath);
+void panelAnimInvalidateAll();
+PanelAnimStats getPanelAnimStats();
+
+#endif
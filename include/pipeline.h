@@ -0,0 +1,62 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <Arduino.h>
+#include "globals.h"
+#include "pacing.h"
+
+#define FRAME_RING_SIZE 3   // Composed frames buffered between decoder and presenter
+#define DECODE_TASK_CORE 0  // AsyncTCP runs on core 1 (CONFIG_ASYNC_TCP_RUNNING_CORE)
+#define PRESENT_TASK_CORE 1
+
+#define FRAME_ALL_ROWS 0xFFFFFFFFu
+static_assert(MATRIX_HEIGHT <= 32, "Frame::dirtyRows has one bit per panel row");
+
+// One fully composed frame, ready to be handed to the panel
+struct Frame {
+    uint16_t pixels[MATRIX_WIDTH * MATRIX_HEIGHT]; // RGB565, row major
+    uint16_t delayMs;  // Authored display time, the present task schedules against it
+    bool firstInGif;
+    bool lastInGif;
+    bool endsGif;        // No picture: the GIF stopped early, the presenter just closes its schedule
+    uint32_t generation; // frameRingGeneration() when the GIF started; older frames are flushed
+    uint32_t dirtyRows;  // Rows that differ from the frame committed before this one, see frameMarkDirty()
+    uint16_t dirtyX0, dirtyX1; // Columns [x0, x1) the changes lie in
+    uint32_t decodeUs;   // Producer time spent making the frame, waiting for its slot excluded
+};
+
+// Pipeline counters, safe to read from any task
+struct PipelineStats {
+    uint32_t queueDepth;      // Frames currently waiting in the ring
+    uint32_t peakQueueDepth;
+    uint32_t underruns;       // Presenter was due a frame but the ring was empty
+    uint32_t framesPresented;
+    uint32_t flushes;         // Play/next/pause requests that discarded queued frames
+    uint32_t lastPreemptUs;   // Request receipt to first frame of the new GIF on the panel
+    uint32_t maxPreemptUs;
+};
+
+// Sees every frame the decoder commits, on the decode task, before the presenter does
+typedef void (*frame_observer_cb)(const Frame *frame);
+// Microseconds Frame::decodeUs is measured in; micros() unless replaced
+typedef uint32_t (*frame_clock_cb)();
+
+// Function declarations
+bool initPlaybackPipeline();
+void startPlaybackPipeline(void (*decodeLoop)());
+Frame *frameRingAcquire();
+void frameMarkDirty(Frame *frame, uint32_t candidateRows, int x0, int x1);
+void frameRingCommit();
+void frameRingEndGif(uint32_t generation);
+void frameRingWaitEmpty();
+uint32_t frameRingGeneration();
+void frameRingFlush(bool timeNextGif, unsigned long requestUs);
+PipelineStats getPipelineStats();
+void setFrameDropPolicy(frame_drop_policy_t policy);
+frame_drop_policy_t getFrameDropPolicy();
+PacingStats getLastPacingStats();
+void setFrameObserver(frame_observer_cb observer);
+void setFrameClock(frame_clock_cb clock);
+uint32_t frameClockUs();
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef PLAYCONTROL_H
+#define PLAYCONTROL_H
+
+#include <Arduino.h>
+
+// Requests from the web API that preempt the GIF on screen. Each one flushes
+// the frame ring, which bumps its generation; the decoder compares that with
+// the generation its GIF started in at every frame boundary, so the current
+// GIF stops within one frame.
+#define PLAY_REQUEST_PATH_LEN 256
+
+// Function declarations (web API side)
+void requestPlayNow(const char *path, unsigned long receivedUs);
+void requestNextGif(unsigned long receivedUs);
+void requestPlaybackStop();
+
+// Function declarations (decode side)
+uint32_t beginPlayback();
+bool playbackInterrupted(uint32_t generation);
+bool takePlayNowRequest(char *path, size_t len);
+
+#endif
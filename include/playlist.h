@@ -0,0 +1,80 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include <Arduino.h>
+#include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
+
+// Binary index of the GIFs in GIF_DIR, kept on the card:
+//   IndexHeader | IndexRecord[count] | string table (NUL-terminated file names)
+// Records are fixed width, so entry i is one seek away.
+#define PLAYLIST_INDEX_PATH "/.gifindex"
+#define PLAYLIST_INDEX_TMP_PATH "/.gifindex.tmp"
+#define PLAYLIST_INDEX_MAGIC 0x31584947 // "GIX1"
+#define PLAYLIST_INDEX_VERSION 3
+
+// Changes made through the web API since the index was built are appended to
+// a journal and applied on top of the index, until a background compaction
+// folds them into a new index.
+//
+// At boot the index and journal are trusted while GIF_DIR's modification time
+// matches the one recorded in the header; only then is the directory walked.
+// A host that changes files without touching the directory's time needs an
+// explicit rescan (/api/playlist/rescan).
+#define PLAYLIST_JOURNAL_PATH "/.gifjournal"
+#define PLAYLIST_JOURNAL_TMP_PATH "/.gifjournal.tmp"
+#define PLAYLIST_COMPACT_THRESHOLD 4096 // Journal bytes that trigger a compaction
+#define PLAYLIST_MAX_ADDED 256          // GIFs added between two compactions
+#define PLAYLIST_PENDING_MAX 32         // Changes the web API can queue between two GIFs
+
+// A GIF played from outside the playlist (e.g. a play-now request)
+#define PLAYLIST_NO_POSITION 0xFFFFFFFFu
+
+struct IndexHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t count;          // Number of records
+    uint32_t stringsSize;    // Bytes in the string table
+    uint32_t fingerprint;    // Sum of the name and size hashes, so journal entries can update it
+    uint32_t dirStamp;       // GIF_DIR's FAT modify date << 16 | time when last checked, 0 if unknown
+};
+
+struct IndexRecord {
+    uint32_t nameOffset;     // Into the string table
+    uint16_t nameLength;     // Without the terminating NUL
+    uint16_t frameCount;     // Learned the first time the GIF plays to the end, 0 until then
+    uint32_t fileSize;
+};
+
+typedef enum {
+    JOURNAL_ADD = 1,
+    JOURNAL_REMOVE = 2,
+} journal_op_t;
+
+struct JournalRecord {
+    uint8_t op;              // journal_op_t
+    uint8_t reserved;
+    uint16_t nameLength;     // Followed by the file name, no NUL
+    uint32_t fileSize;       // Of an added GIF, as of the change
+};
+
+typedef void (*playlist_path_cb)(uint32_t index, const char *path);
+
+// Function declarations (playback side)
+bool playlistOpen(MatrixPanel_I2S_DMA *dma_display);
+uint32_t playlistCount();
+uint32_t playlistLiveCount();
+bool playlistIsLive(uint32_t index);
+bool playlistGetPath(uint32_t index, char *path, size_t len);
+uint32_t playlistReadRange(uint32_t start, uint32_t count, playlist_path_cb onPath);
+uint16_t playlistFrameCount(uint32_t index);
+void playlistSetFrameCount(uint32_t index, uint16_t frames);
+bool playlistSync();
+
+// Function declarations (web API side)
+void playlistNotifyAdded(const char *path);
+void playlistNotifyRemoved(const char *path);
+void playlistNotifyRenamed(const char *from, const char *to);
+void playlistNotifyRescan();
+
+#endif
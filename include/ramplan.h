@@ -0,0 +1,31 @@
+#ifndef RAMPLAN_H
+#define RAMPLAN_H
+
+#include <Arduino.h>
+
+// Internal RAM plan. Without PSRAM (esp32dev) the panel DMA buffers share
+// about 300 KB of internal RAM with the frame ring, the decoder, the caches,
+// the converter, uploads and WiFi. What is allocated after the panel is
+// decided before it, here, so the panel's DMA budget is what is free less all
+// of that and PANEL_DMA_HEADROOM. With PSRAM the caches and the converter
+// live there and cost no internal RAM. Without it they stay off unless the
+// build gives them internal RAM: FRAME_CACHE_HEAP_BUDGET, FILE_CACHE_HEAP_BUDGET
+// and PANEL_ANIM_HEAP_CONVERTER.
+struct RamPlan {
+    bool psram;
+    bool converter;             // Panel animations can be converted, not just played
+    uint32_t frameRingBytes;
+    uint32_t turboBytes;        // Turbo GIF decoding buffer
+    uint32_t uploadBytes;       // Buffers of the uploads that may run at once
+    uint32_t frameCacheBytes;   // Internal RAM only, 0 when in PSRAM or off
+    uint32_t fileCacheBytes;
+    uint32_t converterBytes;
+    uint32_t totalBytes;        // Internal RAM allocated after the panel
+};
+
+extern RamPlan ramPlan; // Set once at boot, before the panel starts
+
+// Function declarations
+RamPlan planInternalRam(bool psram);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+#include <Arduino.h>
+#include "globals.h"
+
+// Maps GIF canvases of any size onto the panel while they decode. When a GIF
+// opens, planScale() works out where its canvas lands on the panel and builds
+// a column map (source column per panel column) and a row map (source row per
+// panel row). GIFDraw() then asks scaleRowVisible() whether a decoded line
+// lands on any panel row at all, and skips the palette and pixel work if not.
+// Canvases that need no scaling take a direct 1:1 path. The panel rows and
+// columns each frame drew into are kept for dirty tracking (frameMarkDirty()).
+// Each decoder has its own Scaler: playback uses playbackScaler, the panel
+// animation converter (panelanim.h) another one on its own task.
+typedef enum {
+    SCALE_FILTER_NEAREST = 0,  // One source pixel per panel pixel
+    SCALE_FILTER_BOX,          // Average of a 2x2 source block, when shrinking
+    SCALE_FILTER_COUNT
+} scale_filter_t;
+
+typedef enum {
+    SCALE_FIT_LETTERBOX = 0,   // Scale up or down until it touches two edges, bars on the others
+    SCALE_FIT_FIT,             // Only shrink GIFs larger than the panel, smaller ones stay 1:1
+    SCALE_FIT_FILL,            // Scale to cover the whole panel, cropping the overhang
+    SCALE_FIT_COUNT
+} scale_fit_t;
+
+#define SCALE_FILTER_DEFAULT SCALE_FILTER_BOX
+#define SCALE_FIT_DEFAULT SCALE_FIT_FIT
+
+struct ScaleStats {
+    uint16_t srcWidth, srcHeight;  // Canvas of the GIF playing now
+    int16_t outX, outY;            // Where the scaled canvas lands, negative when cropped
+    uint16_t outWidth, outHeight;
+    uint32_t rowsDrawn;            // Decoded lines written to the canvas
+    uint32_t rowsSkipped;          // Decoded lines that landed on no panel row
+};
+
+// Plan and per-frame state of one decoder
+struct Scaler {
+    int srcW, srcH;
+    int outX, outY, outW, outH;     // Scaled canvas in panel coordinates
+    int x0, x1, y0, y1;             // Panel columns and rows it covers
+    bool unscaled;                  // 1:1, the maps are not used
+    bool box;
+    scale_filter_t filter;          // Settings the plan was made with
+    scale_fit_t fit;
+    uint16_t colMap[MATRIX_WIDTH];  // Source column for each covered panel column
+    uint16_t rowMap[MATRIX_HEIGHT];
+    bool rowTouched[MATRIX_HEIGHT]; // Box filter: panel row already holds one source row this frame
+    uint32_t damageRows;            // Panel rows drawn since scaleBeginFrame(), one bit per row
+    int damageX0, damageX1;
+    uint32_t rowsDrawn;
+    uint32_t rowsSkipped;
+};
+
+extern scale_filter_t scaleFilter; // Persisted, used from the next GIF on
+extern scale_fit_t scaleFit;
+extern Scaler playbackScaler;      // Owned by the decode task
+
+// Function declarations
+void planScale(Scaler &scaler, int srcWidth, int srcHeight);
+void scaleBeginFrame(Scaler &scaler);
+uint32_t scaleFrameDamage(const Scaler &scaler, int *x0, int *x1);
+bool scaleRowVisible(Scaler &scaler, int srcY);
+void scaleDrawRow(Scaler &scaler, uint16_t *canvas, const uint8_t *pixels, int frameX, int frameWidth,
+                  int srcY, const uint16_t *palette, int transparent);
+ScaleStats getScaleStats();
+const char *scaleFilterName(scale_filter_t filter);
+const char *scaleFitName(scale_fit_t fit);
+bool parseScaleFilter(const String &name, scale_filter_t *filter);
+bool parseScaleFit(const String &name, scale_fit_t *fit);
+
+#endif
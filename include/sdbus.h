@@ -0,0 +1,50 @@
+#ifndef SDBUS_H
+#define SDBUS_H
+
+#include <Arduino.h>
+
+// Arbitration of the SD card between the tasks that use it. SdFat is not
+// thread safe, so every card access holds sdLock(). Waiters are served by
+// class rather than arrival: playback reads first, then the web API, then
+// bulk work (uploads, panel animation conversion, index compaction). A class
+// kept waiting SD_BUS_STARVE_MS is served next regardless, so bulk work
+// still gets through while a GIF plays.
+//
+// The SD I/O task runs card work handed to it with sdBusSubmit(): read-ahead
+// windows and GIF opens for the decoder (sdreader.h) and upload flushes
+// (upload.h), one queue per class, always the most urgent job first. Each
+// class counts how long its jobs sat in the queue and how long its lock
+// requests waited for the card.
+typedef enum {
+    SD_IO_PLAYBACK = 0,
+    SD_IO_INTERACTIVE,
+    SD_IO_BULK,
+    SD_IO_CLASSES
+} sd_io_class_t;
+
+#define SD_BUS_STARVE_MS 50
+#define SD_BUS_TASK_CORE 0           // Next to the decoder, away from AsyncTCP
+#define SD_BUS_QUEUE_LEN 4           // Jobs per class
+
+typedef void (*sd_job_fn)(void *arg);
+
+struct SdBusClassStats {
+    uint32_t locks;          // sdLock() calls that took the card
+    uint32_t contended;      // ...of which had to wait for another task
+    uint32_t avgLockWaitUs;  // Over the contended ones
+    uint32_t maxLockWaitUs;
+    uint32_t jobs;           // Jobs run by the SD I/O task
+    uint32_t avgQueueWaitUs;
+    uint32_t maxQueueWaitUs;
+    uint32_t queued;         // Waiting now
+};
+
+// Function declarations
+bool initSdBus();
+void sdLock(sd_io_class_t ioClass = SD_IO_INTERACTIVE);
+void sdUnlock();
+bool sdBusSubmit(sd_io_class_t ioClass, sd_job_fn fn, void *arg);
+SdBusClassStats getSdBusStats(sd_io_class_t ioClass);
+const char *sdIoClassName(sd_io_class_t ioClass);
+
+#endif
@@ -10,11 +10,12 @@
 #include <FS.h>
 #include <SdFat.h>
 #include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
-#include <vector>
+#include "sdbus.h"
 
 // Constants
 #define BATCH_SIZE 10
 #define MAX_GIF_PATH_LEN 256
+#define GIF_PATH_ARENA_SIZE (BATCH_SIZE * MAX_GIF_PATH_LEN) // Worst case for one batch
 
 // SD Card pin definitions
 #define SD_CS_PIN    4    // SD card chip select pin
@@ -25,13 +26,21 @@
 // Global SD-related variables
 extern SdFs sd;
 extern bool sdError;
-extern std::vector<char*> gifFilePaths;
 extern unsigned long total_files;
-extern String current_gif;
+
+// Heap state sampled around every batch load
+struct HeapStats {
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;      // Low-water mark since boot
+    uint32_t largestFreeBlock; // Fragmentation: biggest single allocation possible
+};
+extern HeapStats heapBeforeBatch;
+extern HeapStats heapAfterBatch;
 
 // Batch processing variables
 extern unsigned long total_gifs_count;
 extern unsigned long current_batch_start;
+extern unsigned long current_batch_end;     // Position after the batch, where the next one starts
 extern bool batch_processing_complete;
 
 // Function declarations
@@ -40,6 +49,14 @@ void listRootDirectories(MatrixPanel_I2S_DMA *dma_display);
 bool countTotalGifs(MatrixPanel_I2S_DMA *dma_display);
 bool loadNextGifBatch(MatrixPanel_I2S_DMA *dma_display);
 void clearGifFilePaths();
+size_t gifPathCount();
+const char *gifPath(size_t i);
+uint32_t gifPathIndex(size_t i);
+void remapGifPathIndices(uint32_t (*remap)(uint32_t position, const char *path));
+void setCurrentGif(const char *path);
+void getCurrentGif(char *buf, size_t len);
+String currentGif();
+HeapStats sampleHeap();
 void displayStatus(MatrixPanel_I2S_DMA *dma_display, const char* message, uint16_t color);
 void displayStatus(MatrixPanel_I2S_DMA *dma_display, const char* line1, const char* line2, uint16_t color);
 void displayStatus(MatrixPanel_I2S_DMA *dma_display, const char* line1, const char* line2, const char* line3, uint16_t color);
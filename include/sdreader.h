@@ -0,0 +1,37 @@
+#ifndef SDREADER_H
+#define SDREADER_H
+
+#include <Arduino.h>
+
+// Buffered reads of GIF files for the decoder. Reads are whole, sector
+// aligned windows; each file has two, and while the decoder works through one
+// the SD I/O task (sdbus.h) fills the other with the following window. It
+// also opens the next playlist entry and reads its first window while the
+// current GIF plays, so switching GIFs does not wait on the card. All of it
+// is playback class card work, served ahead of uploads and conversion.
+#define SD_READ_SECTOR 512
+#define SD_READ_WINDOW 4096          // Bytes per card read, a multiple of SD_READ_SECTOR
+#define SD_LATENCY_BUCKETS 64        // Read latency histogram, 4 buckets per power of two
+#define SD_READER_STALE_PATHS 8      // Invalidations remembered; past that every open file is stale
+
+// Card reads made for GIF playback, safe to read from any task
+struct SdReadStats {
+    uint32_t reads;          // Windows read from the card
+    uint64_t bytes;
+    uint32_t bytesPerSec;    // Throughput while reading
+    uint32_t avgLatencyUs;
+    uint32_t p99LatencyUs;   // Upper bound of the histogram bucket
+    uint32_t readAheadHits;  // Windows the decoder found already read
+    uint32_t prefetchHits;   // GIFs opened from a prefetched file
+};
+
+// Function declarations
+bool initSdReader();
+void *sdReaderOpen(const char *path, int32_t *size);
+void sdReaderClose(void *handle);
+int32_t sdReaderRead(void *handle, uint32_t pos, uint8_t *buf, int32_t len);
+void sdReaderHint(const char *current, const char *next);
+void sdReaderInvalidate(const char *path);
+SdReadStats getSdReadStats();
+
+#endif
@@ -9,5 +9,19 @@ void loadBrightnessFromPreferences();
 void saveBrightnessToPreferences();
 void loadGifPlaybackFromPreferences();
 void saveGifPlaybackToPreferences();
+void loadPlaybackModeFromPreferences();
+void savePlaybackModeToPreferences();
+void saveShuffleStateToPreferences(uint32_t position);
+void saveShufflePositionToPreferences(uint32_t position);
+void loadPanelBufferingFromPreferences();
+void savePanelBufferingToPreferences();
+void loadColorCurveFromPreferences();
+void saveColorCurveToPreferences();
+void loadDitherFromPreferences();
+void saveDitherToPreferences();
+void loadScalingFromPreferences();
+void saveScalingToPreferences();
+void loadFrameDropPolicyFromPreferences();
+void saveFrameDropPolicyToPreferences();
 
 #endif
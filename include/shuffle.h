@@ -0,0 +1,38 @@
+#ifndef SHUFFLE_H
+#define SHUFFLE_H
+
+#include <Arduino.h>
+
+// Shuffle walks a seeded permutation of the playlist positions
+// [0, domain) instead of shuffling a list of paths, so it needs the same few
+// bytes of state for 50 GIFs or 50000. The permutation is a Feistel network
+// over the next even power of two, cycle-walked back into range, so every
+// position comes up exactly once per cycle. Each cycle gets a new seed.
+//
+// The domain is fixed when a cycle starts: GIFs added during a cycle join the
+// next one, and positions that no longer exist are skipped.
+typedef enum {
+    PLAYBACK_SEQUENTIAL = 0,
+    PLAYBACK_SHUFFLE = 1,
+} playback_mode_t;
+
+#define SHUFFLE_FEISTEL_ROUNDS 4
+// The position is written to NVS at most this often, not once per GIF, to
+// spare the flash. A reboot replays the GIFs played since the last write.
+#define SHUFFLE_SAVE_INTERVAL_MS (5 * 60 * 1000UL)
+
+extern playback_mode_t playbackMode;
+extern uint32_t shuffleSeed;
+extern uint32_t shufflePosition; // Next slot of the permutation to play
+extern uint32_t shuffleDomain;   // playlistCount() when the cycle started
+
+// Function declarations
+uint32_t shufflePermute(uint32_t position, uint32_t domain, uint32_t seed);
+void shuffleBeginCycle(uint32_t domain);
+uint32_t shuffleNext(uint32_t domain);
+void shuffleShowing();
+bool shufflePeek(uint32_t *index);
+const char *playbackModeName(playback_mode_t mode);
+bool parsePlaybackMode(const String &name, playback_mode_t *mode);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef STATUSFEED_H
+#define STATUSFEED_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Pushes playback state to the web UI as Server-Sent Events on /api/events,
+// in place of polling /api/status. A client gets a "status" event with the
+// whole state when it connects. After that it gets "change" events that hold
+// only the fields that changed, e.g. {"current_gif":"/gifs/cat.gif"}. The
+// state is sampled from the clients' AsyncTCP polls, about every
+// STATUS_FEED_INTERVAL_MS, so a burst of changes goes out as one event. Each event is serialized once
+// and the same bytes are queued to every client. A "ping" event every
+// STATUS_FEED_PING_MS lets a client tell an idle channel from a dead one.
+// /api/status stays, with the full counters, for diagnostics.
+#define STATUS_FEED_INTERVAL_MS 500     // How often AsyncTCP polls a connection
+#define STATUS_FEED_PING_MS 15000
+#define STATUS_FEED_TEXT_BYTES 768     // The full state, with room to escape current_gif
+
+struct StatusFeedStats {
+    uint32_t clients;          // Connected now
+    uint32_t connects;
+    uint32_t changes;          // "change" events sent
+    uint32_t bytes;            // Event payload bytes, counted once per event
+};
+
+// Function declarations
+void setupStatusFeed(AsyncWebServer &server);
+StatusFeedStats getStatusFeedStats();
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <Arduino.h>
+#include "globals.h"
+
+// Writes an upload to the SD card through one open handle. TCP chunks come in
+// whatever sizes the network delivers. They are gathered in a buffer and go
+// to the card as whole, sector-aligned runs of UPLOAD_BUFFER_BYTES, which
+// SdFat writes as multi-sector transfers past its sector cache. Only the
+// tail is written short, when the upload finishes. The writes are bulk class
+// jobs for the SD I/O task (sdbus.h), write-behind: the next chunks fill the
+// other half of the buffer meanwhile, and the web server only waits when
+// the card falls a whole buffer behind. The file is preallocated from the
+// request's Content-Length (an upper bound, multipart framing included) and
+// cut to the bytes received at the end. Uploads are written under a temporary
+// name and put in place with uploadCommit(), which first calls the hook set
+// with uploadSetReplaceHook() so nothing keeps reading the file it replaces.
+//
+// Each upload has its own writer, tied to its request, so uploads from
+// different clients never share state. Only UPLOAD_MAX_WRITERS hold a buffer
+// at once; the internal RAM plan (ramplan.h) reserves that much.
+#define UPLOAD_SECTOR_BYTES 512
+#define UPLOAD_BUFFER_BYTES (16 * UPLOAD_SECTOR_BYTES)
+#define UPLOAD_MAX_WRITERS 2
+#define UPLOAD_TEMP_SUFFIX ".part"
+#define UPLOAD_OLD_SUFFIX ".old"     // The replaced file while the upload is renamed into place
+
+struct UploadWriter {
+    FsFile file;
+    String path;               // File being written, the temporary name
+    bool resumed;              // Opened by uploadResume(): kept on abort
+    uint64_t base;             // File offset the upload started at
+    uint8_t *buffer;           // Two halves of UPLOAD_BUFFER_BYTES, heap, held only while an upload runs
+    uint8_t half;              // The one being filled
+    size_t buffered;
+    bool flushing;             // The other half is queued for or being written by the SD I/O task
+    bool flushOk;
+    SemaphoreHandle_t flushDone;
+    uint64_t received;         // Bytes handed to uploadWrite()
+    uint32_t writes;           // Card writes
+    uint32_t startMs;
+    uint32_t writeMs;          // Time spent in card writes
+    uint32_t stallMs;          // Time uploadWrite() waited for the card
+    uint32_t elapsedMs;        // Set by uploadFinish()
+    uint32_t kbps;             // Achieved rate, set by uploadFinish()
+    bool active;
+    const char *error;         // Why the upload failed, null while it has not
+    int errorStatus;           // HTTP status to answer with
+};
+
+struct UploadStats {
+    uint32_t completed;
+    uint32_t failed;
+    uint64_t bytes;            // Over all completed uploads
+    uint32_t lastBytes;
+    uint32_t lastMs;
+    uint32_t lastKBps;
+    uint32_t lastWriteMs;      // Part of lastMs spent writing to the card
+    uint32_t lastWrites;
+    uint32_t lastStallMs;
+};
+
+// Function declarations
+bool uploadBegin(UploadWriter &writer, const char *path, uint64_t expectedBytes);
+bool uploadResume(UploadWriter &writer, const char *path, uint64_t offset);
+bool uploadWrite(UploadWriter &writer, const uint8_t *data, size_t len);
+bool uploadFinish(UploadWriter &writer);
+void uploadAbort(UploadWriter &writer);
+void uploadRelease(UploadWriter &writer);
+bool uploadCommit(const char *tempPath, const char *path);
+void uploadSetReplaceHook(void (*hook)(const char *path));
+UploadStats getUploadStats();
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef UPLOADSESSION_H
+#define UPLOADSESSION_H
+
+#include <Arduino.h>
+#include "sdcard.h"
+
+// Resumable GIF uploads. A client opens a session for a file name, size and
+// the CRC32 of the whole file, and PUTs the file in chunks, each with its
+// Content-Range and CRC32. Every chunk is written to
+// UPLOAD_SESSION_DIR/<id>.part through an UploadWriter (upload.h). A chunk
+// counts only once its CRC matches. The verified length and the CRC32 of the
+// bytes up to it are then saved in <id>.ses, so they survive a dropped
+// connection and a reboot. Reopening the session for the same name, size and
+// file CRC, from any connection, returns that offset to resume from; another
+// file of the same name and size gets a new session. Data past the offset
+// is discarded when the next chunk arrives. Once the last byte is verified
+// and the whole file's CRC matches, the file is put in GIF_DIR with
+// uploadCommit(). With UPLOAD_SESSION_MAX sessions unfinished, opening a new
+// one drops the least recently used.
+#define UPLOAD_SESSION_DIR "/.uploads"
+#define UPLOAD_SESSION_MAGIC 0x33534C55   // "ULS3"
+#define UPLOAD_SESSION_MAX 4              // Unfinished sessions kept on the card
+#define UPLOAD_CHUNK_IDLE_MS 10000        // A chunk silent this long may be taken over
+
+struct UploadSessionRecord {
+    uint32_t magic;
+    uint32_t id;
+    uint64_t size;
+    uint64_t offset;           // Bytes verified
+    uint32_t fileCrc;          // CRC32 of the whole file, from the client
+    uint32_t verifiedCrc;      // CRC32 of the bytes before offset
+    uint32_t lastUsed;         // Session clock when last opened or extended; the lowest is dropped first
+    char path[MAX_GIF_PATH_LEN];
+};
+
+struct UploadSessionResult {
+    uint32_t id;
+    uint64_t size;
+    uint64_t offset;
+    uint32_t fileCrc;
+    bool committed;            // The file is in place and the session gone
+    char path[MAX_GIF_PATH_LEN];
+    uint32_t chunk;            // Chunk token from uploadChunkBegin()
+    uint32_t kbps;             // Rate the chunk was written at
+    int status;                // HTTP status; 200 when all went well
+    const char *message;
+};
+
+// Function declarations
+bool uploadSessionOpen(const char *path, uint64_t size, uint32_t fileCrc, UploadSessionResult *result);
+bool uploadSessionGet(uint32_t id, UploadSessionResult *result);
+bool uploadSessionCancel(uint32_t id);
+bool uploadChunkBegin(uint32_t id, uint64_t first, uint64_t last, uint64_t size, uint32_t crc,
+                      UploadSessionResult *result);
+void uploadChunkWrite(uint32_t chunk, const uint8_t *data, size_t len);
+bool uploadChunkEnd(uint32_t chunk, UploadSessionResult *result);
+uint32_t uploadCrc32(uint32_t crc, const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,100 @@
+#include "Arduino.h"
+#include <stdarg.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+static std::atomic<bool> fastClock(false);
+static std::atomic<uint64_t> skippedUs(0); // Time fast-forwarded instead of slept
+
+void nativeSetFastClock(bool fast) {
+    fastClock.store(fast);
+}
+
+static std::atomic<size_t> psramSize(NATIVE_PSRAM_DEFAULT);
+static std::atomic<size_t> psramUsed(0);
+
+void nativeSetPsram(size_t bytes) {
+    psramSize.store(bytes);
+}
+
+bool psramFound() {
+    return psramSize.load() > 0;
+}
+
+void *ps_malloc(size_t size) {
+    size_t used = psramUsed.load();
+    do {
+        if (size > psramSize.load() - min(used, psramSize.load())) return nullptr;
+    } while (!psramUsed.compare_exchange_weak(used, used + size));
+    return malloc(size);
+}
+
+uint32_t EspClass::getPsramSize() {
+    return (uint32_t)psramSize.load();
+}
+
+uint32_t EspClass::getFreePsram() {
+    size_t size = psramSize.load(), used = psramUsed.load();
+    return (uint32_t)(used < size ? size - used : 0);
+}
+
+unsigned long micros() {
+    uint64_t real = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime).count();
+    return (unsigned long)(uint32_t)(real + skippedUs.load(std::memory_order_relaxed));
+}
+
+unsigned long millis() {
+    uint64_t real = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime).count();
+    return (unsigned long)(uint32_t)((real + skippedUs.load(std::memory_order_relaxed)) / 1000);
+}
+
+void delay(unsigned long ms) {
+    if (fastClock.load(std::memory_order_relaxed)) {
+        skippedUs.fetch_add((uint64_t)ms * 1000, std::memory_order_relaxed);
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+uint32_t esp_random() {
+    static std::random_device device;
+    static std::mutex lock;
+    std::lock_guard<std::mutex> guard(lock);
+    return device();
+}
+
+String::String(double v, int decimals) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    _s = buf;
+}
+
+void String::replace(const String &from, const String &to) {
+    if (from._s.empty()) return;
+    size_t pos = 0;
+    while ((pos = _s.find(from._s, pos)) != std::string::npos) {
+        _s.replace(pos, from._s.length(), to._s);
+        pos += to._s.length();
+    }
+}
+
+size_t Print::printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vprintf(format, args);
+    va_end(args);
+    return n > 0 ? (size_t)n : 0;
+}
@@ -0,0 +1,140 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Just enough of the ESP32 Arduino core to run the playback path on a host.
+// Time comes from the host's monotonic clock, optionally fast-forwarded
+// (see nativeSetFastClock) so benchmarks do not sit out GIF frame delays.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <new>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+using std::min;
+using std::max;
+
+#define IRAM_ATTR
+#define PROGMEM
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+// Native only: make delay()/vTaskDelay() advance a virtual clock instead of sleeping
+void nativeSetFastClock(bool fast);
+// Native only: PSRAM the simulated board has, NATIVE_PSRAM_DEFAULT unless set;
+// 0 is a board without any, like esp32dev
+#define NATIVE_PSRAM_DEFAULT (4 * 1024 * 1024)
+void nativeSetPsram(size_t bytes);
+
+class String {
+public:
+    String(const char *s = "") : _s(s ? s : "") {}
+    String(const std::string &s) : _s(s) {}
+    String(char c) : _s(1, c) {}
+    String(int v) : _s(std::to_string(v)) {}
+    String(unsigned int v) : _s(std::to_string(v)) {}
+    String(long v) : _s(std::to_string(v)) {}
+    String(unsigned long v) : _s(std::to_string(v)) {}
+    String(double v, int decimals = 2);
+
+    const char *c_str() const { return _s.c_str(); }
+    unsigned length() const { return _s.length(); }
+    bool isEmpty() const { return _s.empty(); }
+    bool reserve(unsigned size) { _s.reserve(size); return true; }
+    char operator[](unsigned i) const { return i < _s.length() ? _s[i] : 0; }
+
+    bool startsWith(const String &prefix) const { return _s.compare(0, prefix._s.length(), prefix._s) == 0; }
+    bool endsWith(const String &suffix) const {
+        return _s.length() >= suffix._s.length() &&
+               _s.compare(_s.length() - suffix._s.length(), suffix._s.length(), suffix._s) == 0;
+    }
+    int indexOf(char c, unsigned from = 0) const { size_t i = _s.find(c, from); return i == std::string::npos ? -1 : (int)i; }
+    int indexOf(const String &s, unsigned from = 0) const { size_t i = _s.find(s._s, from); return i == std::string::npos ? -1 : (int)i; }
+    int lastIndexOf(char c) const { size_t i = _s.rfind(c); return i == std::string::npos ? -1 : (int)i; }
+    String substring(unsigned from, unsigned to) const { return from < to && from < _s.length() ? String(_s.substr(from, to - from)) : String(); }
+    String substring(unsigned from) const { return from < _s.length() ? String(_s.substr(from)) : String(); }
+    long toInt() const { return strtol(_s.c_str(), nullptr, 10); }
+    void toLowerCase() { std::transform(_s.begin(), _s.end(), _s.begin(), ::tolower); }
+    void remove(unsigned index, unsigned count = 1) { if (index < _s.length()) _s.erase(index, count); }
+    void replace(const String &from, const String &to);
+    bool concat(const char *s, unsigned len) { _s.append(s, len); return true; }
+
+    String &operator+=(const String &s) { _s += s._s; return *this; }
+    String &operator+=(const char *s) { _s += s; return *this; }
+    String &operator+=(char c) { _s += c; return *this; }
+    friend String operator+(const String &a, const String &b) { return String(a._s + b._s); }
+    friend String operator+(const String &a, const char *b) { return String(a._s + b); }
+    friend String operator+(const char *a, const String &b) { return String(a + b._s); }
+    bool operator==(const String &s) const { return _s == s._s; }
+    bool operator==(const char *s) const { return _s == s; }
+    bool operator!=(const String &s) const { return _s != s._s; }
+    bool operator!=(const char *s) const { return _s != s; }
+
+private:
+    std::string _s;
+};
+
+class Print {
+public:
+    size_t print(const char *s) { return fputs(s, stdout) >= 0 ? strlen(s) : 0; }
+    size_t print(const String &s) { return print(s.c_str()); }
+    size_t print(char c) { return putchar(c) == c ? 1 : 0; }
+    size_t print(long v) { return printf("%ld", v); }
+    size_t print(unsigned long v) { return printf("%lu", v); }
+    size_t print(int v) { return print((long)v); }
+    size_t print(unsigned int v) { return print((unsigned long)v); }
+    size_t print(double v, int decimals = 2) { return printf("%.*f", decimals, v); }
+    size_t println() { return print("\n"); }
+    template <class T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    size_t write(const uint8_t *buf, size_t len) { return fwrite(buf, 1, len, stdout); }
+};
+
+class HardwareSerial : public Print {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    void flush() { fflush(stdout); }
+};
+extern HardwareSerial Serial;
+
+// Heap figures have no meaning on a host; they report zero. PSRAM is the
+// simulated size, less everything ps_malloc() handed out (frees are not seen).
+class EspClass {
+public:
+    uint32_t getFreeHeap() { return 0; }
+    uint32_t getMinFreeHeap() { return 0; }
+    uint32_t getMaxAllocHeap() { return 0; }
+    uint32_t getFreePsram();
+    uint32_t getPsramSize();
+    void restart() { exit(0); }
+};
+extern EspClass ESP;
+
+bool psramFound();
+void *ps_malloc(size_t size); // nullptr once the simulated PSRAM is used up
+uint32_t esp_random();
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#endif
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef NATIVE_HUB75_DMA_H
+#define NATIVE_HUB75_DMA_H
+
+// MatrixPanel_I2S_DMA drawing into an RGB565 framebuffer in host memory.
+// Covers the calls the firmware makes; text is accepted but not rendered.
+// With double_buff set, drawing goes to a back buffer and flipDMABuffer()
+// swaps it in, as on the panel.
+
+#include <Arduino.h>
+#include <vector>
+
+struct HUB75_I2S_CFG {
+    struct i2s_pins {
+        int8_t r1, g1, b1, r2, g2, b2, a, b, c, d, e, lat, oe, clk;
+    };
+    enum clk_speed { HZ_8M = 8000000, HZ_10M = 10000000, HZ_15M = 15000000, HZ_20M = 20000000 };
+
+    HUB75_I2S_CFG(uint16_t width = 64, uint16_t height = 32, uint16_t chain = 1, i2s_pins pins = {})
+        : mx_width(width), mx_height(height), chain_length(chain), gpio(pins) {}
+
+    uint16_t mx_width;
+    uint16_t mx_height;
+    uint16_t chain_length;
+    i2s_pins gpio;
+    clk_speed i2sspeed = HZ_8M;
+    bool double_buff = false;
+    uint8_t latch_blanking = 1;
+    bool clkphase = true;
+    uint16_t min_refresh_rate = 60;
+
+    void setPixelColorDepthBits(uint8_t bits) { pixel_color_depth_bits = bits < 1 ? 1 : bits > 12 ? 12 : bits; }
+    uint8_t getPixelColorDepthBits() const { return pixel_color_depth_bits; }
+
+private:
+    uint8_t pixel_color_depth_bits = 8;
+};
+
+// Counters for profiling how the firmware drives the panel
+struct NativePanelStats {
+    uint64_t pixelWrites;   // drawPixel calls
+    uint64_t hlineWrites;   // drawFastHLine calls
+    uint64_t hlinePixels;   // Pixels covered by drawFastHLine
+    uint64_t flips;
+};
+
+class MatrixPanel_I2S_DMA {
+public:
+    MatrixPanel_I2S_DMA(const HUB75_I2S_CFG &config);
+    virtual ~MatrixPanel_I2S_DMA() {}
+
+    bool begin();
+    const HUB75_I2S_CFG &getCfg() const { return _cfg; }
+    int16_t width() const { return _width; }
+    int16_t height() const { return _height; }
+
+    virtual void drawPixel(int16_t x, int16_t y, uint16_t color);
+    virtual void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color);
+    virtual void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color);
+    virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    virtual void fillScreen(uint16_t color);
+    void fillScreenRGB888(uint8_t r, uint8_t g, uint8_t b) { fillScreen(color565(r, g, b)); }
+    void drawPixelRGB888(int16_t x, int16_t y, uint8_t r, uint8_t g, uint8_t b) { drawPixel(x, y, color565(r, g, b)); }
+    void clearScreen() { fillScreen(0); }
+    void flipDMABuffer();
+
+    void setBrightness8(uint8_t brightness) { _brightness = brightness; }
+    uint8_t brightness() const { return _brightness; }
+    static uint16_t color565(uint8_t r, uint8_t g, uint8_t b) {
+        return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+    }
+
+    void setCursor(int16_t x, int16_t y) { _cursorX = x; _cursorY = y; }
+    void setTextColor(uint16_t color) { _textColor = color; }
+    void setTextSize(uint8_t size) { _textSize = size; }
+    void setTextWrap(bool wrap) { (void)wrap; }
+    size_t print(const char *text) { return strlen(text); }
+    size_t print(const String &text) { return text.length(); }
+
+    // Native only: what the panel shows, row major RGB565
+    const uint16_t *frontBuffer() const { return _buffers[_front].data(); }
+    const NativePanelStats &stats() const { return _stats; }
+    bool writePPM(const char *path) const;
+
+private:
+    uint16_t *back() { return _buffers[_cfg.double_buff ? 1 - _front : _front].data(); }
+
+    HUB75_I2S_CFG _cfg;
+    int16_t _width;
+    int16_t _height;
+    std::vector<uint16_t> _buffers[2];
+    int _front;
+    uint8_t _brightness;
+    int16_t _cursorX, _cursorY;
+    uint16_t _textColor;
+    uint8_t _textSize;
+    NativePanelStats _stats;
+};
+
+#endif
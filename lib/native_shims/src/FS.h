@@ -0,0 +1,7 @@
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+// The firmware reaches files through SdFat; nothing from fs:: is needed here
+#include <Arduino.h>
+
+#endif
@@ -0,0 +1,197 @@
+#include "Arduino.h"
+#include <pthread.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+
+struct NativeTask {
+    TaskFunction_t fn;
+    void *param;
+};
+
+struct NativeQueue {
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<std::vector<uint8_t>> items;
+    size_t length;
+    size_t itemSize;
+};
+
+// Mutexes, recursive mutexes and binary semaphores share one implementation
+struct NativeSemaphore {
+    std::mutex lock;
+    std::condition_variable changed;
+    unsigned count;
+    bool ownable;           // Mutex: remembers the owner, recursive takes nest
+    std::thread::id owner;
+    unsigned depth;
+};
+
+// Run cond() under lock until it holds or ticksToWait ms have passed
+template <class Lock, class Cond>
+static bool waitFor(std::condition_variable &cv, Lock &lock, TickType_t ticksToWait, Cond cond) {
+    if (ticksToWait == portMAX_DELAY) {
+        cv.wait(lock, cond);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds(ticksToWait), cond);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core) {
+    (void)stackDepth; (void)priority; (void)core;
+    NativeTask *task = new NativeTask{fn, param};
+    std::thread thread([task]() { task->fn(task->param); });
+    pthread_setname_np(thread.native_handle(), std::string(name).substr(0, 15).c_str());
+    thread.detach();
+    if (handle) *handle = task;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *param,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+    return xTaskCreatePinnedToCore(fn, name, stackDepth, param, priority, handle, 0);
+}
+
+// Each thread has a handle of its own, the main thread included
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    static thread_local NativeTask self;
+    return &self;
+}
+
+// Only deleting the calling task is supported, which is all the firmware does
+void vTaskDelete(TaskHandle_t task) {
+    (void)task;
+    pthread_exit(nullptr);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks);
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)millis();
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    NativeQueue *queue = new NativeQueue;
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+static BaseType_t queueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait, bool front) {
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitFor(queue->changed, lock, ticksToWait, [queue]() { return queue->items.size() < queue->length; }))
+        return pdFAIL;
+    const uint8_t *bytes = static_cast<const uint8_t *>(item);
+    std::vector<uint8_t> copy(bytes, bytes + queue->itemSize);
+    if (front)
+        queue->items.push_front(std::move(copy));
+    else
+        queue->items.push_back(std::move(copy));
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait) {
+    return queueSend(queue, item, ticksToWait, false);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticksToWait) {
+    return queueSend(queue, item, ticksToWait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticksToWait) {
+    return queueSend(queue, item, ticksToWait, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait) {
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitFor(queue->changed, lock, ticksToWait, [queue]() { return !queue->items.empty(); }))
+        return pdFAIL;
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->lock);
+    return queue->items.size();
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+static SemaphoreHandle_t createSemaphore(unsigned count, bool ownable) {
+    NativeSemaphore *sem = new NativeSemaphore;
+    sem->count = count;
+    sem->ownable = ownable;
+    sem->depth = 0;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return createSemaphore(1, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+    return createSemaphore(1, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return createSemaphore(0, false);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticksToWait) {
+    std::unique_lock<std::mutex> lock(sem->lock);
+    if (!waitFor(sem->changed, lock, ticksToWait, [sem]() { return sem->count > 0; }))
+        return pdFAIL;
+    sem->count--;
+    if (sem->ownable) {
+        sem->owner = std::this_thread::get_id();
+        sem->depth = 1;
+    }
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    std::lock_guard<std::mutex> lock(sem->lock);
+    if (sem->count > 0)
+        return pdFAIL;
+    sem->count++;
+    sem->owner = std::thread::id();
+    sem->depth = 0;
+    sem->changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticksToWait) {
+    {
+        std::lock_guard<std::mutex> lock(sem->lock);
+        if (sem->depth > 0 && sem->owner == std::this_thread::get_id()) {
+            sem->depth++;
+            return pdPASS;
+        }
+    }
+    return xSemaphoreTake(sem, ticksToWait);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem) {
+    {
+        std::lock_guard<std::mutex> lock(sem->lock);
+        if (sem->depth == 0 || sem->owner != std::this_thread::get_id())
+            return pdFAIL;
+        if (--sem->depth > 0)
+            return pdPASS;
+    }
+    return xSemaphoreGive(sem);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    delete sem;
+}
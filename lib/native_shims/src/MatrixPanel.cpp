@@ -0,0 +1,70 @@
+#include "ESP32-HUB75-MatrixPanel-I2S-DMA.h"
+
+MatrixPanel_I2S_DMA::MatrixPanel_I2S_DMA(const HUB75_I2S_CFG &config)
+    : _cfg(config), _width(config.mx_width * config.chain_length), _height(config.mx_height),
+      _front(0), _brightness(128), _cursorX(0), _cursorY(0), _textColor(0xFFFF), _textSize(1), _stats()
+{
+}
+
+bool MatrixPanel_I2S_DMA::begin() {
+    _buffers[0].assign((size_t)_width * _height, 0);
+    if (_cfg.double_buff)
+        _buffers[1].assign((size_t)_width * _height, 0);
+    return true;
+}
+
+void MatrixPanel_I2S_DMA::drawPixel(int16_t x, int16_t y, uint16_t color) {
+    _stats.pixelWrites++;
+    if (x < 0 || y < 0 || x >= _width || y >= _height) return;
+    back()[y * _width + x] = color;
+}
+
+void MatrixPanel_I2S_DMA::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) {
+    _stats.hlineWrites++;
+    if (y < 0 || y >= _height) return;
+    if (x < 0) { w += x; x = 0; }
+    if (x + w > _width) w = _width - x;
+    if (w <= 0) return;
+    _stats.hlinePixels += w;
+    uint16_t *row = back() + y * _width;
+    std::fill(row + x, row + x + w, color);
+}
+
+void MatrixPanel_I2S_DMA::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) {
+    for (int16_t i = 0; i < h; i++)
+        drawPixel(x, y + i, color);
+}
+
+void MatrixPanel_I2S_DMA::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+    for (int16_t i = 0; i < h; i++)
+        drawFastHLine(x, y + i, w, color);
+}
+
+void MatrixPanel_I2S_DMA::fillScreen(uint16_t color) {
+    uint16_t *buf = back();
+    std::fill(buf, buf + (size_t)_width * _height, color);
+}
+
+void MatrixPanel_I2S_DMA::flipDMABuffer() {
+    _stats.flips++;
+    if (_cfg.double_buff)
+        _front = 1 - _front;
+}
+
+// Binary PPM of the front buffer, expanded to 8 bits per channel
+bool MatrixPanel_I2S_DMA::writePPM(const char *path) const {
+    FILE *out = fopen(path, "wb");
+    if (!out) return false;
+    fprintf(out, "P6\n%d %d\n255\n", _width, _height);
+    const uint16_t *buf = frontBuffer();
+    for (size_t i = 0; i < (size_t)_width * _height; i++) {
+        uint16_t c = buf[i];
+        uint8_t rgb[3] = {
+            (uint8_t)(((c >> 11) & 0x1F) * 255 / 31),
+            (uint8_t)(((c >> 5) & 0x3F) * 255 / 63),
+            (uint8_t)((c & 0x1F) * 255 / 31),
+        };
+        fwrite(rgb, 1, 3, out);
+    }
+    return fclose(out) == 0;
+}
@@ -0,0 +1,38 @@
+#include "Preferences.h"
+
+static std::map<std::string, uint32_t> store;
+static std::mutex storeLock;
+
+uint32_t Preferences::get(const char *key, uint32_t defaultValue) {
+    std::lock_guard<std::mutex> guard(storeLock);
+    auto it = store.find(_ns + "/" + key);
+    return it == store.end() ? defaultValue : it->second;
+}
+
+size_t Preferences::put(const char *key, uint32_t value, size_t size) {
+    std::lock_guard<std::mutex> guard(storeLock);
+    store[_ns + "/" + key] = value;
+    return size;
+}
+
+bool Preferences::isKey(const char *key) {
+    std::lock_guard<std::mutex> guard(storeLock);
+    return store.count(_ns + "/" + key) > 0;
+}
+
+bool Preferences::remove(const char *key) {
+    std::lock_guard<std::mutex> guard(storeLock);
+    return store.erase(_ns + "/" + key) > 0;
+}
+
+bool Preferences::clear() {
+    std::lock_guard<std::mutex> guard(storeLock);
+    std::string prefix = _ns + "/";
+    for (auto it = store.begin(); it != store.end();) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0)
+            it = store.erase(it);
+        else
+            ++it;
+    }
+    return true;
+}
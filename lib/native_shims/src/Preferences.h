@@ -0,0 +1,31 @@
+#ifndef NATIVE_PREFERENCES_H
+#define NATIVE_PREFERENCES_H
+
+// NVS preferences kept in process memory; nothing survives a restart
+#include <Arduino.h>
+#include <map>
+
+class Preferences {
+public:
+    bool begin(const char *name, bool readOnly = false) { (void)readOnly; _ns = name; return true; }
+    void end() {}
+    bool clear();
+    bool remove(const char *key);
+    bool isKey(const char *key);
+
+    int32_t getInt(const char *key, int32_t defaultValue = 0) { return (int32_t)get(key, (uint32_t)defaultValue); }
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0) { return get(key, defaultValue); }
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0) { return (uint8_t)get(key, defaultValue); }
+    bool getBool(const char *key, bool defaultValue = false) { return get(key, defaultValue) != 0; }
+    size_t putInt(const char *key, int32_t value) { return put(key, (uint32_t)value, 4); }
+    size_t putUInt(const char *key, uint32_t value) { return put(key, value, 4); }
+    size_t putUChar(const char *key, uint8_t value) { return put(key, value, 1); }
+    size_t putBool(const char *key, bool value) { return put(key, value, 1); }
+
+private:
+    uint32_t get(const char *key, uint32_t defaultValue);
+    size_t put(const char *key, uint32_t value, size_t size);
+    std::string _ns;
+};
+
+#endif
@@ -0,0 +1,215 @@
+#include "SdFat.h"
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+struct NativeFileState {
+    int fd = -1;
+    DIR *dir = nullptr;
+    std::string hostPath;
+    std::string name;
+
+    ~NativeFileState() {
+        if (fd >= 0) ::close(fd);
+        if (dir) ::closedir(dir);
+    }
+};
+
+static std::string baseName(const std::string &path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+bool FsFile::isOpen() const {
+    return _state && (_state->fd >= 0 || _state->dir);
+}
+
+bool FsFile::isFile() const {
+    return _state && _state->fd >= 0;
+}
+
+bool FsFile::isDir() const {
+    return _state && _state->dir;
+}
+
+size_t FsFile::getName(char *name, size_t size) {
+    if (!isOpen() || size == 0) return 0;
+    strlcpy(name, _state->name.c_str(), size);
+    return strlen(name);
+}
+
+bool FsFile::openNext(FsFile *dir, int oflag) {
+    close();
+    if (!dir || !dir->isDir()) return false;
+
+    struct dirent *entry;
+    while ((entry = ::readdir(dir->_state->dir)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        std::string path = dir->_state->hostPath + "/" + entry->d_name;
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0) continue;
+
+        auto state = std::make_shared<NativeFileState>();
+        state->hostPath = path;
+        state->name = entry->d_name;
+        if (S_ISDIR(st.st_mode))
+            state->dir = ::opendir(path.c_str());
+        else
+            state->fd = ::open(path.c_str(), oflag & ~O_AT_END);
+        if (state->fd < 0 && !state->dir) continue;
+        _state = state;
+        return true;
+    }
+    return false;
+}
+
+bool FsFile::rewindDirectory() {
+    if (!isDir()) return false;
+    ::rewinddir(_state->dir);
+    return true;
+}
+
+bool FsFile::close() {
+    _state.reset();
+    return true;
+}
+
+int FsFile::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int FsFile::read(void *buf, size_t count) {
+    if (!isFile()) return -1;
+    return (int)::read(_state->fd, buf, count);
+}
+
+size_t FsFile::write(const void *buf, size_t count) {
+    if (!isFile()) return 0;
+    ssize_t n = ::write(_state->fd, buf, count);
+    return n < 0 ? 0 : (size_t)n;
+}
+
+int FsFile::available() {
+    if (!isFile()) return 0;
+    uint64_t left = fileSize() - position();
+    return left > 0x7fffffff ? 0x7fffffff : (int)left;
+}
+
+// Directory positions are telldir() cookies, as opaque as SdFat's entry offsets
+bool FsFile::seekSet(uint64_t pos) {
+    if (isDir()) {
+        ::seekdir(_state->dir, (long)pos);
+        return true;
+    }
+    return isFile() && ::lseek(_state->fd, (off_t)pos, SEEK_SET) == (off_t)pos;
+}
+
+uint64_t FsFile::position() const {
+    if (isDir()) {
+        long pos = ::telldir(_state->dir);
+        return pos < 0 ? 0 : (uint64_t)pos;
+    }
+    if (!isFile()) return 0;
+    off_t pos = ::lseek(_state->fd, 0, SEEK_CUR);
+    return pos < 0 ? 0 : (uint64_t)pos;
+}
+
+uint64_t FsFile::fileSize() const {
+    struct stat st;
+    if (!isFile() || ::fstat(_state->fd, &st) != 0) return 0;
+    return (uint64_t)st.st_size;
+}
+
+bool FsFile::truncate(uint64_t length) {
+    return isFile() && ::ftruncate(_state->fd, (off_t)length) == 0;
+}
+
+bool FsFile::sync() {
+    return isFile() && ::fsync(_state->fd) == 0;
+}
+
+// The host's mtime packed the way FAT stores it, 2-second resolution
+bool FsFile::getModifyDateTime(uint16_t *pdate, uint16_t *ptime) {
+    struct stat st;
+    if (!isOpen() || ::stat(_state->hostPath.c_str(), &st) != 0) return false;
+    struct tm tm;
+    localtime_r(&st.st_mtime, &tm);
+    *pdate = (uint16_t)(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+    *ptime = (uint16_t)((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec >> 1));
+    return true;
+}
+
+void SdFs::setHostRoot(const char *root) {
+    _root = root;
+    while (_root.size() > 1 && _root.back() == '/') _root.pop_back();
+}
+
+bool SdFs::begin(SdSpiConfig config) {
+    (void)config;
+    if (_root.empty()) {
+        const char *env = getenv("HUB75_SD_ROOT");
+        setHostRoot(env ? env : ".");
+    }
+    struct stat st;
+    return ::stat(_root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+std::string SdFs::hostPath(const char *path) const {
+    std::string p = path ? path : "";
+    if (p.empty() || p[0] != '/') p = "/" + p;
+    return _root + p;
+}
+
+FsFile SdFs::open(const char *path, int oflag) {
+    FsFile file;
+    std::string host = hostPath(path);
+    auto state = std::make_shared<NativeFileState>();
+    state->hostPath = host;
+    state->name = baseName(host);
+
+    struct stat st;
+    if (::stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        state->dir = ::opendir(host.c_str());
+    } else {
+        state->fd = ::open(host.c_str(), oflag & ~O_AT_END, 0644);
+        if (state->fd >= 0 && (oflag & O_AT_END))
+            ::lseek(state->fd, 0, SEEK_END);
+    }
+    if (state->fd >= 0 || state->dir)
+        file._state = state;
+    return file;
+}
+
+bool SdFs::exists(const char *path) {
+    struct stat st;
+    return ::stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool SdFs::remove(const char *path) {
+    return ::unlink(hostPath(path).c_str()) == 0;
+}
+
+bool SdFs::rename(const char *oldPath, const char *newPath) {
+    return ::rename(hostPath(oldPath).c_str(), hostPath(newPath).c_str()) == 0;
+}
+
+bool SdFs::mkdir(const char *path, bool parents) {
+    std::string host = hostPath(path);
+    if (parents) {
+        for (size_t i = _root.size() + 1; i < host.size(); i++) {
+            if (host[i] == '/') {
+                std::string parent = host.substr(0, i);
+                if (::mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST) return false;
+            }
+        }
+    }
+    return ::mkdir(host.c_str(), 0755) == 0 || (parents && errno == EEXIST);
+}
+
+bool SdFs::rmdir(const char *path) {
+    return ::rmdir(hostPath(path).c_str()) == 0;
+}
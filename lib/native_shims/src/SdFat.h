@@ -0,0 +1,88 @@
+#ifndef NATIVE_SDFAT_H
+#define NATIVE_SDFAT_H
+
+// SdFs/FsFile backed by a directory on the host. Card paths are resolved
+// below the root given to SdFs::setHostRoot() (default: $HUB75_SD_ROOT, then
+// the current directory). Open flags are the host's <fcntl.h> values, which
+// SdFat mirrors.
+
+#include <Arduino.h>
+#include <fcntl.h>
+#include <memory>
+
+#ifndef O_AT_END
+#define O_AT_END 0x40000000
+#endif
+#define O_READ O_RDONLY
+#define O_WRITE O_WRONLY
+
+#define DEDICATED_SPI 1
+#define SHARED_SPI 0
+#define SD_SCK_MHZ(mhz) ((mhz) * 1000000UL)
+
+struct SdSpiConfig {
+    SdSpiConfig(uint8_t cs, uint8_t options, uint32_t maxSck) : csPin(cs), options(options), maxSck(maxSck) {}
+    uint8_t csPin;
+    uint8_t options;
+    uint32_t maxSck;
+};
+
+struct NativeFileState;
+
+class FsFile {
+public:
+    FsFile() {}
+
+    operator bool() const { return isOpen(); }
+    bool isOpen() const;
+    bool isFile() const;
+    bool isDir() const;
+    bool isDirectory() const { return isDir(); }
+    size_t getName(char *name, size_t size);
+
+    bool openNext(FsFile *dir, int oflag = O_RDONLY);
+    bool rewindDirectory();
+    bool close();
+
+    int read();
+    int read(void *buf, size_t count);
+    size_t write(const void *buf, size_t count);
+    size_t write(uint8_t b) { return write(&b, 1); }
+    int available();
+    bool seek(uint64_t pos) { return seekSet(pos); }
+    bool seekSet(uint64_t pos);
+    void rewind() { seekSet(0); }
+    uint64_t position() const;
+    uint64_t size() const { return fileSize(); }
+    uint64_t fileSize() const;
+    bool preAllocate(uint64_t length) { (void)length; return isOpen(); }
+    bool truncate(uint64_t length);
+    bool truncate() { return truncate(position()); }
+    bool sync();
+    bool getModifyDateTime(uint16_t *pdate, uint16_t *ptime);
+
+private:
+    friend class SdFs;
+    std::shared_ptr<NativeFileState> _state; // Copies share the open file, like SdFat's handles
+};
+
+class SdFs {
+public:
+    void setHostRoot(const char *root);
+    bool begin(SdSpiConfig config);
+
+    FsFile open(const char *path, int oflag = O_RDONLY);
+    bool exists(const char *path);
+    bool remove(const char *path);
+    bool rename(const char *oldPath, const char *newPath);
+    bool mkdir(const char *path, bool parents = true);
+    bool rmdir(const char *path);
+
+private:
+    std::string hostPath(const char *path) const;
+    std::string _root;
+};
+
+typedef SdFs SdFat;
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef NATIVE_ESP_HEAP_CAPS_H
+#define NATIVE_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Like ESP.getFreeHeap(), heap figures report zero on a host
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+inline size_t heap_caps_get_free_size(uint32_t caps) { (void)caps; return 0; }
+inline size_t heap_caps_get_largest_free_block(uint32_t caps) { (void)caps; return 0; }
+
+#endif
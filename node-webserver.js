@@ -18,6 +18,14 @@ const upload = multer({ dest: path.join(BASE_DIR, 'uploads/') });
 app.get('/api/status', (req, res) => {
   res.json({ status: 'connected', ssid: 'MockSSID', ip: '127.0.0.1', current_gif: '', free_heap: 123456, uptime: 123456, brightness: 128 });
 });
+// Pushed status like the device: whole state on connect, then a ping every 15 seconds
+app.get('/api/events', (req, res) => {
+  res.set({ 'Content-Type': 'text/event-stream', 'Cache-Control': 'no-cache', Connection: 'keep-alive' });
+  res.flushHeaders();
+  res.write(`event: status\ndata: ${JSON.stringify({ status: 'connected', ssid: 'MockSSID', ip: '127.0.0.1', current_gif: '', brightness: 128, gif_playback_enabled: true })}\n\n`);
+  const ping = setInterval(() => res.write('event: ping\ndata: {}\n\n'), 15000);
+  req.on('close', () => clearInterval(ping));
+});
 app.get('/api/brightness/increase', (req, res) => res.json({ status: 'success', message: 'Brightness increased', old_brightness: 100, new_brightness: 125 }));
 app.get('/api/brightness/decrease', (req, res) => res.json({ status: 'success', message: 'Brightness decreased', old_brightness: 125, new_brightness: 100 }));
 app.get('/api/brightness/set', (req, res) => res.json({ status: 'success', message: 'Brightness set', old_brightness: 100, new_brightness: req.query.value }));
@@ -46,15 +54,23 @@ app.get('/api/files', (req, res) => {
   if (!fs.existsSync(dirPath) || !fs.lstatSync(dirPath).isDirectory()) {
     return res.status(400).json({ status: 'error', message: 'Directory not found' });
   }
-  const files = fs.readdirSync(dirPath).map(name => {
+  const entry = name => {
     const stat = fs.lstatSync(path.join(dirPath, name));
     return {
       name,
       type: stat.isDirectory() ? 'folder' : 'file',
       size: stat.isDirectory() ? undefined : stat.size
     };
-  });
-  res.json(files);
+  };
+  const names = fs.readdirSync(dirPath);
+  const { offset, limit, cursor } = req.query;
+  if (offset === undefined && limit === undefined && cursor === undefined) return res.json(names.map(entry));
+  // Paged like the device; the cursor here is just the index of the next entry
+  const start = (cursor ? parseInt(cursor, 16) : 0) + (parseInt(offset) || 0);
+  const count = Math.min(Math.max(parseInt(limit) || 100, 1), 1000);
+  const entries = names.slice(start, start + count).map(entry);
+  const next = start + count < names.length ? (start + count).toString(16) + '.0' : null;
+  res.json({ path: req.query.path || '/', offset: parseInt(offset) || 0, entries, count: entries.length, next });
 });
 
 app.post('/api/files/delete', (req, res) => {
@@ -1,14 +1,33 @@
 #include "api.h"
 #include "globals.h"
 #include "sdcard.h"
+#include "gif.h"
 #include "settings.h"
+#include "pipeline.h"
+#include "framecache.h"
+#include "playlist.h"
+#include "shuffle.h"
+#include "playcontrol.h"
+#include "sdreader.h"
+#include "filecache.h"
+#include "panel.h"
+#include "colorcorrect.h"
+#include "dither.h"
+#include "scale.h"
+#include "panelanim.h"
+#include "filelist.h"
+#include "upload.h"
+#include "uploadsession.h"
+#include "statusfeed.h"
+#include "ramplan.h"
 #include "LittleFS.h"
 #include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
+#include <memory>
+#include <new>
 
 extern AsyncWebServer server;
 extern SdFat sd;
-extern String current_gif;
 extern int brightness;
 extern MatrixPanel_I2S_DMA *dma_display;
 
@@ -30,7 +49,134 @@ String getContentType(String filename) {
     return "text/plain";
 }
 
+// A file on the card is about to change: drop everything cached or held
+// open for it. Called before the change, so playback stops reading the old
+// file first, and again after an upload for anything cached in between.
+static void invalidateCaches(const char *path) {
+    frameCacheInvalidate(path);
+    fileCacheInvalidate(path);
+    panelAnimInvalidate(path);
+    sdReaderInvalidate(path);
+}
+
+static void invalidateAllCaches() {
+    frameCacheInvalidateAll();
+    fileCacheInvalidateAll();
+    panelAnimInvalidateAll();
+    sdReaderInvalidate(nullptr);
+}
+
+// An upload in progress, kept in its request's _tempObject so concurrent
+// uploads never share state; the request handler answers with the outcome
+struct RequestUpload {
+    UploadWriter writer;
+    String path;               // Where the file goes once complete
+    bool useSD;                // Else LittleFS, written directly
+    File littleFsFile;
+};
+
+// Drop the request's upload when its connection goes, finished or not
+static void endRequestUpload(AsyncWebServerRequest *request) {
+    RequestUpload *upload = static_cast<RequestUpload *>(request->_tempObject);
+    if (upload == nullptr) return;
+    uploadRelease(upload->writer);
+    if (upload->littleFsFile) upload->littleFsFile.close();
+    upload->~RequestUpload();
+    free(upload); // The request would free() it too, without running the destructor
+    request->_tempObject = nullptr;
+}
+
+// The request's upload, created with its first file part; null when out of memory
+static RequestUpload *requestUpload(AsyncWebServerRequest *request) {
+    RequestUpload *upload = static_cast<RequestUpload *>(request->_tempObject);
+    if (upload != nullptr) return upload;
+    void *mem = malloc(sizeof(RequestUpload));
+    if (mem == nullptr) return nullptr;
+    upload = new (mem) RequestUpload();
+    request->_tempObject = upload;
+    request->onDisconnect([request]() { endRequestUpload(request); });
+    return upload;
+}
+
+// Tell everything that keeps track of the card about a file just put in place
+static void notifyUploaded(const String &path) {
+    invalidateCaches(path.c_str());
+    playlistNotifyAdded(path.c_str());
+    if (path.startsWith(String(GIF_DIR) + "/") && path.endsWith(".gif")) {
+        panelAnimQueue(path.c_str());
+    }
+}
+
+// Put a finished upload in place; uploadCommit() invalidates what reads the
+// old file first (uploadSetReplaceHook())
+static bool commitUpload(UploadWriter &upload, const String &path) {
+    if (!uploadCommit(upload.path.c_str(), path.c_str())) {
+        upload.error = "Could not replace the existing file";
+        upload.errorStatus = 500;
+        return false;
+    }
+    notifyUploaded(path);
+    return true;
+}
+
+// s as the inside of a JSON string, cut short rather than overflow out
+static void escapeJson(const char *s, char *out, size_t size) {
+    size_t len = 0;
+    for (; *s; s++) {
+        uint8_t c = (uint8_t)*s;
+        char esc[8];
+        int n;
+        if (c == '"' || c == '\\') n = snprintf(esc, sizeof(esc), "\\%c", c);
+        else if (c < 0x20) n = snprintf(esc, sizeof(esc), "\\u%04x", c);
+        else {
+            esc[0] = (char)c;
+            n = 1;
+        }
+        if (len + n >= size) break;
+        memcpy(out + len, esc, n);
+        len += n;
+    }
+    out[len] = '\0';
+}
+
+// Session state, and the error when there is one; offset is where to send from next
+static void sendSessionResult(AsyncWebServerRequest *request, const UploadSessionResult &result) {
+    char json[MAX_GIF_PATH_LEN * 2 + 256];
+    char path[MAX_GIF_PATH_LEN * 2];
+    escapeJson(result.path, path, sizeof(path)); // Built from the client's file name
+    if (result.status != 200 && result.id == 0) {
+        snprintf(json, sizeof(json), "{\"status\":\"error\",\"message\":\"%s\"}", result.message);
+    } else {
+        snprintf(json, sizeof(json),
+                 "{\"status\":\"%s\",%s%s%s\"id\":\"%08lx\",\"path\":\"%s\",\"size\":%llu,\"crc\":\"%08lx\","
+                 "\"offset\":%llu,\"committed\":%s,\"kbps\":%lu}",
+                 result.status == 200 ? "success" : "error", result.message ? "\"message\":\"" : "",
+                 result.message ? result.message : "", result.message ? "\"," : "", (unsigned long)result.id,
+                 path, (unsigned long long)result.size, (unsigned long)result.fileCrc,
+                 (unsigned long long)result.offset, result.committed ? "true" : "false", (unsigned long)result.kbps);
+    }
+    request->send(result.status, "application/json", json);
+}
+
+static void sendUploadResult(AsyncWebServerRequest *request) {
+    const RequestUpload *pending = static_cast<const RequestUpload *>(request->_tempObject);
+    if (pending == nullptr) {
+        request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"No file received, or out of memory\"}");
+        return;
+    }
+    const UploadWriter &upload = pending->writer;
+    if (upload.error) {
+        request->send(upload.errorStatus, "application/json",
+                      String("{\"status\":\"error\",\"message\":\"") + upload.error + "\"}");
+        return;
+    }
+    request->send(200, "application/json",
+                  "{\"status\":\"success\",\"message\":\"Upload complete\",\"kbps\":" + String(upload.kbps) + "}");
+}
+
 void setupAPIEndpoints() {
+    uploadSetReplaceHook(invalidateCaches);
+
     // Handle OPTIONS preflight requests for all paths (important for CORS)
     server.on("/", HTTP_OPTIONS, [](AsyncWebServerRequest *request) { // Handle OPTIONS for root
         // Serial.println("OPTIONS / called");
@@ -74,6 +220,33 @@ void setupAPIEndpoints() {
     server.on("/api/gif/toggle", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
         request->send(204);
     });
+    server.on("/api/gif/next", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
+        request->send(204);
+    });
+    server.on("/api/playlist/rescan", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
+        request->send(204);
+    });
+    server.on("/api/playback/mode", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
+        request->send(204);
+    });
+    server.on("/api/playback/drop", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
+        request->send(204);
+    });
+    server.on("/api/display/buffering", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
+        request->send(204);
+    });
+    server.on("/api/display/curve", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
+        request->send(204);
+    });
+    server.on("/api/display/dither", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
+        request->send(204);
+    });
+    server.on("/api/display/scaling", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
+        request->send(204);
+    });
+    server.on("/api/gif/convert", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
+        request->send(204);
+    });
 
     // GIF upload endpoint
     server.on("/api/gif/upload", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
@@ -89,10 +262,7 @@ void setupAPIEndpoints() {
                 request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Only .gif files are allowed\"}");
                 return;
             }
-            // Success response is now sent only if no error occurred during upload
-            if (!request->hasParam("upload_error", true) || request->getParam("upload_error", true)->value() != "1") {
-                request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Upload complete\"}");
-            }
+            sendUploadResult(request);
         } else {
             request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Missing filename\"}");
         }
@@ -100,48 +270,26 @@ void setupAPIEndpoints() {
     
     // Upload handler
     [](AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
-        static FsFile uploadFile;
-        static String uploadFilename;
-        static bool uploadError = false;
-        
+        RequestUpload *upload = requestUpload(request);
+        if (upload == nullptr) return;
         if (index == 0) {
-            uploadError = false;
             Serial.println("UPLOAD /api/gif/upload started");
-            uploadFilename = filename;
-            if (!uploadFilename.endsWith(".gif")) {
-                Serial.println("Rejected non-GIF upload: " + uploadFilename);
-                uploadError = true;
-                return;
-            }
-            String path = String("/gifs/") + uploadFilename;
-            if (sd.exists(path.c_str())) {
-                sd.remove(path.c_str());
-            }
-            uploadFile = sd.open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
-            if (!uploadFile) {
-                Serial.println("SD card error or full: " + path);
-                request->send(507, "application/json", "{\"status\":\"error\",\"message\":\"SD card error or full\"}");
-                uploadError = true;
+            if (!filename.endsWith(".gif")) {
+                Serial.println("Rejected non-GIF upload: " + filename);
+                uploadAbort(upload->writer);
+                upload->writer.error = "Only .gif files are allowed";
+                upload->writer.errorStatus = 400;
                 return;
             }
-            Serial.println("Upload start: " + path);
+            upload->path = String("/gifs/") + filename;
+            if (!uploadBegin(upload->writer, (upload->path + UPLOAD_TEMP_SUFFIX).c_str(), request->contentLength())) return;
+            Serial.println("Upload start: " + upload->path);
         }
         
-        if (uploadFile && !uploadError && len > 0) {
-            int written = uploadFile.write(data, len);
-            if (written != len) {
-                Serial.println("Write error during upload: " + uploadFilename);
-                uploadFile.close();
-                request->send(507, "application/json", "{\"status\":\"error\",\"message\":\"Write error during upload\"}");
-                uploadError = true;
-            }
-        }
-        
-        if (final) {
-            if (uploadFile && !uploadError) {
-                uploadFile.close();
-                Serial.println("Upload complete: " + uploadFilename);
-            }
+        if (!upload->writer.active) return;
+        if (len > 0 && !uploadWrite(upload->writer, data, len)) return;
+        if (final && uploadFinish(upload->writer)) {
+            commitUpload(upload->writer, upload->path);
         }
     });
 
@@ -153,29 +301,29 @@ void setupAPIEndpoints() {
     server.on("/api/file/upload", HTTP_POST, [](AsyncWebServerRequest *request) {
         Serial.println("POST /api/file/upload called");
         if (request->hasParam("filename", true) && request->hasParam("path", true)) {
-            String filename = request->getParam("filename", true)->value();
-            String targetPath = request->getParam("path", true)->value();
-            
-            // Success response is now sent only if no error occurred during upload
-            if (!request->hasParam("upload_error", true) || request->getParam("upload_error", true)->value() != "1") {
-                request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Upload complete\"}");
-            }
+            sendUploadResult(request);
         } else {
             request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Missing filename or path\"}");
         }
     },
     // Upload handler for general files
     [](AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
-        static File uploadFile;
-        static String uploadFilename;
-        static String uploadPath;
-        static bool uploadError = false;
-        static bool useSD = false;
+        RequestUpload *upload = requestUpload(request);
+        if (upload == nullptr) return;
+        UploadWriter &fileUpload = upload->writer;
+        File &uploadFile = upload->littleFsFile;
+        String &uploadPath = upload->path;
+        bool &useSD = upload->useSD;
         
         if (index == 0) {
-            uploadError = false;
+            uploadAbort(fileUpload);
+            fileUpload.error = nullptr;
             Serial.println("UPLOAD /api/file/upload started");
-            uploadFilename = filename;
+            if (!request->hasParam("path", true)) {
+                fileUpload.error = "Missing filename or path";
+                fileUpload.errorStatus = 400;
+                return;
+            }
             uploadPath = request->getParam("path", true)->value();
             
             // Determine if this should go to SD card or LittleFS
@@ -192,29 +340,18 @@ void setupAPIEndpoints() {
                 int lastSlash = dirPath.lastIndexOf('/');
                 if (lastSlash > 0) {
                     String parentDir = dirPath.substring(0, lastSlash);
-                    if (!sd.exists(parentDir.c_str())) {
-                        if (!sd.mkdir(parentDir.c_str())) {
-                            Serial.println("Failed to create directory: " + parentDir);
-                            request->send(507, "application/json", "{\"status\":\"error\",\"message\":\"Failed to create directory\"}");
-                            uploadError = true;
-                            return;
-                        }
+                    sdLock();
+                    bool dirOk = sd.exists(parentDir.c_str()) || sd.mkdir(parentDir.c_str());
+                    sdUnlock();
+                    if (!dirOk) {
+                        Serial.println("Failed to create directory: " + parentDir);
+                        fileUpload.error = "Failed to create directory";
+                        fileUpload.errorStatus = 507;
+                        return;
                     }
                 }
                 
-                // Remove existing file if it exists
-                if (sd.exists(uploadPath.c_str())) {
-                    sd.remove(uploadPath.c_str());
-                }
-                
-                FsFile sdFile = sd.open(uploadPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
-                if (!sdFile) {
-                    Serial.println("SD card error or full: " + uploadPath);
-                    request->send(507, "application/json", "{\"status\":\"error\",\"message\":\"SD card error or full\"}");
-                    uploadError = true;
-                    return;
-                }
-                // We'll handle SD writes differently, store the file handle
+                if (!uploadBegin(fileUpload, (uploadPath + UPLOAD_TEMP_SUFFIX).c_str(), request->contentLength())) return;
             } else {
                 // Use LittleFS for web files
                 // Remove existing file if it exists
@@ -225,65 +362,284 @@ void setupAPIEndpoints() {
                 uploadFile = LittleFS.open(uploadPath, "w");
                 if (!uploadFile) {
                     Serial.println("LittleFS error or full: " + uploadPath);
-                    request->send(507, "application/json", "{\"status\":\"error\",\"message\":\"LittleFS error or full\"}");
-                    uploadError = true;
+                    fileUpload.error = "LittleFS error or full";
+                    fileUpload.errorStatus = 507;
                     return;
                 }
             }
             Serial.println("Upload start: " + uploadPath + (useSD ? " (SD)" : " (LittleFS)"));
         }
         
-        if (!uploadError && len > 0) {
-            if (useSD) {
-                // Handle SD card writes
-                FsFile sdFile = sd.open(uploadPath.c_str(), O_WRONLY | O_APPEND);
-                if (sdFile) {
-                    int written = sdFile.write(data, len);
-                    sdFile.close();
-                    if (written != len) {
-                        Serial.println("Write error during upload: " + uploadFilename);
-                        request->send(507, "application/json", "{\"status\":\"error\",\"message\":\"Write error during upload\"}");
-                        uploadError = true;
-                    }
-                } else {
-                    Serial.println("Failed to open SD file for writing: " + uploadPath);
-                    uploadError = true;
-                }
-            } else {
-                // Handle LittleFS writes
-                if (uploadFile) {
-                    int written = uploadFile.write(data, len);
-                    if (written != len) {
-                        Serial.println("Write error during upload: " + uploadFilename);
-                        uploadFile.close();
-                        request->send(507, "application/json", "{\"status\":\"error\",\"message\":\"Write error during upload\"}");
-                        uploadError = true;
-                    }
-                }
+        if (useSD) {
+            if (!fileUpload.active) return;
+            if (len > 0 && !uploadWrite(fileUpload, data, len)) return;
+            if (final && uploadFinish(fileUpload)) {
+                commitUpload(fileUpload, uploadPath);
+            }
+            return;
+        }
+
+        // Handle LittleFS writes
+        if (fileUpload.error || !uploadFile) return;
+        if (len > 0) {
+            int written = uploadFile.write(data, len);
+            if (written != len) {
+                Serial.println("Write error during upload: " + filename);
+                uploadFile.close();
+                fileUpload.error = "Write error during upload";
+                fileUpload.errorStatus = 507;
+                return;
             }
         }
-        
         if (final) {
-            if (!uploadError) {
-                if (!useSD && uploadFile) {
-                    uploadFile.close();
-                }
-                Serial.println("Upload complete: " + uploadPath);
+            uploadFile.close();
+            Serial.println("Upload complete: " + uploadPath);
+        }
+    });
+
+    // Resumable GIF uploads, see uploadsession.h
+    server.on("/api/upload/session", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
+        request->send(204);
+    });
+    server.on("/api/upload/chunk", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
+        request->send(204);
+    });
+    server.on("/api/upload/cancel", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
+        request->send(204);
+    });
+
+    // Open a session with ?filename=&size=&crc=, or look one up with ?id=
+    server.on("/api/upload/session", HTTP_GET, [](AsyncWebServerRequest *request) {
+        UploadSessionResult result = {};
+        if (request->hasParam("id")) {
+            uploadSessionGet(strtoul(request->getParam("id")->value().c_str(), NULL, 16), &result);
+            sendSessionResult(request, result);
+            return;
+        }
+        if (!request->hasParam("filename") || !request->hasParam("size") || !request->hasParam("crc")) {
+            request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Missing filename, size or crc\"}");
+            return;
+        }
+        String filename = request->getParam("filename")->value();
+        uint64_t size = strtoull(request->getParam("size")->value().c_str(), NULL, 10);
+        String path = String(GIF_DIR) + "/" + filename;
+        if (!filename.endsWith(".gif") || filename.indexOf('/') >= 0 || path.length() >= MAX_GIF_PATH_LEN) {
+            request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Only .gif files are allowed\"}");
+            return;
+        }
+        if (size == 0) {
+            request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Invalid size\"}");
+            return;
+        }
+        uint32_t fileCrc = strtoul(request->getParam("crc")->value().c_str(), NULL, 16);
+        uploadSessionOpen(path.c_str(), size, fileCrc, &result);
+        sendSessionResult(request, result);
+    });
+
+    // One chunk: PUT ?id=&crc= with Content-Range: bytes first-last/size
+    server.on("/api/upload/chunk", HTTP_PUT, [](AsyncWebServerRequest *request) {
+        UploadSessionResult *result = static_cast<UploadSessionResult *>(request->_tempObject);
+        if (result == nullptr) {
+            request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Missing chunk body\"}");
+            return;
+        }
+        if (result->committed) notifyUploaded(result->path);
+        sendSessionResult(request, *result);
+    }, nullptr,
+    [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        UploadSessionResult *result = static_cast<UploadSessionResult *>(request->_tempObject);
+        if (index == 0) {
+            // Freed with the request
+            result = static_cast<UploadSessionResult *>(calloc(1, sizeof(UploadSessionResult)));
+            request->_tempObject = result;
+            if (result == nullptr) return;
+            unsigned long long first, last, size;
+            if (!request->hasParam("id") || !request->hasParam("crc") || !request->hasHeader("Content-Range") ||
+                sscanf(request->getHeader("Content-Range")->value().c_str(), "bytes %llu-%llu/%llu",
+                       &first, &last, &size) != 3 || last - first + 1 != total) {
+                result->status = 400;
+                result->message = "Missing id, crc or a Content-Range matching the body";
+                return;
             }
+            uint32_t id = strtoul(request->getParam("id")->value().c_str(), NULL, 16);
+            uint32_t crc = strtoul(request->getParam("crc")->value().c_str(), NULL, 16);
+            uploadChunkBegin(id, first, last, size, crc, result);
+        }
+        if (result == nullptr || result->status != 200) return;
+        uploadChunkWrite(result->chunk, data, len);
+        if (index + len == total) uploadChunkEnd(result->chunk, result);
+    });
+
+    server.on("/api/upload/cancel", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (!request->hasParam("id")) {
+            request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Missing id\"}");
+            return;
         }
+        if (!uploadSessionCancel(strtoul(request->getParam("id")->value().c_str(), NULL, 16))) {
+            request->send(404, "application/json", "{\"status\":\"error\",\"message\":\"No such upload session\"}");
+            return;
+        }
+        request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Upload cancelled\"}");
     });
 
+    // Pushed status for the web UI, see statusfeed.h
+    setupStatusFeed(server);
+
     // Status endpoint
     server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest *request) {
         String json = "{";
         json += "\"status\":\"connected\",";
         json += "\"ssid\":\"" + WiFi.SSID() + "\",";
         json += "\"ip\":\"" + WiFi.localIP().toString() + "\",";
-        json += "\"current_gif\":\"" + current_gif + "\",";
+        json += "\"current_gif\":\"" + currentGif() + "\",";
         json += "\"free_heap\":" + String(ESP.getFreeHeap()) + ",";
+        json += "\"min_free_heap\":" + String(ESP.getMinFreeHeap()) + ",";
+        json += "\"largest_free_block\":" + String(ESP.getMaxAllocHeap()) + ",";
+        json += "\"batch_heap_before\":{\"free\":" + String(heapBeforeBatch.freeHeap) +
+                ",\"min_free\":" + String(heapBeforeBatch.minFreeHeap) +
+                ",\"largest_block\":" + String(heapBeforeBatch.largestFreeBlock) + "},";
+        json += "\"batch_heap_after\":{\"free\":" + String(heapAfterBatch.freeHeap) +
+                ",\"min_free\":" + String(heapAfterBatch.minFreeHeap) +
+                ",\"largest_block\":" + String(heapAfterBatch.largestFreeBlock) + "},";
+        GifHeapStats gifHeap = getGifHeapStats();
+        json += "\"gif_decoder\":{\"turbo\":" + String(gifHeap.turbo ? "true" : "false") +
+                ",\"heap_checked\":" + String(gifHeap.checked) +
+                ",\"heap_violations\":" + String(gifHeap.violations) +
+                ",\"heap_last_delta\":" + String(gifHeap.lastDelta) + "},";
         json += "\"uptime\":" + String(millis()) + ",";
         json += "\"brightness\":" + String(brightness) + ",";
-        json += "\"gif_playback_enabled\":" + String(gifPlaybackEnabled ? "true" : "false");
+        json += "\"playback_mode\":\"" + String(playbackModeName(playbackMode)) + "\",";
+        json += "\"panel_buffering\":\"" + String(panelDmaPlan.doubleBuffer ? "double" : "single") + "\",";
+        json += "\"panel_color_depth_bits\":" + String(panelDmaPlan.colorDepthBits) + ",";
+        json += "\"panel_dma_bytes\":" + String(panelDmaPlan.totalBytes) + ",";
+        json += "\"ram_plan\":{\"psram\":" + String(ramPlan.psram ? "true" : "false") +
+                ",\"converter\":" + String(ramPlan.converter ? "true" : "false") +
+                ",\"frame_ring\":" + String(ramPlan.frameRingBytes) +
+                ",\"turbo\":" + String(ramPlan.turboBytes) +
+                ",\"uploads\":" + String(ramPlan.uploadBytes) +
+                ",\"frame_cache\":" + String(ramPlan.frameCacheBytes) +
+                ",\"file_cache\":" + String(ramPlan.fileCacheBytes) +
+                ",\"converter_bytes\":" + String(ramPlan.converterBytes) +
+                ",\"total\":" + String(ramPlan.totalBytes) + "},";
+        PanelDrawStats panelDraw = getPanelDrawStats();
+        json += "\"panel_rows_written\":" + String(panelDraw.rowsWritten) + ",";
+        json += "\"panel_rows_skipped\":" + String(panelDraw.rowsSkipped) + ",";
+        json += "\"panel_last_frame_rows_written\":" + String(panelDraw.lastFrameRowsWritten) + ",";
+        json += "\"panel_full_redraws\":" + String(panelDraw.fullRedraws) + ",";
+        json += "\"color_curve\":\"" + String(colorCurveName(colorCurve)) + "\",";
+        DitherStats dither = getDitherStats();
+        json += "\"dither\":{\"enabled\":" + String(ditherEnabled ? "true" : "false") +
+                ",\"active\":" + String(dither.active ? "true" : "false") +
+                ",\"lost_bits\":" + String(dither.lostBits) +
+                ",\"refreshes\":" + String(dither.refreshes) +
+                ",\"frame_us\":" + String(dither.lastFrameUs) +
+                ",\"max_frame_us\":" + String(dither.maxFrameUs) +
+                ",\"interval_us\":" + String(dither.intervalUs) +
+                ",\"bench_frame_us\":" + String(dither.benchFrameUs) +
+                ",\"budget_us\":" + String(DITHER_REFRESH_BUDGET_US) +
+                ",\"over_budget\":" + String(dither.overBudget ? "true" : "false") + "},";
+        ScaleStats scale = getScaleStats();
+        json += "\"scaling\":{\"filter\":\"" + String(scaleFilterName(scaleFilter)) + "\"" +
+                ",\"fit\":\"" + String(scaleFitName(scaleFit)) + "\"" +
+                ",\"gif_width\":" + String(scale.srcWidth) +
+                ",\"gif_height\":" + String(scale.srcHeight) +
+                ",\"scaled_width\":" + String(scale.outWidth) +
+                ",\"scaled_height\":" + String(scale.outHeight) +
+                ",\"rows_drawn\":" + String(scale.rowsDrawn) +
+                ",\"rows_skipped\":" + String(scale.rowsSkipped) + "},";
+        PanelAnimStats anim = getPanelAnimStats();
+        json += "\"panel_anim\":{\"converted\":" + String(anim.indexed) +
+                ",\"pending\":" + String(anim.pending) +
+                ",\"converting\":" + String(anim.converting ? "true" : "false") +
+                ",\"conversions\":" + String(anim.converted) +
+                ",\"failed\":" + String(anim.failed) +
+                ",\"last_convert_ms\":" + String(anim.lastConvertMs) +
+                ",\"plays\":" + String(anim.plays) +
+                ",\"frames_played\":" + String(anim.framesPlayed) +
+                ",\"fallbacks\":" + String(anim.fallbacks) +
+                ",\"work_bytes\":" + String(anim.workBytes) + "},";
+        UploadStats upload = getUploadStats();
+        json += "\"upload\":{\"completed\":" + String(upload.completed) +
+                ",\"failed\":" + String(upload.failed) +
+                ",\"total_kb\":" + String((unsigned long)(upload.bytes / 1024)) +
+                ",\"last_bytes\":" + String(upload.lastBytes) +
+                ",\"last_ms\":" + String(upload.lastMs) +
+                ",\"last_kbps\":" + String(upload.lastKBps) +
+                ",\"last_write_ms\":" + String(upload.lastWriteMs) +
+                ",\"last_writes\":" + String(upload.lastWrites) +
+                ",\"last_stall_ms\":" + String(upload.lastStallMs) + "},";
+        json += "\"sd_bus\":{";
+        for (int c = 0; c < SD_IO_CLASSES; c++) {
+            SdBusClassStats bus = getSdBusStats((sd_io_class_t)c);
+            if (c > 0) json += ",";
+            json += "\"" + String(sdIoClassName((sd_io_class_t)c)) + "\":{\"locks\":" + String(bus.locks) +
+                    ",\"waited\":" + String(bus.contended) +
+                    ",\"avg_wait_us\":" + String(bus.avgLockWaitUs) +
+                    ",\"max_wait_us\":" + String(bus.maxLockWaitUs) +
+                    ",\"jobs\":" + String(bus.jobs) +
+                    ",\"queued\":" + String(bus.queued) +
+                    ",\"avg_queue_us\":" + String(bus.avgQueueWaitUs) +
+                    ",\"max_queue_us\":" + String(bus.maxQueueWaitUs) + "}";
+        }
+        json += "},";
+        json += "\"gif_playback_enabled\":" + String(gifPlaybackEnabled ? "true" : "false") + ",";
+        StatusFeedStats feed = getStatusFeedStats();
+        json += "\"status_feed\":{\"clients\":" + String(feed.clients) +
+                ",\"connects\":" + String(feed.connects) +
+                ",\"changes\":" + String(feed.changes) +
+                ",\"bytes\":" + String(feed.bytes) + "},";
+        PipelineStats stats = getPipelineStats();
+        json += "\"frame_queue_depth\":" + String(stats.queueDepth) + ",";
+        json += "\"frame_queue_peak\":" + String(stats.peakQueueDepth) + ",";
+        json += "\"frame_underruns\":" + String(stats.underruns) + ",";
+        json += "\"frames_presented\":" + String(stats.framesPresented) + ",";
+        json += "\"frame_flushes\":" + String(stats.flushes) + ",";
+        json += "\"preempt_latency_us\":" + String(stats.lastPreemptUs) + ",";
+        json += "\"preempt_latency_max_us\":" + String(stats.maxPreemptUs) + ",";
+        PacingStats pacing = getLastPacingStats();
+        json += "\"last_gif_pacing\":{";
+        json += "\"drop_policy\":\"" + String(frameDropPolicyName(getFrameDropPolicy())) + "\",";
+        json += "\"frames\":" + String(pacing.frames) + ",";
+        json += "\"dropped\":" + String(pacing.dropped) + ",";
+        json += "\"avg_lateness_us\":" + String(pacing.avgLatenessUs) + ",";
+        json += "\"max_lateness_us\":" + String(pacing.maxLatenessUs) + ",";
+        json += "\"jitter_us\":" + String(pacing.jitterUs) + ",";
+        json += "\"authored_ms\":" + String(pacing.authoredMs) + ",";
+        json += "\"actual_ms\":" + String(pacing.actualMs);
+        json += "},";
+        FrameCacheStats cache = getFrameCacheStats();
+        json += "\"frame_cache\":{";
+        json += "\"hits\":" + String(cache.hits) + ",";
+        json += "\"misses\":" + String(cache.misses) + ",";
+        json += "\"evictions\":" + String(cache.evictions) + ",";
+        json += "\"entries\":" + String(cache.entries) + ",";
+        json += "\"bytes_used\":" + String(cache.bytesUsed) + ",";
+        json += "\"capacity\":" + String(cache.capacity) + ",";
+        json += "\"psram\":" + String(cache.inPsram ? "true" : "false");
+        json += "},";
+        FileCacheStats files = getFileCacheStats();
+        json += "\"file_cache\":{";
+        json += "\"hits\":" + String(files.hits) + ",";
+        json += "\"misses\":" + String(files.misses) + ",";
+        json += "\"oversized\":" + String(files.oversized) + ",";
+        json += "\"evictions\":" + String(files.evictions) + ",";
+        json += "\"entries\":" + String(files.entries) + ",";
+        json += "\"bytes_used\":" + String(files.bytesUsed) + ",";
+        json += "\"capacity\":" + String(files.capacity) + ",";
+        json += "\"max_file_size\":" + String(files.maxFileSize) + ",";
+        json += "\"psram\":" + String(files.inPsram ? "true" : "false");
+        json += "},";
+        SdReadStats sdRead = getSdReadStats();
+        json += "\"sd_read\":{";
+        json += "\"reads\":" + String(sdRead.reads) + ",";
+        json += "\"bytes\":" + String((unsigned long long)sdRead.bytes) + ",";
+        json += "\"bytes_per_hour\":" + String((unsigned long long)(millis() ? sdRead.bytes * 3600000ULL / millis() : 0)) + ",";
+        json += "\"bytes_per_sec\":" + String(sdRead.bytesPerSec) + ",";
+        json += "\"avg_latency_us\":" + String(sdRead.avgLatencyUs) + ",";
+        json += "\"p99_latency_us\":" + String(sdRead.p99LatencyUs) + ",";
+        json += "\"readahead_hits\":" + String(sdRead.readAheadHits) + ",";
+        json += "\"prefetch_hits\":" + String(sdRead.prefetchHits);
+        json += "}";
         json += "}";
         request->send(200, "application/json", json);
     });
@@ -376,6 +732,31 @@ void setupAPIEndpoints() {
 
     // GIF playback control endpoints
     server.on("/api/gif/play", HTTP_GET, [](AsyncWebServerRequest *request) {
+        unsigned long receivedUs = micros();
+        if (request->hasParam("path")) {
+            String path = request->getParam("path")->value();
+            if (!path.startsWith("/")) path = "/" + path;
+            if (path.length() >= PLAY_REQUEST_PATH_LEN || !path.endsWith(".gif")) {
+                request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Invalid GIF path\"}");
+                return;
+            }
+            sdLock();
+            bool exists = sd.exists(path.c_str());
+            sdUnlock();
+            if (!exists) {
+                request->send(404, "application/json", "{\"status\":\"error\",\"message\":\"GIF not found\"}");
+                return;
+            }
+            requestPlayNow(path.c_str(), receivedUs);
+            if (!gifPlaybackEnabled) {
+                gifPlaybackEnabled = true;
+                saveGifPlaybackToPreferences();
+            }
+            Serial.printf("Play now requested via API: %s\n", path.c_str());
+            String json = "{\"status\":\"success\",\"message\":\"Playing " + path + "\",\"playback_enabled\":true}";
+            request->send(200, "application/json", json);
+            return;
+        }
         if (!gifPlaybackEnabled) {
             gifPlaybackEnabled = true;
             saveGifPlaybackToPreferences();
@@ -391,6 +772,7 @@ void setupAPIEndpoints() {
     server.on("/api/gif/pause", HTTP_GET, [](AsyncWebServerRequest *request) {
         if (gifPlaybackEnabled) {
             gifPlaybackEnabled = false;
+            requestPlaybackStop();
             saveGifPlaybackToPreferences();
             Serial.println("GIF playback paused via API");
             String json = "{\"status\":\"success\",\"message\":\"GIF playback paused\",\"playback_enabled\":false}";
@@ -403,6 +785,7 @@ void setupAPIEndpoints() {
 
     server.on("/api/gif/stop", HTTP_GET, [](AsyncWebServerRequest *request) {
         gifPlaybackEnabled = false;
+        requestPlaybackStop();
         saveGifPlaybackToPreferences();
         Serial.println("GIF playback stopped via API");
         String json = "{\"status\":\"success\",\"message\":\"GIF playback stopped\",\"playback_enabled\":false}";
@@ -411,6 +794,7 @@ void setupAPIEndpoints() {
 
     server.on("/api/gif/toggle", HTTP_GET, [](AsyncWebServerRequest *request) {
         gifPlaybackEnabled = !gifPlaybackEnabled;
+        if (!gifPlaybackEnabled) requestPlaybackStop();
         saveGifPlaybackToPreferences();
         const char* action = gifPlaybackEnabled ? "started" : "paused";
         Serial.printf("GIF playback %s via API\n", action);
@@ -418,35 +802,229 @@ void setupAPIEndpoints() {
         request->send(200, "application/json", json);
     });
 
+    server.on("/api/gif/next", HTTP_GET, [](AsyncWebServerRequest *request) {
+        requestNextGif(micros());
+        Serial.println("Next GIF requested via API");
+        String json = "{\"status\":\"success\",\"message\":\"Skipping to the next GIF\",\"playback_enabled\":" + String(gifPlaybackEnabled ? "true" : "false") + "}";
+        request->send(200, "application/json", json);
+    });
+
+    // The boot check trusts the index while /gifs keeps its time; this walks it
+    server.on("/api/playlist/rescan", HTTP_GET, [](AsyncWebServerRequest *request) {
+        playlistNotifyRescan();
+        Serial.println("Playlist rescan requested via API");
+        String json = "{\"status\":\"success\",\"message\":\"Playlist rescan queued\"}";
+        request->send(200, "application/json", json);
+    });
+
+    // Playback order: GET reports it, ?mode=sequential|shuffle changes it
+    server.on("/api/playback/mode", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (request->hasParam("mode")) {
+            playback_mode_t mode;
+            if (!parsePlaybackMode(request->getParam("mode")->value(), &mode)) {
+                String json = "{\"status\":\"error\",\"message\":\"Mode must be 'sequential' or 'shuffle'\"}";
+                request->send(400, "application/json", json);
+                return;
+            }
+            if (mode != playbackMode) {
+                playbackMode = mode; // The decode task switches at the next GIF
+                savePlaybackModeToPreferences();
+                Serial.printf("Playback mode set to %s via API\n", playbackModeName(playbackMode));
+            }
+        }
+        String json = "{";
+        json += "\"status\":\"success\",";
+        json += "\"mode\":\"" + String(playbackModeName(playbackMode)) + "\",";
+        json += "\"shuffle_position\":" + String(shufflePosition) + ",";
+        json += "\"shuffle_cycle_length\":" + String(shuffleDomain);
+        json += "}";
+        request->send(200, "application/json", json);
+    });
+
+    // Panel buffering: GET reports it, ?mode=double|single changes it from the next boot
+    server.on("/api/display/buffering", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (request->hasParam("mode")) {
+            String mode = request->getParam("mode")->value();
+            if (mode != "double" && mode != "single") {
+                String json = "{\"status\":\"error\",\"message\":\"Mode must be 'double' or 'single'\"}";
+                request->send(400, "application/json", json);
+                return;
+            }
+            bool requested = (mode == "double");
+            if (requested != panelDoubleBufferRequested) {
+                panelDoubleBufferRequested = requested; // DMA buffers are only allocated at boot
+                savePanelBufferingToPreferences();
+                Serial.printf("Panel buffering set to %s via API, applies after restart\n", mode.c_str());
+            }
+        }
+        String json = "{";
+        json += "\"status\":\"success\",";
+        json += "\"requested\":\"" + String(panelDoubleBufferRequested ? "double" : "single") + "\",";
+        json += "\"active\":\"" + String(panelDmaPlan.doubleBuffer ? "double" : "single") + "\",";
+        json += "\"color_depth_bits\":" + String(panelDmaPlan.colorDepthBits) + ",";
+        json += "\"dma_bytes\":" + String(panelDmaPlan.totalBytes) + ",";
+        json += "\"dma_budget\":" + String(panelDmaPlan.budget) + ",";
+        json += "\"restart_required\":" + String(panelDoubleBufferRequested != panelDmaPlan.doubleBuffer ? "true" : "false");
+        json += "}";
+        request->send(200, "application/json", json);
+    });
+
+    // Frame drop policy: GET reports it, ?policy=never|late changes it
+    server.on("/api/playback/drop", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (request->hasParam("policy")) {
+            frame_drop_policy_t policy;
+            if (!parseFrameDropPolicy(request->getParam("policy")->value().c_str(), &policy)) {
+                String json = "{\"status\":\"error\",\"message\":\"Policy must be 'never' or 'late'\"}";
+                request->send(400, "application/json", json);
+                return;
+            }
+            if (policy != getFrameDropPolicy()) {
+                setFrameDropPolicy(policy); // The presenter picks it up at the next frame
+                saveFrameDropPolicyToPreferences();
+                Serial.printf("Frame drop policy set to %s via API\n", frameDropPolicyName(policy));
+            }
+        }
+        String json = "{";
+        json += "\"status\":\"success\",";
+        json += "\"policy\":\"" + String(frameDropPolicyName(getFrameDropPolicy())) + "\"";
+        json += "}";
+        request->send(200, "application/json", json);
+    });
+
+    // Colour curve: GET reports it, ?curve=off|cie1931|gamma2.2|gamma2.8 changes it
+    server.on("/api/display/curve", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (request->hasParam("curve")) {
+            color_curve_t curve;
+            if (!parseColorCurve(request->getParam("curve")->value(), &curve)) {
+                String json = "{\"status\":\"error\",\"message\":\"Curve must be 'off', 'cie1931', 'gamma2.2' or 'gamma2.8'\"}";
+                request->send(400, "application/json", json);
+                return;
+            }
+            if (curve != colorCurve) {
+                colorCurve = curve; // The decoder picks it up at the next frame
+                frameCacheInvalidateAll(); // Cached frames were composed with the old curve
+                saveColorCurveToPreferences();
+                Serial.printf("Colour curve set to %s via API\n", colorCurveName(colorCurve));
+            }
+        }
+        String json = "{";
+        json += "\"status\":\"success\",";
+        json += "\"curve\":\"" + String(colorCurveName(colorCurve)) + "\"";
+        json += "}";
+        request->send(200, "application/json", json);
+    });
+
+    // Scaling of GIFs that are not panel sized: GET reports it,
+    // ?filter=nearest|box and/or ?fit=letterbox|fit|fill change it
+    server.on("/api/display/scaling", HTTP_GET, [](AsyncWebServerRequest *request) {
+        scale_filter_t filter = scaleFilter;
+        scale_fit_t fit = scaleFit;
+        if (request->hasParam("filter") && !parseScaleFilter(request->getParam("filter")->value(), &filter)) {
+            String json = "{\"status\":\"error\",\"message\":\"Filter must be 'nearest' or 'box'\"}";
+            request->send(400, "application/json", json);
+            return;
+        }
+        if (request->hasParam("fit") && !parseScaleFit(request->getParam("fit")->value(), &fit)) {
+            String json = "{\"status\":\"error\",\"message\":\"Fit must be 'letterbox', 'fit' or 'fill'\"}";
+            request->send(400, "application/json", json);
+            return;
+        }
+        if (filter != scaleFilter || fit != scaleFit) {
+            scaleFilter = filter; // The decoder picks them up at the next GIF
+            scaleFit = fit;
+            frameCacheInvalidateAll(); // Cached frames were scaled the old way
+            saveScalingToPreferences();
+            Serial.printf("Scaling set to %s, %s via API\n", scaleFilterName(scaleFilter), scaleFitName(scaleFit));
+        }
+        String json = "{";
+        json += "\"status\":\"success\",";
+        json += "\"filter\":\"" + String(scaleFilterName(scaleFilter)) + "\",";
+        json += "\"fit\":\"" + String(scaleFitName(scaleFit)) + "\"";
+        json += "}";
+        request->send(200, "application/json", json);
+    });
+
+    // Temporal dithering at low brightness: GET reports it, ?mode=on|off changes it
+    server.on("/api/display/dither", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (request->hasParam("mode")) {
+            String mode = request->getParam("mode")->value();
+            if (mode != "on" && mode != "off") {
+                String json = "{\"status\":\"error\",\"message\":\"Mode must be 'on' or 'off'\"}";
+                request->send(400, "application/json", json);
+                return;
+            }
+            bool enabled = (mode == "on");
+            if (enabled != ditherEnabled) {
+                ditherEnabled = enabled; // The presenter picks it up at the next frame
+                saveDitherToPreferences();
+                Serial.printf("Dithering turned %s via API\n", mode.c_str());
+            }
+        }
+        DitherStats dither = getDitherStats();
+        String json = "{";
+        json += "\"status\":\"success\",";
+        json += "\"mode\":\"" + String(ditherEnabled ? "on" : "off") + "\",";
+        json += "\"active\":" + String(dither.active ? "true" : "false") + ",";
+        json += "\"lost_bits\":" + String(dither.lostBits) + ",";
+        json += "\"over_budget\":" + String(dither.overBudget ? "true" : "false");
+        json += "}";
+        request->send(200, "application/json", json);
+    });
+
+    // Pre-render a GIF already on the card as a panel animation; uploads are converted on their own
+    server.on("/api/gif/convert", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (!request->hasParam("path")) {
+            request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Missing path\"}");
+            return;
+        }
+        String path = request->getParam("path")->value();
+        if (!path.startsWith("/")) path = "/" + path;
+        if (path.length() >= MAX_GIF_PATH_LEN || !path.endsWith(".gif")) {
+            request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Invalid GIF path\"}");
+            return;
+        }
+        sdLock();
+        bool exists = sd.exists(path.c_str());
+        sdUnlock();
+        if (!exists) {
+            request->send(404, "application/json", "{\"status\":\"error\",\"message\":\"GIF not found\"}");
+            return;
+        }
+        if (!panelAnimQueue(path.c_str())) {
+            request->send(503, "application/json", "{\"status\":\"error\",\"message\":\"Conversion queue full\"}");
+            return;
+        }
+        Serial.printf("Panel animation conversion queued via API: %s\n", path.c_str());
+        String json = "{\"status\":\"success\",\"message\":\"Converting " + path + "\",";
+        json += "\"converted\":" + String(panelAnimHas(path.c_str()) ? "true" : "false");
+        json += "}";
+        request->send(200, "application/json", json);
+    });
+
     // List files in a directory
     server.on("/api/files", HTTP_GET, [](AsyncWebServerRequest *request) {
         String path = "/";
         if (request->hasParam("path")) path = request->getParam("path")->value();
         if (!path.startsWith("/")) path = "/" + path;
-        FsFile dir = sd.open(path.c_str(), O_RDONLY);
-        if (!dir || !dir.isDir()) {
-            request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Directory not found\"}");
+        // Any paging parameter switches to the paged object, see filelist.h
+        bool paged = request->hasParam("offset") || request->hasParam("limit") || request->hasParam("cursor");
+        long offset = request->hasParam("offset") ? request->getParam("offset")->value().toInt() : 0;
+        long limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : FILE_LIST_DEFAULT_LIMIT;
+        String cursor = request->hasParam("cursor") ? request->getParam("cursor")->value() : "";
+        int status;
+        const char *message;
+        FileListing *listing = fileListOpen(path.c_str(), paged, offset > 0 ? offset : 0, cursor.c_str(),
+                                            limit > 0 ? limit : 1, &status, &message);
+        if (!listing) {
+            request->send(status, "application/json", String("{\"status\":\"error\",\"message\":\"") + message + "\"}");
             return;
         }
-        String json = "[";
-        FsFile entry;
-        bool first = true;
-        while ((entry = dir.openNextFile())) {
-            if (!first) json += ",";
-            first = false;
-            
-            char name[256];
-            entry.getName(name, sizeof(name));
-            json += "{\"name\":\"" + String(name) + "\",";
-            json += "\"type\":\"" + String(entry.isDir() ? "folder" : "file") + "\",";
-            if (!entry.isDir()) json += "\"size\":" + String(entry.size()) + ",";
-            if (json.endsWith(",")) json.remove(json.length() - 1); // Remove trailing comma
-            json += "}";
-            entry.close();
-        }
-        json += "]";
-        dir.close();
-        request->send(200, "application/json", json);
+        // The filler owns the listing; it is closed when the response ends or the client drops
+        std::shared_ptr<FileListing> holder(listing, fileListClose);
+        request->send(request->beginChunkedResponse("application/json",
+            [holder](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                return fileListRead(holder.get(), buffer, maxLen);
+            }));
     });
 
     // Delete file or folder
@@ -464,11 +1042,19 @@ void setupAPIEndpoints() {
         }
         String path = doc["path"] | "";
         if (!path.startsWith("/")) path = "/" + path;
+        // One lock across the check and the change, so nothing slips in between
+        sdLock();
         if (!sd.exists(path.c_str())) {
+            sdUnlock();
             request->send(404, "application/json", "{\"status\":\"error\",\"message\":\"File/folder not found\"}");
             return;
         }
+        invalidateCaches(path.c_str());
         bool ok = sd.remove(path.c_str());
+        sdUnlock();
+        if (ok) {
+            playlistNotifyRemoved(path.c_str());
+        }
         if (ok) request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Deleted\"}");
         else request->send(500, "application/json", "{\"status\":\"error\",\"message\":\"Delete failed\"}");
     });
@@ -491,11 +1077,18 @@ void setupAPIEndpoints() {
         if (!path.startsWith("/")) path = "/" + path;
         int lastSlash = path.lastIndexOf('/');
         String newPath = path.substring(0, lastSlash + 1) + newName;
+        sdLock();
         if (!sd.exists(path.c_str())) {
+            sdUnlock();
             request->send(404, "application/json", "{\"status\":\"error\",\"message\":\"File/folder not found\"}");
             return;
         }
+        invalidateCaches(path.c_str());
         bool ok = sd.rename(path.c_str(), newPath.c_str());
+        sdUnlock();
+        if (ok) {
+            playlistNotifyRenamed(path.c_str(), newPath.c_str());
+        }
         if (ok) request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Renamed\"}");
         else request->send(500, "application/json", "{\"status\":\"error\",\"message\":\"Rename failed\"}");
     });
@@ -517,11 +1110,18 @@ void setupAPIEndpoints() {
         String newPath = doc["newPath"] | "";
         if (!path.startsWith("/")) path = "/" + path;
         if (!newPath.startsWith("/")) newPath = "/" + newPath;
+        sdLock();
         if (!sd.exists(path.c_str())) {
+            sdUnlock();
             request->send(404, "application/json", "{\"status\":\"error\",\"message\":\"File/folder not found\"}");
             return;
         }
+        invalidateCaches(path.c_str());
         bool ok = sd.rename(path.c_str(), newPath.c_str());
+        sdUnlock();
+        if (ok) {
+            playlistNotifyRenamed(path.c_str(), newPath.c_str());
+        }
         if (ok) request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Moved\"}");
         else request->send(500, "application/json", "{\"status\":\"error\",\"message\":\"Move failed\"}");
     });
@@ -541,11 +1141,14 @@ void setupAPIEndpoints() {
         }
         String name = doc["name"] | "";
         String path = "/" + name;
+        sdLock();
         if (sd.exists(path.c_str())) {
+            sdUnlock();
             request->send(409, "application/json", "{\"status\":\"error\",\"message\":\"Folder already exists\"}");
             return;
         }
         bool ok = sd.mkdir(path.c_str());
+        sdUnlock();
         if (ok) request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Folder created\"}");
         else request->send(500, "application/json", "{\"status\":\"error\",\"message\":\"Create folder failed\"}");
     });
@@ -568,11 +1171,18 @@ void setupAPIEndpoints() {
         if (!path.startsWith("/")) path = "/" + path;
         int lastSlash = path.lastIndexOf('/');
         String newPath = path.substring(0, lastSlash + 1) + newName;
+        sdLock();
         if (!sd.exists(path.c_str())) {
+            sdUnlock();
             request->send(404, "application/json", "{\"status\":\"error\",\"message\":\"Directory not found\"}");
             return;
         }
+        invalidateAllCaches();
         bool ok = sd.rename(path.c_str(), newPath.c_str());
+        sdUnlock();
+        if (ok) {
+            playlistNotifyRenamed(path.c_str(), newPath.c_str());
+        }
         if (ok) request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Directory renamed\"}");
         else request->send(500, "application/json", "{\"status\":\"error\",\"message\":\"Rename failed\"}");
     });
@@ -592,12 +1202,19 @@ void setupAPIEndpoints() {
         }
         String path = doc["path"] | "";
         if (!path.startsWith("/")) path = "/" + path;
+        sdLock();
         if (!sd.exists(path.c_str())) {
+            sdUnlock();
             request->send(404, "application/json", "{\"status\":\"error\",\"message\":\"Directory not found\"}");
             return;
         }
         // Recursively delete directory
+        invalidateAllCaches();
         bool ok = sd.rmdir(path.c_str());
+        sdUnlock();
+        if (ok) {
+            playlistNotifyRemoved(path.c_str());
+        }
         if (ok) request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Directory deleted\"}");
         else request->send(500, "application/json", "{\"status\":\"error\",\"message\":\"Delete failed\"}");
     });
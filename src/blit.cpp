@@ -0,0 +1,42 @@
+#include "blit.h"
+
+// Push one scanline of RGB565 pixels into the DMA buffer.
+// The span is clipped to the panel, then split into runs of equal colour:
+// long runs go through drawFastHLine(), which updates every bit plane for the
+// whole run in a single pass, and short runs use the non-virtual drawPixel()
+// so the compiler can inline it instead of dispatching through Adafruit_GFX.
+void blitRow565(MatrixPanel_I2S_DMA *display, int x, int y, const uint16_t *span, int count)
+{
+    if (display == nullptr || y < 0 || y >= display->height())
+        return;
+
+    if (x < 0) {
+        span -= x;
+        count += x;
+        x = 0;
+    }
+    if (x + count > display->width())
+        count = display->width() - x;
+
+    int i = 0;
+    while (i < count) {
+        uint16_t color = span[i];
+        int run = 1;
+        while (i + run < count && span[i + run] == color)
+            run++;
+
+        if (run >= BLIT_HLINE_MIN_RUN) {
+            display->drawFastHLine(x + i, y, run, color);
+        } else {
+            for (int k = 0; k < run; k++)
+                display->MatrixPanel_I2S_DMA::drawPixel(x + i + k, y, color);
+        }
+        i += run;
+    }
+} /* blitRow565() */
+
+void blitFrame565(MatrixPanel_I2S_DMA *display, const uint16_t *pixels, int width, int height)
+{
+    for (int y = 0; y < height; y++)
+        blitRow565(display, 0, y, pixels + y * width, width);
+} /* blitFrame565() */
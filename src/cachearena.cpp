@@ -0,0 +1,213 @@
+#include "cachearena.h"
+
+static portMUX_TYPE staleMux = portMUX_INITIALIZER_UNLOCKED; // Guards the stale flags of every arena
+
+static uint32_t hashPath(const char *path) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    while (*path) {
+        hash ^= (uint8_t)*path++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+uint32_t cacheArenaPathBytes(const char *path) {
+    return (strlen(path) + 1 + 3) & ~3u;
+}
+
+// Allocate the arena: with PSRAM, psramBudget or half of what is free if
+// less; without it, heapBudget, where 0 leaves the cache off
+bool cacheArenaInit(CacheArena &arena, const char *name, CacheArenaEntry *entries, int maxEntries,
+                    uint32_t psramBudget, uint32_t heapBudget) {
+    memset(&arena, 0, sizeof(arena));
+    memset(entries, 0, sizeof(CacheArenaEntry) * maxEntries);
+    arena.entries = entries;
+    arena.maxEntries = maxEntries;
+    arena.pinned = -1;
+    if (psramFound()) {
+        arena.size = min(psramBudget, (uint32_t)(ESP.getFreePsram() / 2));
+        arena.base = (uint8_t *)ps_malloc(arena.size);
+        arena.inPsram = true;
+    } else if (heapBudget > 0) {
+        arena.size = heapBudget;
+        arena.base = (uint8_t *)malloc(arena.size);
+    } else {
+        Serial.printf("%s off: no PSRAM\n", name);
+        return false;
+    }
+    if (arena.base == nullptr) {
+        Serial.printf("%s disabled: arena allocation failed\n", name);
+        arena.size = 0;
+        return false;
+    }
+    return true;
+}
+
+static const char *entryPath(CacheArena &arena, int i) {
+    return (const char *)(arena.base + arena.entries[i].offset);
+}
+
+// Entry holding path, or -1; stale entries are found too
+int cacheArenaFind(CacheArena &arena, const char *path) {
+    if (arena.base == nullptr) return -1;
+    uint32_t hash = hashPath(path);
+    for (int i = 0; i < arena.maxEntries; i++) {
+        const CacheArenaEntry &entry = arena.entries[i];
+        if (entry.used && i != arena.pinned && entry.pathHash == hash && strcmp(entryPath(arena, i), path) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Whether path is cached; stale entries count as missing
+bool cacheArenaHas(CacheArena &arena, const char *path) {
+    int i = cacheArenaFind(arena, path);
+    return i >= 0 && !arena.entries[i].stale;
+}
+
+void cacheArenaDropStale(CacheArena &arena) {
+    for (int i = 0; i < arena.maxEntries; i++) {
+        portENTER_CRITICAL(&staleMux);
+        bool stale = arena.entries[i].used && arena.entries[i].stale && i != arena.pinned;
+        portEXIT_CRITICAL(&staleMux);
+        if (stale) arena.entries[i].used = false;
+    }
+}
+
+uint32_t cacheArenaBytesUsed(CacheArena &arena) {
+    uint32_t used = 0;
+    for (int i = 0; i < arena.maxEntries; i++) {
+        if (arena.entries[i].used) used += arena.entries[i].bytes;
+    }
+    return used;
+}
+
+uint32_t cacheArenaEntryCount(CacheArena &arena) {
+    uint32_t count = 0;
+    for (int i = 0; i < arena.maxEntries; i++) {
+        if (arena.entries[i].used && i != arena.pinned) count++;
+    }
+    return count;
+}
+
+// Evict the least recently used entry, or with sizeWeighted the one with the
+// largest age * size
+static bool evictOne(CacheArena &arena) {
+    int victim = -1;
+    uint64_t worst = 0;
+    for (int i = 0; i < arena.maxEntries; i++) {
+        const CacheArenaEntry &entry = arena.entries[i];
+        if (!entry.used || i == arena.pinned) continue;
+        uint64_t score = arena.useClock - entry.lastUsed + 1;
+        if (arena.sizeWeighted) score *= entry.bytes;
+        if (victim < 0 || score > worst) {
+            victim = i;
+            worst = score;
+        }
+    }
+    if (victim < 0) return false;
+    arena.entries[victim].used = false;
+    arena.evictions++;
+    return true;
+}
+
+// Slide live entries down so all free space is at the end; returns the new end
+static uint32_t compact(CacheArena &arena) {
+    uint32_t end = 0;
+    for (;;) {
+        // Next entry in arena order at or after 'end'
+        int next = -1;
+        for (int i = 0; i < arena.maxEntries; i++) {
+            const CacheArenaEntry &entry = arena.entries[i];
+            if (entry.used && entry.offset >= end && (next < 0 || entry.offset < arena.entries[next].offset)) {
+                next = i;
+            }
+        }
+        if (next < 0) return end;
+        CacheArenaEntry &entry = arena.entries[next];
+        if (entry.offset != end) {
+            memmove(arena.base + end, arena.base + entry.offset, entry.bytes);
+            entry.offset = end;
+        }
+        end += entry.bytes;
+    }
+}
+
+static uint32_t arenaEnd(CacheArena &arena) {
+    uint32_t end = 0;
+    for (int i = 0; i < arena.maxEntries; i++) {
+        const CacheArenaEntry &entry = arena.entries[i];
+        if (entry.used && entry.offset + entry.bytes > end) end = entry.offset + entry.bytes;
+    }
+    return end;
+}
+
+// A new entry for path with room for payloadBytes after it, evicting as
+// needed; returns it, or -1 if it cannot fit. The payload is left unwritten.
+int cacheArenaAlloc(CacheArena &arena, const char *path, uint32_t payloadBytes) {
+    if (arena.base == nullptr) return -1;
+    uint32_t needed = cacheArenaPathBytes(path) + payloadBytes;
+    if (needed > arena.size) return -1;
+
+    int slot;
+    for (;;) {
+        slot = -1;
+        for (int i = 0; i < arena.maxEntries && slot < 0; i++) {
+            if (!arena.entries[i].used) slot = i;
+        }
+        if (slot >= 0 && cacheArenaBytesUsed(arena) + needed <= arena.size) break;
+        if (!evictOne(arena)) return -1;
+    }
+    uint32_t end = arenaEnd(arena);
+    if (end + needed > arena.size) end = compact(arena);
+
+    CacheArenaEntry &entry = arena.entries[slot];
+    entry.offset = end;
+    entry.bytes = needed;
+    entry.pathHash = hashPath(path);
+    entry.lastUsed = ++arena.useClock;
+    entry.stale = false;
+    entry.used = true;
+    strcpy((char *)(arena.base + entry.offset), path);
+    return slot;
+}
+
+void cacheArenaFree(CacheArena &arena, int i) {
+    arena.entries[i].used = false;
+}
+
+// Shrink an entry's payload, e.g. to what was filled of a reservation
+void cacheArenaTrim(CacheArena &arena, int i, uint32_t payloadBytes) {
+    arena.entries[i].bytes = cacheArenaPathBytes(entryPath(arena, i)) + payloadBytes;
+}
+
+void cacheArenaTouch(CacheArena &arena, int i) {
+    arena.entries[i].lastUsed = ++arena.useClock;
+}
+
+uint8_t *cacheArenaPayload(CacheArena &arena, int i) {
+    return arena.base + arena.entries[i].offset + cacheArenaPathBytes(entryPath(arena, i));
+}
+
+uint32_t cacheArenaPayloadBytes(CacheArena &arena, int i) {
+    return arena.entries[i].bytes - cacheArenaPathBytes(entryPath(arena, i));
+}
+
+// Called from any task when a file is replaced, moved or removed
+void cacheArenaInvalidate(CacheArena &arena, const char *path) {
+    uint32_t hash = hashPath(path);
+    portENTER_CRITICAL(&staleMux);
+    for (int i = 0; i < arena.maxEntries; i++) {
+        if (arena.entries[i].used && arena.entries[i].pathHash == hash) arena.entries[i].stale = true;
+    }
+    portEXIT_CRITICAL(&staleMux);
+}
+
+void cacheArenaInvalidateAll(CacheArena &arena) {
+    portENTER_CRITICAL(&staleMux);
+    for (int i = 0; i < arena.maxEntries; i++) {
+        if (arena.entries[i].used) arena.entries[i].stale = true;
+    }
+    portEXIT_CRITICAL(&staleMux);
+}
@@ -0,0 +1,162 @@
+#include "colorcorrect.h"
+#include <array>
+
+color_curve_t colorCurve = COLOR_CURVE_DEFAULT;
+
+// Compile-time pow() for the gamma tables: x^g = exp(g * ln(x)), with ln and
+// exp reduced to ranges where their series converge in a few terms
+constexpr double LN2 = 0.69314718055994530942;
+
+constexpr double constLn(double x) {
+    int k = 0;
+    while (x >= 2.0) { x /= 2.0; k++; }
+    while (x < 1.0) { x *= 2.0; k--; }
+    // ln(m) = 2 atanh((m - 1) / (m + 1)), |z| <= 1/3 for m in [1, 2)
+    double z = (x - 1.0) / (x + 1.0);
+    double term = z, sum = 0.0;
+    for (int n = 1; n < 40; n += 2) {
+        sum += term / n;
+        term *= z * z;
+    }
+    return k * LN2 + 2.0 * sum;
+}
+
+constexpr double constExp(double x) {
+    // exp(x) = exp(x / 64)^64
+    double y = x / 64.0, term = 1.0, sum = 1.0;
+    for (int n = 1; n < 20; n++) {
+        term *= y / n;
+        sum += term;
+    }
+    for (int i = 0; i < 6; i++) sum *= sum;
+    return sum;
+}
+
+constexpr double constPow(double x, double g) {
+    return x <= 0.0 ? 0.0 : constExp(g * constLn(x));
+}
+
+// CIE 1931 lightness (L* = 100 * v) to luminance
+constexpr double cie1931(double v) {
+    double l = v * 100.0;
+    if (l <= 8.0) return l / 903.3;
+    double t = (l + 16.0) / 116.0;
+    return t * t * t;
+}
+
+typedef std::array<uint16_t, 256> CurveTable; // 8-bit channel to linear light, Q12
+
+constexpr CurveTable makeCurve(color_curve_t curve) {
+    CurveTable table = {};
+    for (int i = 0; i < 256; i++) {
+        double v = i / 255.0;
+        double linear = curve == COLOR_CURVE_CIE1931 ? cie1931(v)
+                      : curve == COLOR_CURVE_GAMMA22 ? constPow(v, 2.2)
+                      : curve == COLOR_CURVE_GAMMA28 ? constPow(v, 2.8)
+                      : v;
+        table[i] = (uint16_t)(linear * 4095.0 + 0.5);
+    }
+    return table;
+}
+
+static constexpr CurveTable curveTables[COLOR_CURVE_COUNT] = {
+    makeCurve(COLOR_CURVE_OFF),
+    makeCurve(COLOR_CURVE_CIE1931),
+    makeCurve(COLOR_CURVE_GAMMA22),
+    makeCurve(COLOR_CURVE_GAMMA28),
+};
+static_assert(curveTables[COLOR_CURVE_GAMMA22][128] == 899, "gamma 2.2 table");
+static_assert(curveTables[COLOR_CURVE_GAMMA28][255] == 4095, "gamma 2.8 table");
+
+// Light of each RGB565 channel code on the panel, Q12: the code expanded to
+// 8 bits, through the library's CIE 1931 table
+template <int Bits>
+constexpr std::array<uint16_t, 1 << Bits> makeCodeLight() {
+    std::array<uint16_t, 1 << Bits> light = {};
+    for (int code = 0; code < (1 << Bits); code++) {
+        int value = (code << (8 - Bits)) | (code >> (2 * Bits - 8));
+        light[code] = curveTables[COLOR_CURVE_CIE1931][value];
+    }
+    return light;
+}
+
+static constexpr std::array<uint16_t, 32> codeLight5 = makeCodeLight<5>();
+static constexpr std::array<uint16_t, 64> codeLight6 = makeCodeLight<6>();
+static_assert(codeLight5[1] > 0 && codeLight6[1] > 0, "darkest codes light the LED");
+
+// The code whose light is nearest to linear (Q12)
+template <size_t N>
+static uint8_t nearestCode(const std::array<uint16_t, N> &light, int32_t linear) {
+    size_t lo = 0, hi = N - 1;
+    while (lo < hi) { // First code at least as bright
+        size_t mid = (lo + hi) / 2;
+        if (light[mid] < linear) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo > 0 && linear - light[lo - 1] <= light[lo] - linear) lo--;
+    return lo;
+}
+
+static constexpr int32_t whiteBalance[3][3] = COLOR_WHITE_BALANCE;
+
+static constexpr bool whiteBalanceIsIdentity() {
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 3; col++) {
+            if (whiteBalance[row][col] != (row == col ? 4096 : 0)) return false;
+        }
+    }
+    return true;
+}
+
+// Correct a whole palette into corrected[256]; called by drawGifLine() on the
+// first line of each frame, which covers local palettes too. Returns the
+// palette to draw with.
+const uint16_t *colorCorrectPalette(const uint16_t *palette, color_curve_t curve, uint16_t *corrected) {
+    if (curve == COLOR_CURVE_CIE1931 && whiteBalanceIsIdentity()) return palette; // What the panel does anyway
+    const CurveTable &table = curveTables[curve < COLOR_CURVE_COUNT ? curve : COLOR_CURVE_DEFAULT];
+
+    for (int i = 0; i < 256; i++) {
+        uint16_t color = palette[i];
+        // Expand RGB565 to 8 bits per channel, then to linear light
+        uint8_t r5 = color >> 11, g6 = (color >> 5) & 0x3F, b5 = color & 0x1F;
+        int32_t in[3] = {
+            table[(r5 << 3) | (r5 >> 2)],
+            table[(g6 << 2) | (g6 >> 4)],
+            table[(b5 << 3) | (b5 >> 2)],
+        };
+        int32_t out[3];
+        for (int row = 0; row < 3; row++) {
+            int32_t v = (whiteBalance[row][0] * in[0] + whiteBalance[row][1] * in[1] +
+                         whiteBalance[row][2] * in[2] + 2048) >> 12;
+            out[row] = v < 0 ? 0 : v > 4095 ? 4095 : v;
+        }
+        corrected[i] = (nearestCode(codeLight5, out[0]) << 11) | (nearestCode(codeLight6, out[1]) << 5) |
+                       nearestCode(codeLight5, out[2]);
+    }
+    return corrected;
+}
+
+// LED duty (0-255) the panel library drives an 8-bit channel value with
+uint8_t colorPanelDuty(uint8_t value) {
+    return (curveTables[COLOR_CURVE_CIE1931][value] * 255 + 2047) / 4095;
+}
+
+const char *colorCurveName(color_curve_t curve) {
+    switch (curve) {
+        case COLOR_CURVE_OFF: return "off";
+        case COLOR_CURVE_CIE1931: return "cie1931";
+        case COLOR_CURVE_GAMMA22: return "gamma2.2";
+        case COLOR_CURVE_GAMMA28: return "gamma2.8";
+        default: return "unknown";
+    }
+}
+
+bool parseColorCurve(const String &name, color_curve_t *curve) {
+    for (int i = 0; i < COLOR_CURVE_COUNT; i++) {
+        if (name == colorCurveName((color_curve_t)i)) {
+            *curve = (color_curve_t)i;
+            return true;
+        }
+    }
+    return false;
+}
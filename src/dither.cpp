@@ -0,0 +1,185 @@
+#include "dither.h"
+#include "globals.h"
+#include "blit.h"
+#include "panel.h"
+#include "colorcorrect.h"
+
+bool ditherEnabled = DITHER_DEFAULT_ENABLED;
+
+// Each halving of brightness below this hides one more low bit plane
+#define DITHER_FULL_DEPTH_BRIGHTNESS 128
+
+static const uint8_t bayer4x4[16] = {
+     0,  8,  2, 10,
+    12,  4, 14,  6,
+     3, 11,  1,  9,
+    15,  7, 13,  5,
+};
+
+// Tables for one brightness level. pick*[code][rank] is the code to show for
+// a channel code at a Bayer rank; rank[phase][(y & 3) * 4 + (x & 3)] is the
+// rank of a pixel in that refresh.
+struct DitherTables {
+    uint8_t lostBits;    // Of the 8-bit LED duty
+    bool hidesLevels;    // Some codes show less than their duty
+    uint8_t rank[DITHER_PHASES][16];
+    uint8_t pick5[32][16];
+    uint8_t pick6[64][16];
+};
+
+// Owned by the present task
+static DitherTables tables = {0xFF, false, {}, {}, {}};
+static uint16_t source[MATRIX_WIDTH * MATRIX_HEIGHT];   // Frame being shown, redrawn each refresh
+static uint16_t dithered[MATRIX_WIDTH * MATRIX_HEIGHT];
+static uint8_t phase = 0;
+static unsigned long lastDrawUs = 0;
+static uint32_t intervalUs = DITHER_REFRESH_US;
+static bool haveSource = false;
+
+static DitherStats stats = {0, false, false, 0, 0, 0, DITHER_REFRESH_US, 0};
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint8_t lostBitsFor(uint8_t level, uint8_t depthBits) {
+    uint8_t lost = depthBits < 8 ? 8 - depthBits : 0;
+    for (int b = DITHER_FULL_DEPTH_BRIGHTNESS; b > 1 && level < b; b >>= 1) {
+        lost++;
+    }
+    return lost > 7 ? 7 : lost;
+}
+
+// Fill pick[code][rank] for one channel width: a code whose duty loses its
+// low bits shows the next brighter code for the share of ranks the loss is
+// of one level
+static void buildPicks(uint8_t (*pick)[16], int bits, uint8_t lostBits) {
+    int codes = 1 << bits;
+    int duty[64], shown[64];
+    for (int code = 0; code < codes; code++) {
+        duty[code] = colorPanelDuty((code << (8 - bits)) | (code >> (2 * bits - 8)));
+        shown[code] = (duty[code] >> lostBits) << lostBits;
+    }
+    for (int code = 0; code < codes; code++) {
+        int up = code;
+        while (up + 1 < codes && shown[up] <= shown[code]) up++;
+        int step = shown[up] - shown[code];
+        int share = step > 0 ? (duty[code] - shown[code]) * 16 / step : 0; // Ranks of 16 that show 'up'
+        if (share > 0) tables.hidesLevels = true;
+        for (int rank = 0; rank < 16; rank++) {
+            pick[code][rank] = rank < share ? up : code;
+        }
+    }
+}
+
+static void buildTables(uint8_t lostBits) {
+    tables.lostBits = lostBits;
+    tables.hidesLevels = false;
+    for (int p = 0; p < DITHER_PHASES; p++) {
+        for (int i = 0; i < 16; i++) {
+            // Rotating the rank every refresh walks each pixel through every threshold
+            tables.rank[p][i] = (bayer4x4[i] + p * (16 / DITHER_PHASES)) & 15;
+        }
+    }
+    buildPicks(tables.pick5, 5, lostBits);
+    buildPicks(tables.pick6, 6, lostBits);
+}
+
+// The hot loop: per channel one table lookup
+static void ditherFrame(const uint16_t *in, uint16_t *out, uint8_t p) {
+    for (int y = 0; y < MATRIX_HEIGHT; y++) {
+        const uint8_t *rank = &tables.rank[p][(y & 3) * 4];
+        const uint16_t *src = in + y * MATRIX_WIDTH;
+        uint16_t *dst = out + y * MATRIX_WIDTH;
+        for (int x = 0; x < MATRIX_WIDTH; x++) {
+            uint16_t c = src[x];
+            uint8_t r = rank[x & 3];
+            dst[x] = (tables.pick5[c >> 11][r] << 11) | (tables.pick6[(c >> 5) & 0x3F][r] << 5) |
+                     tables.pick5[c & 0x1F][r];
+        }
+    }
+}
+
+// Whether the current brightness hides any RGB565 levels; rebuilds the
+// tables when brightness or colour depth changed
+bool ditherActive() {
+    uint8_t lost = lostBitsFor(brightness, panelDmaPlan.colorDepthBits);
+    if (lost != tables.lostBits) buildTables(lost);
+    bool active = ditherEnabled && !stats.overBudget && tables.hidesLevels;
+    if (active != stats.active || lost != stats.lostBits) {
+        portENTER_CRITICAL(&statsMux);
+        stats.active = active;
+        stats.lostBits = lost;
+        portEXIT_CRITICAL(&statsMux);
+    }
+    return active;
+}
+
+static void draw(MatrixPanel_I2S_DMA *display) {
+    unsigned long start = micros();
+    phase = (phase + 1) % DITHER_PHASES;
+    ditherFrame(source, dithered, phase);
+    blitFrame565(display, dithered, MATRIX_WIDTH, MATRIX_HEIGHT);
+    uint32_t us = micros() - start;
+    panelInvalidate(); // Both buffers differ from the frames now, redraw them in full after dithering
+    panelPresent();
+    lastDrawUs = micros();
+    intervalUs = max((uint32_t)DITHER_REFRESH_US, us * DITHER_IDLE_FACTOR);
+
+    portENTER_CRITICAL(&statsMux);
+    stats.refreshes++;
+    stats.lastFrameUs = us;
+    if (us > stats.maxFrameUs) stats.maxFrameUs = us;
+    stats.intervalUs = intervalUs;
+    portEXIT_CRITICAL(&statsMux);
+}
+
+// Show a new frame dithered; call only while ditherActive()
+void ditherPresent(MatrixPanel_I2S_DMA *display, const uint16_t *pixels) {
+    memcpy(source, pixels, sizeof(source));
+    haveSource = true;
+    draw(display);
+}
+
+// Whether the shown frame should be redrawn with the next thresholds.
+// Double buffered, only once the last flip has landed.
+bool ditherRefreshDue() {
+    return haveSource && ditherActive() && micros() - lastDrawUs >= intervalUs && panelBackBufferReady();
+}
+
+void ditherRefresh(MatrixPanel_I2S_DMA *display) {
+    draw(display);
+}
+
+// Average time of one refresh at the deepest level: dithering a frame and
+// writing it to the panel. Run before the present task starts, it borrows
+// the present task's tables and leaves the panel blank; over budget,
+// dithering stays off until reboot.
+uint32_t ditherBenchmark(MatrixPanel_I2S_DMA *display, int frames) {
+    for (int i = 0; i < MATRIX_WIDTH * MATRIX_HEIGHT; i++) {
+        source[i] = (uint16_t)(i * 2654435761u >> 16); // Every channel value shows up
+    }
+    buildTables(7);
+    unsigned long start = micros();
+    for (int f = 0; f < frames; f++) {
+        ditherFrame(source, dithered, f % DITHER_PHASES);
+        blitFrame565(display, dithered, MATRIX_WIDTH, MATRIX_HEIGHT);
+    }
+    uint32_t us = (micros() - start) / (frames > 0 ? frames : 1);
+    tables.lostBits = 0xFF; // Rebuilt for the real brightness on first use
+    display->fillScreen(0);
+    panelInvalidate();
+
+    portENTER_CRITICAL(&statsMux);
+    stats.benchFrameUs = us;
+    stats.overBudget = us > DITHER_REFRESH_BUDGET_US;
+    portEXIT_CRITICAL(&statsMux);
+    Serial.printf("Dither: %lu us per %dx%d refresh (budget %d us)%s\n", (unsigned long)us,
+                  MATRIX_WIDTH, MATRIX_HEIGHT, DITHER_REFRESH_BUDGET_US,
+                  stats.overBudget ? ", over budget, disabled" : "");
+    return us;
+}
+
+DitherStats getDitherStats() {
+    portENTER_CRITICAL(&statsMux);
+    DitherStats copy = stats;
+    portEXIT_CRITICAL(&statsMux);
+    return copy;
+}
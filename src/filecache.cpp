@@ -0,0 +1,102 @@
+#include "filecache.h"
+#include "sdreader.h"
+#include "cachearena.h"
+#include "ramplan.h"
+
+// Cache of whole GIF files for decoding from memory. Each entry of the arena
+// (cachearena.h) holds one file. Only the decode task touches the arena, and
+// only between GIFs, so compaction never moves a file AnimatedGIF is reading.
+
+static CacheArenaEntry entries[FILE_CACHE_MAX_ENTRIES];
+static CacheArena arena;
+
+static uint32_t hits = 0, misses = 0, oversized = 0;
+
+static uint32_t maxFileSize() {
+    return arena.size < FILE_CACHE_MAX_FILE_SIZE ? arena.size : FILE_CACHE_MAX_FILE_SIZE;
+}
+
+bool initFileCache() {
+    if (!cacheArenaInit(arena, "File cache", entries, FILE_CACHE_MAX_ENTRIES, FILE_CACHE_PSRAM_BUDGET,
+                        ramPlan.fileCacheBytes)) {
+        return false;
+    }
+    Serial.printf("File cache: %lu bytes in %s, GIFs up to %lu bytes\n", (unsigned long)arena.size,
+                  arena.inPsram ? "PSRAM" : "heap", (unsigned long)maxFileSize());
+    return true;
+}
+
+// Read a cacheable GIF from the card into a new entry; -1 if it is not cacheable
+static int load(const char *path) {
+    int32_t size = 0;
+    void *handle = sdReaderOpen(path, &size);
+    if (handle == nullptr) return -1;
+
+    int slot = -1;
+    if (size > 0 && (uint32_t)size <= maxFileSize()) {
+        slot = cacheArenaAlloc(arena, path, size);
+    }
+    if (slot < 0) {
+        oversized++;
+        sdReaderClose(handle); // Stays parked, so ShowGIF() opens it for free
+        return -1;
+    }
+
+    int32_t read = sdReaderRead(handle, 0, cacheArenaPayload(arena, slot), size);
+    sdReaderClose(handle);
+    if (read != size) {
+        Serial.printf("File cache: short read of %s (%ld of %ld bytes)\n", path, (long)read, (long)size);
+        cacheArenaFree(arena, slot);
+        return -1;
+    }
+    misses++;
+    return slot;
+}
+
+// The whole file of a GIF about to be played, loading it on first play.
+// Returns false for GIFs that have to be streamed from the card. The data
+// stays valid until the next call.
+bool fileCacheGet(const char *path, const uint8_t **data, int32_t *size) {
+    if (arena.base == nullptr) return false;
+    cacheArenaDropStale(arena);
+
+    int i = cacheArenaFind(arena, path);
+    if (i >= 0) {
+        hits++;
+        cacheArenaTouch(arena, i);
+    } else {
+        i = load(path);
+        if (i < 0) return false;
+    }
+    *data = cacheArenaPayload(arena, i);
+    *size = cacheArenaPayloadBytes(arena, i);
+    return true;
+}
+
+// Whether a GIF would play from memory; stale entries count as missing
+bool fileCacheHas(const char *path) {
+    return cacheArenaHas(arena, path);
+}
+
+// Called by the web API when a file is replaced, moved or removed
+void fileCacheInvalidate(const char *path) {
+    cacheArenaInvalidate(arena, path);
+}
+
+void fileCacheInvalidateAll() {
+    cacheArenaInvalidateAll(arena);
+}
+
+FileCacheStats getFileCacheStats() {
+    FileCacheStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.oversized = oversized;
+    stats.evictions = arena.evictions;
+    stats.entries = cacheArenaEntryCount(arena);
+    stats.bytesUsed = cacheArenaBytesUsed(arena);
+    stats.capacity = arena.size;
+    stats.maxFileSize = maxFileSize();
+    stats.inPsram = arena.inPsram;
+    return stats;
+}
@@ -0,0 +1,237 @@
+#include "filelist.h"
+#include "globals.h"
+#include "sdcard.h"
+#include <new>
+
+enum ListStage : uint8_t {
+    LIST_HEAD = 0,
+    LIST_ENTRIES,
+    LIST_TAIL,
+    LIST_DONE
+};
+
+struct FileListing {
+    FsFile dir;
+    uint32_t pathHash;           // Ties cursors to the directory they came from
+    bool paged;
+    uint32_t skip;               // Offset entries still to pass over
+    uint32_t offset;
+    uint32_t limit;
+    uint32_t count;              // Entries written
+    bool hasNext;
+    uint64_t nextPosition;       // Directory position of the first entry of the next page
+    ListStage stage;
+    size_t textLen, textPos;     // Output not yet handed to the server
+    char text[FILE_LIST_TEXT_BYTES];
+};
+
+static uint32_t openListings = 0;
+static portMUX_TYPE listMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t hashPath(const char *path) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    while (*path) {
+        hash ^= (uint8_t)*path++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Append s to out as the inside of a JSON string; returns the new length, or
+// len unchanged when it does not fit
+static size_t appendEscaped(char *out, size_t len, size_t size, const char *s) {
+    size_t start = len;
+    for (; *s; s++) {
+        uint8_t c = (uint8_t)*s;
+        char esc[8];
+        int n;
+        if (c == '"' || c == '\\') n = snprintf(esc, sizeof(esc), "\\%c", c);
+        else if (c < 0x20) n = snprintf(esc, sizeof(esc), "\\u%04x", c);
+        else {
+            esc[0] = (char)c;
+            n = 1;
+        }
+        if (len + n >= size) return start;
+        memcpy(out + len, esc, n);
+        len += n;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Cursor: directory position, then the path hash, in hex
+static bool parseCursor(const char *cursor, uint32_t pathHash, uint64_t *position) {
+    char *end;
+    unsigned long long pos = strtoull(cursor, &end, 16);
+    if (end == cursor || *end != '.') return false;
+    const char *hashText = end + 1;
+    unsigned long hash = strtoul(hashText, &end, 16);
+    if (end == hashText || *end != '\0' || (uint32_t)hash != pathHash) return false;
+    *position = pos;
+    return true;
+}
+
+static void releaseSlot() {
+    portENTER_CRITICAL(&listMux);
+    openListings--;
+    portEXIT_CRITICAL(&listMux);
+}
+
+// Open a listing of path; on failure returns null with the HTTP status and a message
+FileListing *fileListOpen(const char *path, bool paged, uint32_t offset, const char *cursor, uint32_t limit,
+                          int *httpStatus, const char **message) {
+    uint64_t position = 0;
+    uint32_t pathHash = hashPath(path);
+    if (cursor && *cursor && !parseCursor(cursor, pathHash, &position)) {
+        *httpStatus = 400;
+        *message = "Invalid cursor";
+        return nullptr;
+    }
+
+    portENTER_CRITICAL(&listMux);
+    bool slot = openListings < FILE_LIST_MAX_OPEN;
+    if (slot) openListings++;
+    portEXIT_CRITICAL(&listMux);
+    if (!slot) {
+        *httpStatus = 503;
+        *message = "Too many listings in progress";
+        return nullptr;
+    }
+
+    FileListing *listing = new (std::nothrow) FileListing();
+    if (!listing) {
+        releaseSlot();
+        *httpStatus = 503;
+        *message = "Out of memory";
+        return nullptr;
+    }
+
+    sdLock();
+    listing->dir = sd.open(path, O_RDONLY);
+    bool ok = listing->dir && listing->dir.isDir();
+    if (ok && position) ok = listing->dir.seekSet(position);
+    if (!ok) listing->dir.close();
+    sdUnlock();
+    if (!ok) {
+        delete listing;
+        releaseSlot();
+        *httpStatus = 400;
+        *message = position ? "Invalid cursor" : "Directory not found";
+        return nullptr;
+    }
+
+    listing->pathHash = pathHash;
+    listing->paged = paged;
+    listing->skip = offset;
+    listing->offset = offset;
+    if (limit < 1) limit = 1;
+    listing->limit = limit > FILE_LIST_MAX_LIMIT ? FILE_LIST_MAX_LIMIT : limit;
+    listing->stage = LIST_HEAD;
+    if (paged) {
+        int n = snprintf(listing->text, sizeof(listing->text), "{\"path\":\"");
+        n = appendEscaped(listing->text, n, sizeof(listing->text), path);
+        snprintf(listing->text + n, sizeof(listing->text) - n, "\",\"offset\":%lu,\"entries\":[",
+                 (unsigned long)offset);
+    } else {
+        strcpy(listing->text, "[");
+    }
+    listing->textLen = strlen(listing->text);
+    return listing;
+}
+
+// Format the next directory entry into text; false when the page or directory is done
+static bool nextEntry(FileListing *l) {
+    FsFile entry;
+    char name[MAX_GIF_PATH_LEN];
+    uint64_t size = 0;
+    bool folder = false;
+
+    sdLock();
+    for (;;) {
+        uint64_t position = l->dir.position();
+        if (!entry.openNext(&l->dir, O_RDONLY)) {
+            sdUnlock();
+            return false;
+        }
+        if (l->skip) {
+            l->skip--;
+            entry.close();
+            continue;
+        }
+        if (l->paged && l->count >= l->limit) {
+            // One entry past the page: there is a next one, starting here
+            l->hasNext = true;
+            l->nextPosition = position;
+            entry.close();
+            sdUnlock();
+            return false;
+        }
+        break;
+    }
+    entry.getName(name, sizeof(name));
+    folder = entry.isDir();
+    if (!folder) size = entry.size();
+    entry.close();
+    sdUnlock();
+
+    size_t n = l->count ? 1 : 0;
+    l->text[0] = ',';
+    n += snprintf(l->text + n, sizeof(l->text) - n, "{\"name\":\"");
+    n = appendEscaped(l->text, n, sizeof(l->text), name);
+    if (folder) n += snprintf(l->text + n, sizeof(l->text) - n, "\",\"type\":\"folder\"}");
+    else n += snprintf(l->text + n, sizeof(l->text) - n, "\",\"type\":\"file\",\"size\":%llu}",
+                       (unsigned long long)size);
+    l->textLen = n;
+    l->count++;
+    return true;
+}
+
+static void finishListing(FileListing *l) {
+    if (!l->paged) {
+        strcpy(l->text, "]");
+    } else if (l->hasNext) {
+        snprintf(l->text, sizeof(l->text), "],\"count\":%lu,\"next\":\"%llx.%08lx\"}", (unsigned long)l->count,
+                 (unsigned long long)l->nextPosition, (unsigned long)l->pathHash);
+    } else {
+        snprintf(l->text, sizeof(l->text), "],\"count\":%lu,\"next\":null}", (unsigned long)l->count);
+    }
+    l->textLen = strlen(l->text);
+}
+
+// Fill buf with the next part of the response; 0 once it is complete
+size_t fileListRead(FileListing *l, uint8_t *buf, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+        if (l->textPos < l->textLen) {
+            size_t n = l->textLen - l->textPos;
+            if (n > maxLen - written) n = maxLen - written;
+            memcpy(buf + written, l->text + l->textPos, n);
+            l->textPos += n;
+            written += n;
+            continue;
+        }
+        l->textPos = l->textLen = 0;
+        if (l->stage == LIST_HEAD) {
+            l->stage = LIST_ENTRIES;
+        } else if (l->stage == LIST_ENTRIES) {
+            if (!nextEntry(l)) {
+                finishListing(l);
+                l->stage = LIST_TAIL;
+            }
+        } else {
+            l->stage = LIST_DONE;
+            break;
+        }
+    }
+    return written;
+}
+
+// Also called when the client goes away mid-response
+void fileListClose(FileListing *l) {
+    if (!l) return;
+    sdLock();
+    l->dir.close();
+    sdUnlock();
+    delete l;
+    releaseSlot();
+}
@@ -0,0 +1,137 @@
+#include "framecache.h"
+#include "pipeline.h"
+#include "playcontrol.h"
+#include "cachearena.h"
+#include "ramplan.h"
+
+// Cache of fully composed frames for short GIFs. Each entry of the arena
+// (cachearena.h) holds one CachedFrame per GIF frame. The whole GIF is
+// reserved when recording starts; the entry stays pinned until the GIF has
+// decoded, then keeps what was recorded or is dropped.
+
+struct CachedFrame {
+    uint16_t delayMs;
+    uint16_t reserved;
+    uint16_t pixels[MATRIX_WIDTH * MATRIX_HEIGHT];
+};
+
+static CacheArenaEntry entries[FRAME_CACHE_MAX_ENTRIES];
+static CacheArena arena;
+static int reservedFrames = 0; // Of the entry being recorded (arena.pinned)
+static int recordedFrames = 0;
+
+static uint32_t hits = 0, misses = 0;
+
+static CachedFrame *entryFrame(int i, int index) {
+    return (CachedFrame *)cacheArenaPayload(arena, i) + index;
+}
+
+static int entryFrameCount(int i) {
+    return cacheArenaPayloadBytes(arena, i) / sizeof(CachedFrame);
+}
+
+bool initFrameCache() {
+    if (!cacheArenaInit(arena, "Frame cache", entries, FRAME_CACHE_MAX_ENTRIES, FRAME_CACHE_PSRAM_BUDGET,
+                        ramPlan.frameCacheBytes)) {
+        return false;
+    }
+    arena.sizeWeighted = true; // Long GIFs take many frames; evict them before short ones
+    Serial.printf("Frame cache: %lu bytes in %s\n", (unsigned long)arena.size, arena.inPsram ? "PSRAM" : "heap");
+    return true;
+}
+
+// Queue every frame of a cached GIF; returns false on a miss
+bool frameCachePlay(const char *path, uint32_t generation) {
+    if (arena.base == nullptr) return false;
+    cacheArenaDropStale(arena);
+
+    int i = cacheArenaFind(arena, path);
+    if (i < 0) {
+        misses++;
+        return false;
+    }
+    hits++;
+    cacheArenaTouch(arena, i);
+
+    int frameCount = entryFrameCount(i);
+    for (int n = 0; n < frameCount && !playbackInterrupted(generation); n++) {
+        const CachedFrame *cached = entryFrame(i, n);
+        Frame *frame = frameRingAcquire();
+        uint32_t started = frameClockUs();
+        memcpy(frame->pixels, cached->pixels, sizeof(frame->pixels));
+        frameMarkDirty(frame, FRAME_ALL_ROWS, 0, MATRIX_WIDTH); // Frame rectangles are not kept
+        frame->delayMs = cached->delayMs;
+        frame->firstInGif = (n == 0);
+        frame->lastInGif = (n == frameCount - 1);
+        frame->generation = generation;
+        frame->decodeUs = frameClockUs() - started;
+        frameRingCommit();
+    }
+    return true;
+}
+
+// Whether a GIF would play from the cache; stale entries count as missing
+bool frameCacheHas(const char *path) {
+    return cacheArenaHas(arena, path);
+}
+
+bool frameCacheEnabled() {
+    return arena.base != nullptr;
+}
+
+// Start caching the GIF about to be decoded, if it is short enough and fits
+bool frameCacheRecordBegin(const char *path, int frameCount) {
+    if (frameCount <= 0 || frameCount > FRAME_CACHE_MAX_FRAMES) return false;
+    int slot = cacheArenaAlloc(arena, path, (uint32_t)frameCount * sizeof(CachedFrame));
+    if (slot < 0) return false;
+    arena.pinned = slot;
+    reservedFrames = frameCount;
+    recordedFrames = 0;
+    return true;
+}
+
+// Append the canvas after one decoded frame
+void frameCacheRecordFrame(const uint16_t *pixels, uint16_t delayMs) {
+    if (arena.pinned < 0) return;
+    if (recordedFrames >= reservedFrames) {
+        frameCacheRecordEnd(false);
+        return;
+    }
+    CachedFrame *cached = entryFrame(arena.pinned, recordedFrames);
+    cached->delayMs = delayMs;
+    cached->reserved = 0;
+    memcpy(cached->pixels, pixels, sizeof(cached->pixels));
+    recordedFrames++;
+}
+
+// Keep the recorded entry if the whole GIF decoded cleanly, otherwise drop it
+void frameCacheRecordEnd(bool complete) {
+    if (arena.pinned < 0) return;
+    if (!complete || recordedFrames == 0) {
+        cacheArenaFree(arena, arena.pinned);
+    } else {
+        cacheArenaTrim(arena, arena.pinned, (uint32_t)recordedFrames * sizeof(CachedFrame));
+    }
+    arena.pinned = -1;
+}
+
+// Called by the web API when a file is replaced, moved or removed
+void frameCacheInvalidate(const char *path) {
+    cacheArenaInvalidate(arena, path);
+}
+
+void frameCacheInvalidateAll() {
+    cacheArenaInvalidateAll(arena);
+}
+
+FrameCacheStats getFrameCacheStats() {
+    FrameCacheStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = arena.evictions;
+    stats.entries = cacheArenaEntryCount(arena);
+    stats.bytesUsed = cacheArenaBytesUsed(arena);
+    stats.capacity = arena.size;
+    stats.inPsram = arena.inPsram;
+    return stats;
+}
@@ -2,31 +2,72 @@
 #include <SdFat.h>
 #include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
 #include <AnimatedGIF.h>
-#include "Globals.h"
+#include "globals.h"
+#include "gif.h"
+#include "pipeline.h"
+#include "framecache.h"
+#include "sdcard.h"
+#include "playcontrol.h"
+#include "sdreader.h"
+#include "filecache.h"
+#include "colorcorrect.h"
+#include "scale.h"
+#include "panelanim.h"
+#include "playlist.h"
 
-int x_offset, y_offset;
 AnimatedGIF gif;
-FsFile f; // Changed from File to FsFile for SdFat compatibility
+
+// Bytes handed out through the playback decoder's allocation hooks. Only the
+// decode task changes it, so other tasks' allocations never show up here.
+static int32_t decoderHeapBytes = 0;
+
+#ifdef TURBO_BUFFER_SIZE
+static void *turboBuffer = NULL; // Allocated once, handed to every GIF
+static uint32_t turboBufferBytes = 0;
+
+// The library knows how much turbo mode needs; it asks through this
+static void *allocTurboBuffer(uint32_t size)
+{
+    turboBuffer = malloc(size); // Fast internal RAM, not PSRAM
+    turboBufferBytes = turboBuffer != NULL ? size : 0;
+    decoderHeapBytes += turboBufferBytes;
+    return turboBuffer;
+}
+#endif
+static GifHeapStats heapStats = {false, 0, 0, 0};
+static uint32_t gifsPlayed = 0;
 
 void InitMatrixGif()
 {
   gif.begin(LITTLE_ENDIAN_PIXELS);
+#ifdef TURBO_BUFFER_SIZE
+  gif.allocTurboBuf(allocTurboBuffer);
+  heapStats.turbo = (turboBuffer != NULL);
+  if (turboBuffer == NULL)
+    Serial.println("Turbo GIF decoding disabled: buffer allocation failed");
+  else
+    Serial.printf("Turbo GIF decoding: %lu byte buffer\n", (unsigned long)turboBufferBytes);
+#endif
 }
 
-// Draw a line of image directly on the LED Matrix
-void GIFDraw(GIFDRAW *pDraw)
+// Composed image of the GIF being decoded; copied into the frame ring after each frame
+static uint16_t gifCanvas[MATRIX_WIDTH * MATRIX_HEIGHT];
+static GifCanvas playbackCanvas = {gifCanvas, &playbackScaler, COLOR_CURVE_DEFAULT, NULL, {0}};
+
+// Draw a line of image into a canvas, scaled onto the panel (see scale.h)
+void drawGifLine(GIFDRAW *pDraw, GifCanvas &canvas)
 {
     uint8_t *s;
-    uint16_t *d, *usPalette, usTemp[320];
     int x, y, iWidth;
 
-    iWidth = pDraw->iWidth;
-    if (iWidth > dma_display->width())
-        iWidth = dma_display->width();
-
-    usPalette = pDraw->pPalette;
-    y = pDraw->iY + pDraw->y; // current line
+    // The palette is colour corrected once per frame, pixels just look it up
+    if (pDraw->y == 0 || canvas.palette == NULL)
+        canvas.palette = colorCorrectPalette(pDraw->pPalette, canvas.curve, canvas.correctedPalette);
+    y = pDraw->iY + pDraw->y; // current line of the GIF canvas
+    if (!scaleRowVisible(*canvas.scaler, y))
+        return;
 
+    iWidth = pDraw->iWidth;
     s = pDraw->pPixels;
     if (pDraw->ucDisposalMethod == 2) // restore to background color
     {
@@ -37,129 +78,177 @@ void GIFDraw(GIFDRAW *pDraw)
         }
         pDraw->ucHasTransparency = 0;
     }
-    // Apply the new pixels to the main image
-    if (pDraw->ucHasTransparency) // if transparency used
-    {
-        uint8_t *pEnd, c, ucTransparent = pDraw->ucTransparent;
-        int x, iCount;
-        pEnd = s + pDraw->iWidth;
-        x = 0;
-        iCount = 0; // count non-transparent pixels
-        while(x < pDraw->iWidth)
-        {
-            c = ucTransparent-1;
-            d = usTemp;
-            while (c != ucTransparent && s < pEnd)
-            {
-                c = *s++;
-                if (c == ucTransparent) // done, stop
-                {
-                    s--; // back up to treat it like transparent
-                }
-                else // opaque
-                {
-                    *d++ = usPalette[c];
-                    iCount++;
-                }
-            } // while looking for opaque pixels
-            if (iCount) // any opaque pixels?
-            {
-                for(int xOffset = 0; xOffset < iCount; xOffset++ ){
-                    dma_display->drawPixel(x + xOffset, y, usTemp[xOffset]); // 565 Color Format
-                }
-                x += iCount;
-                iCount = 0;
-            }
-            // no, look for a run of transparent pixels
-            c = ucTransparent;
-            while (c == ucTransparent && s < pEnd)
-            {
-                c = *s++;
-                if (c == ucTransparent)
-                    iCount++;
-                else
-                    s--;
-            }
-            if (iCount)
-            {
-                x += iCount; // skip these
-                iCount = 0;
-            }
-        }
-    }
-    else // does not have transparency
-    {
-        s = pDraw->pPixels;
-        // Translate the 8-bit pixels through the RGB565 palette (already byte reversed)
-        for (x=0; x<pDraw->iWidth; x++)
-        {
-            dma_display->drawPixel(x, y, usPalette[*s++]); // color 565
-        }
-    }
+    scaleDrawRow(*canvas.scaler, canvas.pixels, s, pDraw->iX, iWidth, y, canvas.palette,
+                 pDraw->ucHasTransparency ? pDraw->ucTransparent : -1);
+} /* drawGifLine() */
+
+// Playback follows curve changes from the next frame on
+void GIFDraw(GIFDRAW *pDraw)
+{
+    if (pDraw->y == 0)
+        playbackCanvas.curve = colorCurve;
+    drawGifLine(pDraw, playbackCanvas);
 } /* GIFDraw() */
 
+// File I/O goes through the read-ahead reader, see sdreader.h
 void * GIFOpenFile(const char *fname, int32_t *pSize)
 {
-    f = FILESYSTEM.open(fname); // Use the global 'f' with SD filesystem
-    if (f)
-    {
-        *pSize = f.size();
-        return (void *)&f; // Return a pointer to the global 'f'
-    }
-    return NULL;
+    return sdReaderOpen(fname, pSize);
 } /* GIFOpenFile() */
 
 void GIFCloseFile(void *pHandle)
 {
-    FsFile *fp = static_cast<FsFile *>(pHandle); // Changed to FsFile*
-    if (fp != NULL)
-        fp->close(); // Close the file pointed to by pHandle
+    if (pHandle != NULL)
+        sdReaderClose(pHandle);
 } /* GIFCloseFile() */
 
 int32_t GIFReadFile(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen)
 {
-    int32_t iBytesRead;
-    iBytesRead = iLen;
-    FsFile *fp = static_cast<FsFile *>(pFile->fHandle); // Cast to FsFile*
-    // Note: If you read a file all the way to the last byte, seek() stops working
+    int32_t iBytesRead = iLen;
     if ((pFile->iSize - pFile->iPos) < iLen)
-        iBytesRead = pFile->iSize - pFile->iPos - 1; // <-- ugly work-around
+        iBytesRead = pFile->iSize - pFile->iPos;
     if (iBytesRead <= 0)
         return 0;
-    iBytesRead = (int32_t)fp->read(pBuf, iBytesRead);
-    pFile->iPos = fp->position();
+    iBytesRead = sdReaderRead(pFile->fHandle, pFile->iPos, pBuf, iBytesRead);
+    pFile->iPos += iBytesRead;
     return iBytesRead;
 } /* GIFReadFile() */
 
+// Reads are positional, so a seek is only bookkeeping
 int32_t GIFSeekFile(GIFFILE *pFile, int32_t iPosition)
 {
-    int i = micros();
-    FsFile *fp = static_cast<FsFile *>(pFile->fHandle); // Cast to FsFile*
-    fp->seek(iPosition);
-    pFile->iPos = (int32_t)fp->position();
-    i = micros() - i;
-//    Serial.printf("Seek time = %d us\n", i);
+    if (iPosition < 0)
+        iPosition = 0;
+    if (iPosition > pFile->iSize)
+        iPosition = pFile->iSize;
+    pFile->iPos = iPosition;
     return pFile->iPos;
 } /* GIFSeekFile() */
 
 unsigned long start_tick = 0;
 
-void ShowGIF(const char *name) // Changed to const char*
+// Open a GIF from its cached file if there is one, otherwise through the SD callbacks
+static int openGif(const char *name, const uint8_t *data, int32_t size)
+{
+    int rc;
+    if (data != NULL)
+        rc = gif.open((uint8_t *)data, size, GIFDraw);
+    else
+        rc = gif.open(name, GIFOpenFile, GIFCloseFile, GIFReadFile, GIFSeekFile, GIFDraw);
+#ifdef TURBO_BUFFER_SIZE
+    if (rc && turboBuffer != NULL)
+        gif.setTurboBuf(turboBuffer); // Same buffer for every GIF, never freed
+#endif
+    return rc;
+} /* openGif() */
+
+static void checkGifHeap(const char *name, int32_t heapDelta);
+
+// Decode a GIF and queue its composed frames for the present task. position
+// is its playlist position, where its frame count is kept, or PLAYLIST_NO_POSITION.
+// Returns false if it failed or a play/next/pause request cut it short.
+bool ShowGIF(const char *name, uint32_t position)
 {
     start_tick = millis();
+    uint32_t generation = beginPlayback();
+
+    // Short GIFs played before come straight from the frame cache, no SD or decode
+    if (frameCachePlay(name, generation))
+        return !playbackInterrupted(generation);
+
+    // Converted GIFs stream pre-rendered frames, nothing to decode
+    bool complete;
+    if (panelAnimPlay(name, generation, &complete))
+        return complete;
+
+    // Small GIFs decode from a RAM copy of the file after their first play
+    const uint8_t *data = NULL;
+    int32_t size = 0;
+    if (!fileCacheGet(name, &data, &size))
+        data = NULL;
+
+    // A GIF is cached once a full play has put its frame count in the index
+    uint16_t knownFrames = 0;
+    if (frameCacheEnabled() && position != PLAYLIST_NO_POSITION)
+        knownFrames = playlistFrameCount(position);
+    bool caching = knownFrames > 0 && frameCacheRecordBegin(name, knownFrames);
 
-    if (gif.open(name, GIFOpenFile, GIFCloseFile, GIFReadFile, GIFSeekFile, GIFDraw))
+    int32_t heldBefore = decoderHeapBytes;
+    if (openGif(name, data, size))
     {
-        x_offset = (dma_display->width() - gif.getCanvasWidth())/2;
-        if (x_offset < 0) x_offset = 0;
-        y_offset = (dma_display->height() - gif.getCanvasHeight())/2;
-        if (y_offset < 0) y_offset = 0;
-        while (gif.playFrame(true, NULL))
+        planScale(playbackScaler, gif.getCanvasWidth(), gif.getCanvasHeight());
+        memset(gifCanvas, 0, sizeof(gifCanvas));
+
+        bool firstFrame = true;
+        int delayMs = 0;
+        uint32_t frames = 0;
+        int rc;
+        do
         {
-            // No timeout, play fully
-        }
+            uint32_t started = frameClockUs();
+            scaleBeginFrame(playbackScaler);
+            rc = gif.playFrame(false, &delayMs); // Decode only, the present task does the timing
+            if (rc < 0)
+                break;
+            if (playbackInterrupted(generation))
+                break; // Preempted at the frame boundary
+            uint32_t decodeUs = frameClockUs() - started;
+            Frame *frame = frameRingAcquire();
+            started = frameClockUs();
+            memcpy(frame->pixels, gifCanvas, sizeof(frame->pixels));
+            int x0, x1;
+            uint32_t rows = scaleFrameDamage(playbackScaler, &x0, &x1);
+            if (firstFrame) // The canvas was cleared, anything may differ from the last GIF
+                frameMarkDirty(frame, FRAME_ALL_ROWS, 0, MATRIX_WIDTH);
+            else
+                frameMarkDirty(frame, rows, x0, x1);
+            frame->delayMs = delayMs;
+            frame->firstInGif = firstFrame;
+            frame->lastInGif = (rc == 0);
+            frame->generation = generation;
+            frame->decodeUs = decodeUs + (frameClockUs() - started);
+            frameRingCommit();
+            if (caching)
+                frameCacheRecordFrame(gifCanvas, delayMs);
+            firstFrame = false;
+            frames++;
+        } while (rc > 0);
         gif.close();
+        checkGifHeap(name, decoderHeapBytes - heldBefore);
+        bool interrupted = playbackInterrupted(generation);
+        if (rc < 0 && !firstFrame && !interrupted)
+            frameRingEndGif(generation); // No frame was the last one
+
+        complete = rc == 0 && !interrupted;
+        if (complete && knownFrames == 0 && frameCacheEnabled() && position != PLAYLIST_NO_POSITION)
+            playlistSetFrameCount(position, frames > 0xFFFF ? 0xFFFF : frames);
+
+        frameCacheRecordEnd(complete);
+        return complete;
     } else {
+        frameCacheRecordEnd(false);
         Serial.printf("Failed to open GIF: %s\n", name);
+        return false;
+    }
+} /* ShowGIF() */
+
+// Called by ShowGIF() after closing the decoder, with the change of what the
+// decoder holds through its hooks. Once the buffers have settled, any change
+// means something allocates per GIF.
+static void checkGifHeap(const char *name, int32_t heapDelta)
+{
+    if (++gifsPlayed <= GIF_HEAP_WARMUP_GIFS)
+        return;
+    heapStats.checked++;
+    if (heapDelta != 0)
+    {
+        heapStats.violations++;
+        heapStats.lastDelta = heapDelta;
+        Serial.printf("ERROR: Decoder heap changed by %ld bytes decoding %s\n", (long)heapDelta, name);
     }
-} /* ShowGIF() */
\ No newline at end of file
+} /* checkGifHeap() */
+
+GifHeapStats getGifHeapStats()
+{
+    return heapStats;
+} /* getGifHeapStats() */
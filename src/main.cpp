@@ -3,6 +3,18 @@
 #include "sdcard.h"  // Include our updated SD handler header
 #include "portal.h"  // Include WiFi portal setup header
 #include "settings.h" // Include Preferences for storing settings
+#include "pipeline.h" // Decode/present tasks and the frame ring
+#include "framecache.h" // Composed frames of short GIFs
+#include "playlist.h" // On-card GIF index and change journal
+#include "shuffle.h" // Constant-memory shuffle order
+#include "playcontrol.h" // Play-now, next and pause requests from the web API
+#include "sdreader.h" // Read-ahead GIF reads and next-file prefetch
+#include "filecache.h" // Small GIFs played from RAM
+#include "panel.h" // DMA budget and double-buffered presentation
+#include "dither.h" // Temporal dithering at low brightness
+#include "panelanim.h" // Pre-rendered GIFs, converted in the background
+#include "ramplan.h" // Internal RAM handed out after the panel
+#include <esp_heap_caps.h>
 #include <AnimatedGIF.h>
 #include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
 #include <SPI.h>
@@ -30,6 +42,194 @@ uint16_t myRED;
 uint16_t myGREEN;
 uint16_t myBLUE;
 
+// Block while playback is paused or stopped
+static void waitWhilePaused() {
+    if (gifPlaybackEnabled) {
+        return;
+    }
+    Serial.println("GIF playback is disabled, pausing...");
+    frameRingWaitEmpty(); // Let the present task finish before drawing on the panel
+    dma_display->clearScreen();
+    displayStatus(dma_display, "GIF Playback", "PAUSED", dma_display->color565(255, 165, 0));
+
+    // Wait until playback is re-enabled
+    while (!gifPlaybackEnabled) {
+        delay(100);
+        yield(); // Allow other tasks to run
+    }
+    Serial.println("GIF playback resumed");
+}
+
+// Play a GIF to the end. A pause cuts it short and it starts over once
+// playback resumes; a play or next request ends it for good. position is its
+// playlist position, or PLAYLIST_NO_POSITION.
+static void playGif(const char *path, uint32_t position) {
+    setCurrentGif(path);
+    while (true) {
+        if (!gifPlaybackEnabled) {
+            waitWhilePaused();
+            if (interruptGif) {
+                return; // Next or play request while paused, skip this one
+            }
+        }
+        bool finished = ShowGIF(path, position);
+        if (finished || gifPlaybackEnabled) {
+            return;
+        }
+    }
+}
+
+// Play GIFs requested through /api/gif/play?path= before the library continues
+static void servicePlayRequests() {
+    char path[PLAY_REQUEST_PATH_LEN];
+    while (takePlayNowRequest(path, sizeof(path))) {
+        Serial.printf("Playing requested GIF: %s\n", path);
+        playGif(path, PLAYLIST_NO_POSITION);
+    }
+}
+
+// Show one library GIF; ordinal is only used for progress. next, if known, is
+// opened and read ahead on the SD I/O task while this one plays.
+static void playLibraryGif(const char *path, uint32_t position, const char *next, unsigned long ordinal,
+                           unsigned long total) {
+    servicePlayRequests();
+    if (next != nullptr && (frameCacheHas(next) || (!panelAnimHas(next) && fileCacheHas(next)))) {
+        next = nullptr; // Plays from RAM, nothing to prefetch
+    }
+    // Converted GIFs are read from their panel animation instead
+    char pathFile[PANEL_ANIM_PATH_LEN], nextFile[PANEL_ANIM_PATH_LEN];
+    sdReaderHint(panelAnimResolve(path, pathFile, sizeof(pathFile)), panelAnimResolve(next, nextFile, sizeof(nextFile)));
+
+    // Display progress on matrix
+    if(SHOW_PROGRESS) {
+        char progress_msg[32];
+        sprintf(progress_msg, "GIF %lu/%lu", ordinal, total);
+        displayStatus(dma_display, progress_msg, dma_display->color565(0, 255, 255));
+        delay(200); // Reduced from 500ms
+    }
+
+    playGif(path, position);
+
+    // Short breather between GIFs, cut short by a pending request
+    for (int i = 0; i < 5 && !interruptGif; i++) {
+        delay(10);
+    }
+
+    yield(); // Allow other tasks to run
+}
+
+// One step of shuffle mode: look up the next position of the permutation
+static void playShuffleStep() {
+    char path[MAX_GIF_PATH_LEN];
+    char nextPath[MAX_GIF_PATH_LEN];
+
+    // Pick up uploads, deletes and renames made through the web API
+    if (playlistSync()) {
+        total_gifs_count = playlistCount();
+    }
+    if (playlistLiveCount() == 0) {
+        Serial.println("Shuffle: no GIFs left. Waiting...");
+        delay(1000);
+        return;
+    }
+
+    uint32_t index = shuffleNext(playlistCount());
+    if (index >= playlistCount() || !playlistIsLive(index)) {
+        return; // Deleted since the cycle started
+    }
+    if (!playlistGetPath(index, path, sizeof(path))) {
+        Serial.printf("Shuffle: no path for GIF #%lu\n", (unsigned long)index + 1);
+        delay(100);
+        return;
+    }
+
+    uint32_t nextIndex;
+    bool hasNext = shufflePeek(&nextIndex) && playlistGetPath(nextIndex, nextPath, sizeof(nextPath));
+    shuffleShowing();
+    playLibraryGif(path, index, hasNext ? nextPath : nullptr, shufflePosition, shuffleDomain);
+}
+
+// Walk the GIF library batch by batch, or in shuffle order; runs forever on the decode task
+void playGifLibrary() {
+    if (total_gifs_count == 0) {
+        Serial.println("No GIFs found. Looping...");
+        delay(1000); // Reduced from 5000ms
+        return;
+    }
+
+    while (true) {
+        if (playbackMode == PLAYBACK_SHUFFLE) {
+            playShuffleStep();
+            continue;
+        }
+
+        // Check if we need to start over from the beginning
+        if (current_batch_start >= total_gifs_count) {
+            Serial.println("Completed all GIFs! Starting over from the beginning...");
+            current_batch_start = 0;
+            batch_processing_complete = false;
+            delay(1000); // Reduced from 2000ms
+        }
+
+        // Load the next batch of GIFs
+        Serial.printf("Loading batch starting from GIF #%lu (Batch size: %d)\n", current_batch_start + 1, BATCH_SIZE);
+        if (!loadNextGifBatch(dma_display)) {
+            Serial.println("Failed to load GIF batch! Retrying...");
+            delay(1000); // Reduced from 2000ms
+            continue; // Retry loading the same batch
+        }
+
+        // Play all GIFs in the current batch
+        Serial.printf("Playing %u GIFs in current batch...\n", (unsigned)gifPathCount());
+        char nextPath[MAX_GIF_PATH_LEN];
+        size_t i = 0;
+        for (; i < gifPathCount() && playbackMode == PLAYBACK_SEQUENTIAL; i++) {
+            // Pick up uploads, deletes and renames made through the web API
+            if (playlistSync()) {
+                total_gifs_count = playlistCount();
+            }
+            if (!playlistIsLive(gifPathIndex(i))) {
+                continue; // Deleted since the batch was loaded
+            }
+
+            // The first GIF of the next batch is looked up in the index
+            const char *next = nullptr;
+            if (i + 1 < gifPathCount()) {
+                next = gifPath(i + 1);
+            } else if (playlistGetPath(current_batch_end < playlistCount() ? current_batch_end : 0,
+                                       nextPath, sizeof(nextPath))) {
+                next = nextPath;
+            }
+            playLibraryGif(gifPath(i), gifPathIndex(i), next, current_batch_start + i + 1, total_gifs_count);
+        }
+
+        if (i < gifPathCount()) {
+            // Switched to shuffle; resume this batch where we left off when switching back
+            if (gifPathIndex(i) != PLAYLIST_NO_POSITION) {
+                current_batch_start = gifPathIndex(i);
+            }
+            clearGifFilePaths();
+            continue;
+        }
+
+        // Move to the next batch
+        current_batch_start = current_batch_end;
+        
+        Serial.printf("Batch complete. Next batch will start from GIF #%lu\n", current_batch_start + 1);
+        
+        // Clear current batch from memory before loading the next one
+        clearGifFilePaths();
+        
+        // Show memory and pipeline status
+        PipelineStats stats = getPipelineStats();
+        Serial.printf("Free heap after batch: %lu bytes, largest block %lu bytes\n",
+                      (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMaxAllocHeap());
+        Serial.printf("Frame ring: depth %lu, peak %lu, underruns %lu, presented %lu\n",
+                      (unsigned long)stats.queueDepth, (unsigned long)stats.peakQueueDepth,
+                      (unsigned long)stats.underruns, (unsigned long)stats.framesPresented);
+    }
+}
+
 /************************* Arduino Sketch Setup and Loop() *******************************/
 void setup() {
     Serial.begin(115200);
@@ -40,6 +240,12 @@ void setup() {
     // Load brightness and GIF playback state from preferences before initializing display
     loadBrightnessFromPreferences();
     loadGifPlaybackFromPreferences();
+    loadPlaybackModeFromPreferences();
+    loadPanelBufferingFromPreferences();
+    loadColorCurveFromPreferences();
+    loadDitherFromPreferences();
+    loadScalingFromPreferences();
+    loadFrameDropPolicyFromPreferences();
 
     HUB75_I2S_CFG::i2s_pins _pins={R1_PIN, G1_PIN, B1_PIN, R2_PIN, G2_PIN, B2_PIN, A_PIN, B_PIN, C_PIN, D_PIN, E_PIN, LAT_PIN, OE_PIN, CLK_PIN};
 
@@ -51,7 +257,18 @@ void setup() {
         _pins
     );
 
+    // Fit the panel buffers into the DMA budget, leaving room for everything
+    // allocated after them and for WiFi
+    ramPlan = planInternalRam(psramFound());
+    size_t dmaFree = heap_caps_get_free_size(MALLOC_CAP_DMA);
+    uint32_t reserved = ramPlan.totalBytes + PANEL_DMA_HEADROOM;
+    uint32_t dmaBudget = dmaFree > reserved ? dmaFree - reserved : 0;
+    if (dmaBudget > PANEL_DMA_BUDGET) dmaBudget = PANEL_DMA_BUDGET;
+    applyPanelDmaPlan(mxconfig, planPanelDma(panelDoubleBufferRequested, dmaBudget));
+
     // Display Setup
+    Serial.printf("Internal RAM: %lu bytes free, %lu planned after the panel, panel budget %lu\n",
+                  (unsigned long)dmaFree, (unsigned long)ramPlan.totalBytes, (unsigned long)dmaBudget);
     dma_display = new MatrixPanel_I2S_DMA(mxconfig);
     dma_display->begin();
     dma_display->setBrightness8(brightness); // Use loaded brightness value
@@ -69,6 +286,7 @@ void setup() {
     dma_display->setTextColor(myWHITE);
     dma_display->setTextSize(1);
     dma_display->print("Booting...");
+    panelPresent();
 
     Serial.printf("Display initialized with brightness: %d\n", brightness);
 
@@ -99,80 +317,24 @@ void setup() {
     batch_processing_complete = false;
     gifsLoaded = true;
     target_state = PLAYING_ART;
+
+    if (!initPlaybackPipeline()) {
+        displayStatus(dma_display, "MEMORY ERROR!", dma_display->color565(255, 0, 0));
+        while(1) {
+            delay(5000); // Stay in error state
+        }
+    }
+    initFrameCache(); // Playback works without it, just slower
+    initFileCache();  // Likewise, small GIFs just keep streaming from the card
+    initSdReader();   // Likewise, reads are just not prefetched without it
+    initPanelAnim();  // Likewise, GIFs are just decoded without it
+    ditherBenchmark(dma_display, DITHER_BENCH_FRAMES); // Before the present task owns the dither tables
+    startPlaybackPipeline(playGifLibrary);
     
     Serial.printf("Setup complete. Found %lu total GIFs. Ready to start batch processing.\n", total_gifs_count);
 }
 
 void loop() {
-    if (total_gifs_count == 0) {
-        Serial.println("No GIFs found. Looping...");
-        delay(1000); // Reduced from 5000ms
-        return;
-    }
-
-    while (true) {
-        // Check if we need to start over from the beginning
-        if (current_batch_start >= total_gifs_count) {
-            Serial.println("Completed all GIFs! Starting over from the beginning...");
-            current_batch_start = 0;
-            batch_processing_complete = false;
-            delay(1000); // Reduced from 2000ms
-        }
-
-        // Load the next batch of GIFs
-        Serial.printf("Loading batch starting from GIF #%lu (Batch size: %d)\n", current_batch_start + 1, BATCH_SIZE);
-        if (!loadNextGifBatch(dma_display)) {
-            Serial.println("Failed to load GIF batch! Retrying...");
-            delay(1000); // Reduced from 2000ms
-            continue; // Retry loading the same batch
-        }
-
-        // Play all GIFs in the current batch
-        Serial.printf("Playing %lu GIFs in current batch...\n", gifFilePaths.size());
-        for (size_t i = 0; i < gifFilePaths.size(); i++) {
-            const char* path = gifFilePaths[i];
-            current_gif = String(path);
-            
-            // Check if GIF playback is enabled
-            if (!gifPlaybackEnabled) {
-                Serial.println("GIF playback is disabled, pausing...");
-                dma_display->clearScreen();
-                displayStatus(dma_display, "GIF Playback", "PAUSED", dma_display->color565(255, 165, 0));
-                
-                // Wait until playback is re-enabled
-                while (!gifPlaybackEnabled) {
-                    delay(100);
-                    yield(); // Allow other tasks to run
-                }
-                Serial.println("GIF playback resumed");
-            }
-            
-            // Display progress on matrix
-            if(SHOW_PROGRESS) {
-                char progress_msg[32];
-                sprintf(progress_msg, "GIF %lu/%lu", current_batch_start + i + 1, total_gifs_count);
-                displayStatus(dma_display, progress_msg, dma_display->color565(0, 255, 255));
-                delay(200); // Reduced from 500ms
-            }
-            
-            ShowGIF(path); // Play GIF using the stored path
-            delay(50); // Reduced from 100ms
-            
-            yield(); // Allow other tasks to run
-        }
-
-        // Move to the next batch
-        current_batch_start += BATCH_SIZE;
-        
-        Serial.printf("Batch complete. Next batch will start from GIF #%lu\n", current_batch_start + 1);
-        
-        // Clear current batch from memory before loading the next one
-        clearGifFilePaths();
-        
-        // Show memory status
-        Serial.printf("Free heap after batch: %lu bytes\n", ESP.getFreeHeap());
-    }
-    
-    // Simple loop that just handles web requests and shows status
-    delay(100);
-}
\ No newline at end of file
+    // Decoding and presentation run in their own tasks, see startPlaybackPipeline()
+    delay(1000);
+}
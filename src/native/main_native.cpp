@@ -0,0 +1,629 @@
+// Host entry point for [env:native]. Plays a GIF corpus through the real
+// playback path (playlist index, batch loading, ShowGIF, frame ring, pacer)
+// against the shims in lib/native_shims, then reports where the time went.
+//
+//   .pio/build/native/program <card dir> [--fast] [--passes N] [--dump frame.ppm]
+//                             [--single-buffer] [--curve name] [--brightness N]
+//                             [--filter nearest|box] [--fit letterbox|fit|fill] [--convert]
+//                             [--psram BYTES]
+//                             [--record golden.txt | --check golden.txt | --bench-blit]
+//                             [--record-timings timings.txt]
+//   .pio/build/native/program --bench-dither
+//   .pio/build/native/program --replay-pacing timings.txt
+//
+// <card dir> stands in for the SD card root, so the GIFs go in <card dir>/gifs.
+// The playlist index and journal are written next to them, as on the card.
+// --fast skips frame delays instead of sleeping through them.
+// --single-buffer presents by drawing into the live buffer, as with double
+// buffering turned off on the device. --curve picks the colour curve, as
+// /api/display/curve does; golden files only match runs with the same curve.
+// --filter and --fit choose how GIFs that are not panel sized are scaled, as
+// /api/display/scaling does.
+// --brightness sets the panel brightness, so low values exercise dithering.
+// --psram sets how much PSRAM the simulated board has (4 MB by default); 0
+// runs as an esp32dev without any, where the RAM caches and the converter
+// stay off (ramplan.h).
+// --convert renders every GIF as a panel animation before playing, as an
+// upload does. The files stay in <card dir>/.panelanim and later runs play
+// from them too, until that directory is removed.
+// --bench-dither times a dither refresh (dithering a frame and writing it to
+// the panel) and exits with status 1 if it is over DITHER_REFRESH_BUDGET_US.
+// --bench-blit plays the corpus once, keeps the rows each frame changed (the
+// spans the present task hands to blitRow565()), then writes them to a spare
+// panel through the old one-drawPixel()-per-pixel path and through
+// blitRow565(), and reports both in pixels per second.
+//
+// --record hashes every composed frame of every GIF and writes the hashes to
+// a golden file, together with a decode-time and heap budget per GIF.
+// --check replays the corpus against such a file: any frame that hashes
+// differently, or a GIF over its budget, makes the run exit with status 1.
+// Both imply --fast and a single pass, and never drop frames. The decode time
+// is the slowest frame's Frame::decodeUs, in CPU time of the decode thread, so
+// neither waiting for a ring slot nor the fast clock's skipped delays count.
+// A golden file also holds the time a fixed workload took where it was
+// recorded; checks on a slower host stretch the time budgets by the ratio.
+// corpus/check.sh runs this against the GIFs and golden file in corpus/.
+//
+// --record-timings writes every frame's delay and decode time, measured as
+// for --record, to a timings file. --replay-pacing plays such a file through
+// the frame pacer on a simulated clock (see pacing_replay.h) and exits with
+// status 1 if a GIF's playback time strays from its authored time.
+
+#include "globals.h"
+#include "gif.h"
+#include "sdcard.h"
+#include "pipeline.h"
+#include "framecache.h"
+#include "sdreader.h"
+#include "sdbus.h"
+#include "filecache.h"
+#include "panel.h"
+#include "colorcorrect.h"
+#include "dither.h"
+#include "scale.h"
+#include "panelanim.h"
+#include "ramplan.h"
+#include "blit.h"
+#include "pacing_replay.h"
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <malloc.h>
+#include <time.h>
+
+// Globals main.cpp provides on the device
+frame_status_t target_state = STARTUP;
+unsigned long lastStateChange = 0;
+bool interruptGif = false;
+bool gifsLoaded = false;
+int brightness = DEFAULT_BRIGHTNESS;
+bool autoPlay = true;
+bool gifPlaying = false;
+bool allowNextGif = true;
+bool queue_populate_requred = false;
+bool gifPlaybackEnabled = true;
+MatrixPanel_I2S_DMA *dma_display = nullptr;
+
+static int passes = 1;
+static const char *dumpPath = nullptr;
+static const char *recordPath = nullptr;
+static const char *checkPath = nullptr;
+static bool convertFirst = false;
+static bool benchBlit = false;
+static const char *timingsPath = nullptr;
+
+// Budgets recorded in a golden file leave room for host timing noise
+#define BUDGET_FRAME_US_FACTOR 2
+#define BUDGET_FRAME_US_MIN_SLACK 200
+#define BUDGET_HEAP_SLACK 1024
+#define CALIBRATION_BYTES (256 * 1024)
+#define CALIBRATION_RUNS 5
+
+// One GIF of a golden file
+struct GoldenGif {
+    uint32_t maxFrameUs;          // Decode time budget per frame
+    uint32_t maxHeapBytes;        // Peak heap growth budget while the GIF plays
+    std::vector<uint64_t> hashes; // FNV-1a of every composed frame
+};
+
+static std::map<std::string, GoldenGif> golden;
+static uint32_t goldenCalibrationUs = 0; // 0 in files from before calibration: budgets as recorded
+static uint32_t calibrationUs = 0;
+
+// The GIF being decoded, filled in by the frame observer on the decode task
+static GoldenGif current;
+static ReplayGif currentTimings;
+static std::vector<ReplayGif> timings;
+static size_t heapBaseline = 0;
+
+// mallinfo2() only reports the main arena; main() keeps every task on it
+static size_t heapInUse() {
+    return mallinfo2().uordblks;
+}
+
+static uint64_t hashFrame(const Frame *frame) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(frame->pixels);
+    for (size_t i = 0; i < sizeof(frame->pixels); i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// CPU time of the calling thread, the frame clock in --record and --check
+static uint32_t threadCpuUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+// Fastest of a few runs of a fixed hashing workload
+static uint32_t calibrate() {
+    static uint8_t buffer[CALIBRATION_BYTES];
+    uint32_t best = UINT32_MAX;
+    volatile uint64_t sink = 0;
+    for (int run = 0; run < CALIBRATION_RUNS; run++) {
+        uint32_t start = threadCpuUs();
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < sizeof(buffer); i++) {
+            hash = (hash ^ (uint8_t)(buffer[i] + i)) * 0x100000001b3ULL;
+        }
+        sink = hash;
+        uint32_t us = threadCpuUs() - start;
+        if (us < best) {
+            best = us;
+        }
+    }
+    (void)sink;
+    return best > 0 ? best : 1;
+}
+
+static void observeFrame(const Frame *frame) {
+    current.hashes.push_back(hashFrame(frame));
+    if (frame->decodeUs > current.maxFrameUs) {
+        current.maxFrameUs = frame->decodeUs;
+    }
+    currentTimings.frames.push_back({frame->delayMs, frame->decodeUs});
+    size_t heap = heapInUse();
+    if (heap > heapBaseline && heap - heapBaseline > current.maxHeapBytes) {
+        current.maxHeapBytes = (uint32_t)(heap - heapBaseline);
+    }
+}
+
+// Golden file: a "# calibration_us N" line, then one line per GIF,
+// "path max_frame_us max_heap_bytes frames hash..."
+static bool loadGolden(const char *path) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        return false;
+    }
+    int c = fgetc(in);
+    if (c == '#') {
+        unsigned long us;
+        if (fscanf(in, " calibration_us %lu", &us) != 1) {
+            fclose(in);
+            return false;
+        }
+        goldenCalibrationUs = us;
+    } else if (c != EOF) {
+        ungetc(c, in);
+    }
+    char name[MAX_GIF_PATH_LEN];
+    unsigned long frameUs, heapBytes, frames;
+    while (fscanf(in, "%255s %lu %lu %lu", name, &frameUs, &heapBytes, &frames) == 4) {
+        GoldenGif &gif = golden[name];
+        gif.maxFrameUs = frameUs;
+        gif.maxHeapBytes = heapBytes;
+        for (unsigned long i = 0; i < frames; i++) {
+            unsigned long long hash;
+            if (fscanf(in, "%llx", &hash) != 1) {
+                fclose(in);
+                return false;
+            }
+            gif.hashes.push_back(hash);
+        }
+    }
+    fclose(in);
+    return true;
+}
+
+static bool saveGolden(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        return false;
+    }
+    fprintf(out, "# calibration_us %lu\n", (unsigned long)calibrationUs);
+    for (const auto &entry : golden) {
+        fprintf(out, "%s %lu %lu %lu", entry.first.c_str(), (unsigned long)entry.second.maxFrameUs,
+                (unsigned long)entry.second.maxHeapBytes, (unsigned long)entry.second.hashes.size());
+        for (uint64_t hash : entry.second.hashes) {
+            fprintf(out, " %016llx", (unsigned long long)hash);
+        }
+        fprintf(out, "\n");
+    }
+    return fclose(out) == 0;
+}
+
+// Compare a played GIF with its golden entry; returns the number of failures
+static int checkGif(const char *path, const GoldenGif &played) {
+    auto it = golden.find(path);
+    if (it == golden.end()) {
+        Serial.printf("FAIL %s: not in the golden file\n", path);
+        return 1;
+    }
+    const GoldenGif &expected = it->second;
+    int failures = 0;
+    if (played.hashes.size() != expected.hashes.size()) {
+        Serial.printf("FAIL %s: %u frames, expected %u\n", path,
+                      (unsigned)played.hashes.size(), (unsigned)expected.hashes.size());
+        failures++;
+    }
+    for (size_t i = 0; i < played.hashes.size() && i < expected.hashes.size(); i++) {
+        if (played.hashes[i] != expected.hashes[i]) {
+            Serial.printf("FAIL %s: frame %u differs\n", path, (unsigned)i);
+            failures++;
+            break;
+        }
+    }
+    // A slower host gets proportionally more time, a faster one keeps the recorded budget
+    uint32_t frameBudgetUs = expected.maxFrameUs;
+    if (goldenCalibrationUs > 0 && calibrationUs > goldenCalibrationUs) {
+        frameBudgetUs = (uint32_t)((uint64_t)frameBudgetUs * calibrationUs / goldenCalibrationUs);
+    }
+    if (played.maxFrameUs > frameBudgetUs) {
+        Serial.printf("FAIL %s: slowest frame %lu us, budget %lu us\n", path,
+                      (unsigned long)played.maxFrameUs, (unsigned long)frameBudgetUs);
+        failures++;
+    }
+    if (played.maxHeapBytes > expected.maxHeapBytes) {
+        Serial.printf("FAIL %s: heap grew %lu bytes, budget %lu bytes\n", path,
+                      (unsigned long)played.maxHeapBytes, (unsigned long)expected.maxHeapBytes);
+        failures++;
+    }
+    return failures;
+}
+
+// --bench-blit: changed rows recorded from the corpus, replayed through both blit paths
+#define BLIT_BENCH_MAX_ROWS 8192
+#define BLIT_BENCH_ROUNDS 20
+
+struct BlitRow {
+    int16_t x, y, count;
+    uint16_t pixels[MATRIX_WIDTH];
+};
+
+static std::vector<BlitRow> blitRows;
+
+static void recordBlitRows(const Frame *frame) {
+    for (int y = 0; y < MATRIX_HEIGHT && blitRows.size() < BLIT_BENCH_MAX_ROWS; y++) {
+        if (!(frame->dirtyRows & (1u << y)) || frame->dirtyX1 <= frame->dirtyX0) {
+            continue;
+        }
+        BlitRow row;
+        row.x = frame->dirtyX0;
+        row.y = y;
+        row.count = frame->dirtyX1 - frame->dirtyX0;
+        memcpy(row.pixels, frame->pixels + y * MATRIX_WIDTH + row.x, row.count * sizeof(uint16_t));
+        blitRows.push_back(row);
+    }
+}
+
+// How GIFDraw() wrote to the panel before blitRow565(): one virtual drawPixel() per pixel
+static void blitRowPerPixel(MatrixPanel_I2S_DMA *display, int x, int y, const uint16_t *span, int count) {
+    for (int i = 0; i < count; i++) {
+        display->drawPixel(x + i, y, span[i]);
+    }
+}
+
+// Pixels per second writing every recorded row BLIT_BENCH_ROUNDS times
+static double timeBlit(MatrixPanel_I2S_DMA *display,
+                       void (*blit)(MatrixPanel_I2S_DMA *, int, int, const uint16_t *, int)) {
+    uint64_t pixels = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < BLIT_BENCH_ROUNDS; round++) {
+        for (const BlitRow &row : blitRows) {
+            blit(display, row.x, row.y, row.pixels, row.count);
+            pixels += row.count;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds > 0 ? pixels / seconds : 0;
+}
+
+// A spare panel, so the present task keeps the real one to itself
+static void benchmarkBlit() {
+    if (blitRows.empty()) {
+        Serial.printf("Blit: no rows recorded\n");
+        return;
+    }
+    uint64_t pixels = 0;
+    for (const BlitRow &row : blitRows) {
+        pixels += row.count;
+    }
+    MatrixPanel_I2S_DMA panel(dma_display->getCfg());
+    panel.begin();
+    timeBlit(&panel, blitRow565); // Warm the caches for both
+    double perPixel = timeBlit(&panel, blitRowPerPixel);
+    double spans = timeBlit(&panel, blitRow565);
+    Serial.printf("Blit: %u rows, %llu pixels, %d rounds\n", (unsigned)blitRows.size(),
+                  (unsigned long long)pixels, BLIT_BENCH_ROUNDS);
+    Serial.printf("Blit: per-pixel drawPixel %.1f Mpixels/s, blitRow565 %.1f Mpixels/s (%.2fx)\n",
+                  perPixel / 1e6, spans / 1e6, perPixel > 0 ? spans / perPixel : 0.0);
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Queue every GIF of the library for the converter and wait until it is through
+static void convertCorpus() {
+    if (!ramPlan.converter) {
+        Serial.printf("Not converting: the converter is off without PSRAM\n");
+        return;
+    }
+    PanelAnimStats before = getPanelAnimStats();
+    uint32_t queued = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (current_batch_start = 0; current_batch_start < total_gifs_count; current_batch_start += BATCH_SIZE) {
+        if (!loadNextGifBatch(dma_display)) {
+            break;
+        }
+        for (size_t i = 0; i < gifPathCount(); i++) {
+            while (!panelAnimQueue(gifPath(i))) {
+                delay(10);
+            }
+            queued++;
+        }
+    }
+    PanelAnimStats anim = getPanelAnimStats();
+    while (anim.converted + anim.failed < before.converted + before.failed + queued) {
+        delay(10);
+        anim = getPanelAnimStats();
+    }
+    Serial.printf("Converted %lu GIFs in %.1f ms, %lu failed\n", (unsigned long)queued, elapsedMs(start),
+                  (unsigned long)(anim.failed - before.failed));
+}
+
+// Decode task body: every GIF of the library, passes times, then report and exit
+static void playCorpus() {
+    if (convertFirst) {
+        convertCorpus();
+    }
+    auto start = std::chrono::steady_clock::now();
+    unsigned long played = 0;
+    int failures = 0;
+
+    for (int pass = 0; pass < passes; pass++) {
+        current_batch_start = 0;
+        while (current_batch_start < total_gifs_count) {
+            if (!loadNextGifBatch(dma_display)) {
+                break;
+            }
+            for (size_t i = 0; i < gifPathCount(); i++) {
+                const char *path = gifPath(i);
+                current = GoldenGif();
+                currentTimings = ReplayGif();
+                currentTimings.path = path;
+                heapBaseline = heapInUse();
+                if (!recordPath && !checkPath && !timingsPath && !benchBlit) {
+                    // Prefetching on another thread would put host scheduling into the frame budgets
+                    const char *next = i + 1 < gifPathCount() ? gifPath(i + 1) : nullptr;
+                    if (next != nullptr && (frameCacheHas(next) || (!panelAnimHas(next) && fileCacheHas(next)))) {
+                        next = nullptr;
+                    }
+                    char pathFile[PANEL_ANIM_PATH_LEN], nextFile[PANEL_ANIM_PATH_LEN];
+                    sdReaderHint(panelAnimResolve(path, pathFile, sizeof(pathFile)),
+                                 panelAnimResolve(next, nextFile, sizeof(nextFile)));
+                }
+
+                auto gifStart = std::chrono::steady_clock::now();
+                bool ok = ShowGIF(path, gifPathIndex(i));
+                double gifMs = elapsedMs(gifStart);
+                Serial.printf("%10.2f ms  %s%s\n", gifMs, path, ok ? "" : "  (failed)");
+                played++;
+
+                if (recordPath) {
+                    GoldenGif &entry = golden[path];
+                    entry = current;
+                    entry.maxFrameUs = current.maxFrameUs * BUDGET_FRAME_US_FACTOR + BUDGET_FRAME_US_MIN_SLACK;
+                    entry.maxHeapBytes = current.maxHeapBytes + BUDGET_HEAP_SLACK;
+                } else if (checkPath) {
+                    failures += checkGif(path, current);
+                }
+                if (timingsPath && !currentTimings.frames.empty()) {
+                    timings.push_back(currentTimings);
+                }
+            }
+            current_batch_start = current_batch_end;
+        }
+    }
+    frameRingWaitEmpty();
+
+    double totalMs = elapsedMs(start);
+    PipelineStats pipeline = getPipelineStats();
+    FrameCacheStats cache = getFrameCacheStats();
+    FileCacheStats files = getFileCacheStats();
+    SdReadStats sdRead = getSdReadStats();
+    const NativePanelStats &panel = dma_display->stats();
+
+    Serial.printf("\n%lu GIFs in %.1f ms, %lu frames presented (%.1f frames/s)\n", played, totalMs,
+                  (unsigned long)pipeline.framesPresented, pipeline.framesPresented * 1000.0 / totalMs);
+    Serial.printf("Frame ring: peak %lu, underruns %lu\n",
+                  (unsigned long)pipeline.peakQueueDepth, (unsigned long)pipeline.underruns);
+    Serial.printf("Frame cache: %lu hits, %lu misses, %lu evictions\n",
+                  (unsigned long)cache.hits, (unsigned long)cache.misses, (unsigned long)cache.evictions);
+    Serial.printf("File cache: %lu hits, %lu misses, %lu oversized, %lu evictions\n",
+                  (unsigned long)files.hits, (unsigned long)files.misses, (unsigned long)files.oversized,
+                  (unsigned long)files.evictions);
+    Serial.printf("SD reads: %lu windows, %llu bytes, avg %lu us, p99 %lu us, %lu read-ahead hits, %lu prefetch hits\n",
+                  (unsigned long)sdRead.reads, (unsigned long long)sdRead.bytes, (unsigned long)sdRead.avgLatencyUs,
+                  (unsigned long)sdRead.p99LatencyUs, (unsigned long)sdRead.readAheadHits,
+                  (unsigned long)sdRead.prefetchHits);
+    for (int c = 0; c < SD_IO_CLASSES; c++) {
+        SdBusClassStats bus = getSdBusStats((sd_io_class_t)c);
+        Serial.printf("SD bus %s: %lu locks, %lu waited (avg %lu us, max %lu us), %lu jobs queued (avg %lu us, max %lu us)\n",
+                      sdIoClassName((sd_io_class_t)c), (unsigned long)bus.locks, (unsigned long)bus.contended,
+                      (unsigned long)bus.avgLockWaitUs, (unsigned long)bus.maxLockWaitUs, (unsigned long)bus.jobs,
+                      (unsigned long)bus.avgQueueWaitUs, (unsigned long)bus.maxQueueWaitUs);
+    }
+    ScaleStats scale = getScaleStats();
+    Serial.printf("Scaling: %s, %s, %lu lines drawn, %lu skipped\n", scaleFilterName(scaleFilter),
+                  scaleFitName(scaleFit), (unsigned long)scale.rowsDrawn, (unsigned long)scale.rowsSkipped);
+    DitherStats dither = getDitherStats();
+    Serial.printf("Dither: %s, %lu lost bits, %lu refreshes, max %lu us per refresh, every %lu us\n",
+                  dither.active ? "active" : "idle", (unsigned long)dither.lostBits,
+                  (unsigned long)dither.refreshes, (unsigned long)dither.maxFrameUs,
+                  (unsigned long)dither.intervalUs);
+    PanelAnimStats anim = getPanelAnimStats();
+    Serial.printf("Panel animations: %lu on the card, %lu plays, %lu frames, %lu fallbacks to decoding\n",
+                  (unsigned long)anim.indexed, (unsigned long)anim.plays, (unsigned long)anim.framesPlayed,
+                  (unsigned long)anim.fallbacks);
+    PanelDrawStats panelDraw = getPanelDrawStats();
+    Serial.printf("Panel rows: %lu written, %lu skipped as unchanged (%.1f%%), %lu full redraws\n",
+                  (unsigned long)panelDraw.rowsWritten, (unsigned long)panelDraw.rowsSkipped,
+                  100.0 * panelDraw.rowsSkipped / (panelDraw.rowsWritten + panelDraw.rowsSkipped + 0.0001),
+                  (unsigned long)panelDraw.fullRedraws);
+    Serial.printf("Panel: %llu drawPixel, %llu drawFastHLine (%llu pixels), %llu flips\n",
+                  (unsigned long long)panel.pixelWrites, (unsigned long long)panel.hlineWrites,
+                  (unsigned long long)panel.hlinePixels, (unsigned long long)panel.flips);
+
+    if (benchBlit) {
+        benchmarkBlit();
+    }
+    if (dumpPath && !dma_display->writePPM(dumpPath)) {
+        Serial.printf("Failed to write %s\n", dumpPath);
+    }
+    if (recordPath) {
+        if (!saveGolden(recordPath)) {
+            Serial.printf("Failed to write %s\n", recordPath);
+            failures++;
+        } else {
+            Serial.printf("Recorded %u GIFs to %s\n", (unsigned)golden.size(), recordPath);
+        }
+    }
+    if (timingsPath) {
+        if (!savePacingTimings(timingsPath, timings)) {
+            Serial.printf("Failed to write %s\n", timingsPath);
+            failures++;
+        } else {
+            Serial.printf("Recorded timings of %u GIFs to %s\n", (unsigned)timings.size(), timingsPath);
+        }
+    }
+    if (checkPath) {
+        Serial.printf("Golden check: %s (%d failures)\n", failures ? "FAILED" : "passed", failures);
+    }
+    fflush(stdout);
+    exit(failures ? 1 : 0);
+}
+
+int main(int argc, char **argv) {
+    mallopt(M_ARENA_MAX, 1); // Tasks are threads; without this each may get its own arena
+    const char *root = nullptr;
+    bool fast = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fast") == 0) {
+            fast = true;
+        } else if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc) {
+            passes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--curve") == 0 && i + 1 < argc) {
+            if (!parseColorCurve(argv[++i], &colorCurve)) {
+                root = nullptr;
+                break;
+            }
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            if (!parseScaleFilter(argv[++i], &scaleFilter)) {
+                root = nullptr;
+                break;
+            }
+        } else if (strcmp(argv[i], "--fit") == 0 && i + 1 < argc) {
+            if (!parseScaleFit(argv[++i], &scaleFit)) {
+                root = nullptr;
+                break;
+            }
+        } else if (strcmp(argv[i], "--brightness") == 0 && i + 1 < argc) {
+            brightness = atoi(argv[++i]);
+            if (brightness < 0 || brightness > 255) {
+                root = nullptr;
+                break;
+            }
+        } else if (strcmp(argv[i], "--convert") == 0) {
+            convertFirst = true;
+        } else if (strcmp(argv[i], "--psram") == 0 && i + 1 < argc) {
+            nativeSetPsram(strtoul(argv[++i], nullptr, 0));
+        } else if (strcmp(argv[i], "--bench-dither") == 0) {
+            HUB75_I2S_CFG mxconfig(PANEL_RES_X, PANEL_RES_Y, PANEL_CHAIN);
+            MatrixPanel_I2S_DMA panel(mxconfig);
+            panel.begin();
+            return ditherBenchmark(&panel, DITHER_BENCH_FRAMES) > DITHER_REFRESH_BUDGET_US ? 1 : 0;
+        } else if (strcmp(argv[i], "--replay-pacing") == 0 && i + 1 < argc) {
+            int failures = replayPacing(argv[++i]);
+            return failures < 0 ? 2 : failures > 0 ? 1 : 0;
+        } else if (strcmp(argv[i], "--record-timings") == 0 && i + 1 < argc) {
+            timingsPath = argv[++i];
+        } else if (strcmp(argv[i], "--bench-blit") == 0) {
+            benchBlit = true;
+        } else if (strcmp(argv[i], "--single-buffer") == 0) {
+            panelDoubleBufferRequested = false;
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            dumpPath = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc) {
+            checkPath = argv[++i];
+        } else if (root == nullptr) {
+            root = argv[i];
+        } else {
+            root = nullptr;
+            break;
+        }
+    }
+    if (root == nullptr || passes < 1 || (recordPath != nullptr) + (checkPath != nullptr) + benchBlit > 1 ||
+        (benchBlit && timingsPath)) {
+        fprintf(stderr, "usage: %s <card dir> [--fast] [--passes N] [--dump frame.ppm] [--single-buffer]"
+                        " [--curve off|cie1931|gamma2.2|gamma2.8] [--brightness N]"
+                        " [--filter nearest|box] [--fit letterbox|fit|fill] [--convert] [--psram BYTES]"
+                        " [--record golden.txt | --check golden.txt | --bench-blit] [--record-timings timings.txt]\n"
+                        "       %s --bench-dither\n"
+                        "       %s --replay-pacing timings.txt\n", argv[0], argv[0], argv[0]);
+        return 2;
+    }
+    if (checkPath && !loadGolden(checkPath)) {
+        fprintf(stderr, "Cannot read golden file %s\n", checkPath);
+        return 2;
+    }
+    if (recordPath || checkPath || timingsPath) {
+        // Deterministic runs: every frame decoded once, none dropped
+        fast = true;
+        passes = 1;
+        setFrameDropPolicy(DROP_NEVER);
+        setFrameObserver(observeFrame);
+        setFrameClock(threadCpuUs);
+        calibrationUs = calibrate();
+        Serial.printf("Calibration: %lu us", (unsigned long)calibrationUs);
+        if (checkPath) {
+            Serial.printf(", %lu us where the golden file was recorded", (unsigned long)goldenCalibrationUs);
+        }
+        Serial.printf("\n");
+    } else if (benchBlit) {
+        // Every frame once, so the rows are those a full playback draws
+        fast = true;
+        passes = 1;
+        setFrameDropPolicy(DROP_NEVER);
+        setFrameObserver(recordBlitRows);
+    }
+
+    nativeSetFastClock(fast);
+    sd.setHostRoot(root);
+
+    ramPlan = planInternalRam(psramFound());
+    HUB75_I2S_CFG mxconfig(PANEL_RES_X, PANEL_RES_Y, PANEL_CHAIN);
+    applyPanelDmaPlan(mxconfig, planPanelDma(panelDoubleBufferRequested, PANEL_DMA_BUDGET));
+    dma_display = new MatrixPanel_I2S_DMA(mxconfig);
+    dma_display->begin();
+    dma_display->setBrightness8(brightness);
+
+    if (!initSD(dma_display)) {
+        return 1;
+    }
+    InitMatrixGif();
+    if (!countTotalGifs(dma_display)) {
+        return 1;
+    }
+    gifsLoaded = true;
+    target_state = PLAYING_ART;
+
+    if (!initPlaybackPipeline()) {
+        return 1;
+    }
+    initFrameCache();
+    initFileCache();
+    initSdReader();
+    initPanelAnim();
+    startPlaybackPipeline(playCorpus);
+
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}
@@ -0,0 +1,128 @@
+#include "pacing_replay.h"
+#include "pipeline.h"
+#include "sdcard.h"
+
+bool loadPacingTimings(const char *path, std::vector<ReplayGif> &gifs) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        return false;
+    }
+    bool ok = true;
+    char name[MAX_GIF_PATH_LEN];
+    int c;
+    while ((c = fgetc(in)) != EOF) {
+        if (c == '#') {
+            while ((c = fgetc(in)) != EOF && c != '\n') {
+            }
+            continue;
+        }
+        if (c == '\n' || c == ' ') {
+            continue;
+        }
+        ungetc(c, in);
+        unsigned long frames;
+        if (fscanf(in, "%255s %lu", name, &frames) != 2) {
+            ok = false;
+            break;
+        }
+        ReplayGif gif;
+        gif.path = name;
+        for (unsigned long i = 0; i < frames && ok; i++) {
+            unsigned int delayMs;
+            unsigned long decodeUs;
+            ok = fscanf(in, " %u:%lu", &delayMs, &decodeUs) == 2;
+            gif.frames.push_back({(uint16_t)delayMs, (uint32_t)decodeUs});
+        }
+        if (!ok || gif.frames.empty()) {
+            ok = false;
+            break;
+        }
+        gifs.push_back(gif);
+    }
+    fclose(in);
+    return ok && !gifs.empty();
+}
+
+bool savePacingTimings(const char *path, const std::vector<ReplayGif> &gifs) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        return false;
+    }
+    fprintf(out, "# path frames delay_ms:decode_us ...\n");
+    for (const ReplayGif &gif : gifs) {
+        fprintf(out, "%s %u", gif.path.c_str(), (unsigned)gif.frames.size());
+        for (const ReplayFrame &frame : gif.frames) {
+            fprintf(out, " %u:%lu", (unsigned)frame.delayMs, (unsigned long)frame.decodeUs);
+        }
+        fprintf(out, "\n");
+    }
+    return fclose(out) == 0;
+}
+
+// Play every GIF back to back, as the playback loop does; one PacingStats per GIF
+static std::vector<PacingStats> simulate(const std::vector<ReplayGif> &gifs, frame_drop_policy_t policy) {
+    FramePacer pacer(policy);
+    std::vector<PacingStats> results;
+    std::vector<unsigned long> released; // When the presenter let go of each frame's slot
+    unsigned long committedUs = 0;       // Decoder: last frame committed
+    unsigned long nowUs = 0;             // Presenter
+
+    for (const ReplayGif &gif : gifs) {
+        for (size_t n = 0; n < gif.frames.size(); n++) {
+            const ReplayFrame &frame = gif.frames[n];
+            bool first = (n == 0);
+            bool last = (n == gif.frames.size() - 1);
+
+            // Decoder: decode, then wait for a slot if FRAME_RING_SIZE frames are queued
+            unsigned long readyUs = committedUs + frame.decodeUs;
+            size_t index = released.size();
+            if (index >= FRAME_RING_SIZE && released[index - FRAME_RING_SIZE] > readyUs) {
+                readyUs = released[index - FRAME_RING_SIZE];
+            }
+            committedUs = readyUs;
+
+            // Presenter: wait for the frame, then show it at its deadline or drop it
+            if (committedUs > nowUs) {
+                nowUs = committedUs;
+            }
+            unsigned long deadlineUs = pacer.beginFrame(first, nowUs);
+            bool drop = pacer.shouldDrop(frame.delayMs, last, nowUs);
+            if (!drop && (long)(deadlineUs - nowUs) > 0) {
+                nowUs = deadlineUs;
+            }
+            if (pacer.endFrame(frame.delayMs, last, drop, nowUs)) {
+                results.push_back(pacer.lastGifStats());
+            }
+            released.push_back(nowUs);
+        }
+    }
+    return results;
+}
+
+int replayPacing(const char *path) {
+    std::vector<ReplayGif> gifs;
+    if (!loadPacingTimings(path, gifs)) {
+        Serial.printf("Cannot read timings file %s\n", path);
+        return -1;
+    }
+    int failures = 0;
+    for (int p = 0; p < FRAME_DROP_POLICY_COUNT; p++) {
+        frame_drop_policy_t policy = (frame_drop_policy_t)p;
+        std::vector<PacingStats> results = simulate(gifs, policy);
+        for (size_t i = 0; i < gifs.size(); i++) {
+            const PacingStats &stats = results[i];
+            long driftMs = (long)stats.actualMs - (long)stats.authoredMs;
+            bool ok = driftMs <= PACING_REPLAY_TOLERANCE_MS && driftMs >= -PACING_REPLAY_TOLERANCE_MS;
+            Serial.printf("%s %-5s %s: %lu frames, %lu dropped, %lu resyncs, %lu/%lu ms\n", ok ? "ok  " : "FAIL",
+                   frameDropPolicyName(policy), gifs[i].path.c_str(), (unsigned long)stats.frames,
+                   (unsigned long)stats.dropped, (unsigned long)stats.resyncs, (unsigned long)stats.actualMs,
+                   (unsigned long)stats.authoredMs);
+            if (!ok) {
+                failures++;
+            }
+        }
+    }
+    Serial.printf("Pacing replay: %s (%d failures, tolerance %d ms)\n", failures ? "FAILED" : "passed", failures,
+           PACING_REPLAY_TOLERANCE_MS);
+    return failures;
+}
@@ -0,0 +1,33 @@
+#ifndef PACING_REPLAY_H
+#define PACING_REPLAY_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Replays recorded decode times through the real FramePacer on a simulated
+// clock: a decoder that needs each frame's recorded time and blocks while
+// FRAME_RING_SIZE frames wait, and a presenter that takes frames the way the
+// present task does. Every GIF's playback time must come within
+// PACING_REPLAY_TOLERANCE_MS of its authored time, under each drop policy.
+//
+// Timings file: one line per GIF, "path frames delay_ms:decode_us ...".
+// Lines starting with # are comments.
+#define PACING_REPLAY_TOLERANCE_MS 10
+
+struct ReplayFrame {
+    uint16_t delayMs;
+    uint32_t decodeUs;
+};
+
+struct ReplayGif {
+    std::string path;
+    std::vector<ReplayFrame> frames;
+};
+
+bool loadPacingTimings(const char *path, std::vector<ReplayGif> &gifs);
+bool savePacingTimings(const char *path, const std::vector<ReplayGif> &gifs);
+// Returns the number of GIFs out of tolerance, or -1 if the file cannot be read
+int replayPacing(const char *path);
+
+#endif
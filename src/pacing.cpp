@@ -0,0 +1,119 @@
+#include "pacing.h"
+#include <string.h>
+
+FramePacer::FramePacer(frame_drop_policy_t policy)
+    : _policy(policy), _scheduled(false), _inGif(false), _deadlineUs(0), _gifStartUs(0),
+      _consecutiveDrops(0), _prevLatenessUs(0), _latenessSumUs(0), _jitterSumUs(0)
+{
+    memset(&_cur, 0, sizeof(_cur));
+    memset(&_last, 0, sizeof(_last));
+}
+
+unsigned long FramePacer::beginFrame(bool firstInGif, unsigned long nowUs)
+{
+    if (firstInGif || !_inGif) {
+        // A GIF starts when the previous one's last frame has had its time,
+        // or right away if we are already past that point
+        if (!_scheduled || (long)(nowUs - _deadlineUs) > 0)
+            _deadlineUs = nowUs;
+        _scheduled = true;
+        _inGif = true;
+        _gifStartUs = _deadlineUs;
+        _consecutiveDrops = 0;
+        _prevLatenessUs = 0;
+        _latenessSumUs = 0;
+        _jitterSumUs = 0;
+        memset(&_cur, 0, sizeof(_cur));
+    } else if ((long)(nowUs - _deadlineUs) > (long)PACING_RESYNC_US) {
+        // Too far behind to catch up sensibly (e.g. a long SD stall)
+        _deadlineUs = nowUs;
+        _cur.resyncs++;
+    }
+    return _deadlineUs;
+}
+
+bool FramePacer::shouldDrop(uint16_t delayMs, bool lastInGif, unsigned long nowUs) const
+{
+    if (policy() == DROP_NEVER || lastInGif)
+        return false;
+    if (_consecutiveDrops >= PACING_MAX_CONSECUTIVE_DROPS)
+        return false;
+    // Late by the whole slot: the next frame is already due
+    return (long)(nowUs - (_deadlineUs + delayMs * 1000UL)) >= 0;
+}
+
+bool FramePacer::endFrame(uint16_t delayMs, bool lastInGif, bool dropped, unsigned long presentUs)
+{
+    _cur.authoredMs += delayMs;
+
+    if (dropped) {
+        _cur.dropped++;
+        _consecutiveDrops++;
+    } else {
+        long late = (long)(presentUs - _deadlineUs);
+        uint32_t latenessUs = late > 0 ? (uint32_t)late : 0;
+        if (_cur.frames > 0)
+            _jitterSumUs += latenessUs > _prevLatenessUs ? latenessUs - _prevLatenessUs : _prevLatenessUs - latenessUs;
+        _prevLatenessUs = latenessUs;
+        _latenessSumUs += latenessUs;
+        if (latenessUs > _cur.maxLatenessUs)
+            _cur.maxLatenessUs = latenessUs;
+        _cur.frames++;
+        _consecutiveDrops = 0;
+    }
+
+    // The next deadline only depends on the authored delays, not on when we got here
+    _deadlineUs += delayMs * 1000UL;
+
+    if (!lastInGif)
+        return false;
+
+    finishGif((long)(presentUs - _deadlineUs) > 0 ? presentUs : _deadlineUs);
+    return true;
+}
+
+bool FramePacer::endGif(unsigned long nowUs)
+{
+    if (!_inGif)
+        return false;
+    // The last frame shown keeps its full slot, as if it had been the GIF's last
+    finishGif((long)(nowUs - _deadlineUs) > 0 ? nowUs : _deadlineUs);
+    return true;
+}
+
+void FramePacer::finishGif(unsigned long endUs)
+{
+    if (_cur.frames > 0)
+        _cur.avgLatenessUs = (uint32_t)(_latenessSumUs / _cur.frames);
+    if (_cur.frames > 1)
+        _cur.jitterUs = (uint32_t)(_jitterSumUs / (_cur.frames - 1));
+    _cur.actualMs = (uint32_t)((endUs - _gifStartUs) / 1000UL);
+    _last = _cur;
+    _inGif = false;
+}
+
+void FramePacer::abortGif()
+{
+    _inGif = false;
+    _scheduled = false;
+}
+
+const char *frameDropPolicyName(frame_drop_policy_t policy)
+{
+    switch (policy) {
+        case DROP_NEVER: return "never";
+        case DROP_LATE_FRAMES: return "late";
+        default: return "unknown";
+    }
+}
+
+bool parseFrameDropPolicy(const char *name, frame_drop_policy_t *policy)
+{
+    for (int i = 0; i < FRAME_DROP_POLICY_COUNT; i++) {
+        if (strcmp(name, frameDropPolicyName((frame_drop_policy_t)i)) == 0) {
+            *policy = (frame_drop_policy_t)i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,182 @@
+#include "panel.h"
+#include "blit.h"
+#include <atomic>
+
+bool panelDoubleBufferRequested = PANEL_DOUBLE_BUFFER_DEFAULT;
+PanelDmaPlan panelDmaPlan = {false, PANEL_COLOR_DEPTH_BITS, 0, 0, 0};
+
+// When the last flip was requested; the old front buffer is only free once
+// the panel has finished the refresh it was in
+static std::atomic<unsigned long> lastFlipUs(0);
+
+// Per DMA buffer, rows that changed since it was last drawn and the columns
+// they changed in; owned by the present task
+struct BufferDamage {
+    uint32_t rows;
+    uint16_t x0, x1;
+};
+static BufferDamage damage[2] = {{0xFFFFFFFFu, 0, MATRIX_WIDTH}, {0xFFFFFFFFu, 0, MATRIX_WIDTH}};
+static int backBuffer = 0;
+static std::atomic<bool> invalidated(false); // Something else was drawn on the panel
+static std::atomic<bool> presentTaskRunning(false); // From then on only the present task flips
+static std::atomic<bool> flipRequested(false);      // By panelPresentStatus(), for the present task
+
+static std::atomic<uint32_t> rowsWritten(0);
+static std::atomic<uint32_t> rowsSkipped(0);
+static std::atomic<uint32_t> lastFrameRowsWritten(0);
+static std::atomic<uint32_t> fullRedraws(0);
+
+// Estimated DMA memory of one buffer: a 16-bit word per column of the chain
+// for each bit plane of each row pair, plus a descriptor per plane and row
+// with the same again for the repeats of the high planes
+uint32_t panelDmaBufferBytes(uint8_t colorDepthBits) {
+    uint32_t rows = MATRIX_HEIGHT / 2;
+    uint32_t frame = (uint32_t)MATRIX_WIDTH * sizeof(uint16_t) * rows * colorDepthBits;
+    uint32_t descriptors = rows * colorDepthBits * 2 * PANEL_DMA_DESC_BYTES;
+    return frame + descriptors;
+}
+
+PanelDmaPlan planPanelDma(bool doubleBuffer, uint32_t budget) {
+    PanelDmaPlan plan;
+    plan.budget = budget;
+    plan.doubleBuffer = false;
+    plan.colorDepthBits = PANEL_COLOR_DEPTH_BITS;
+
+    if (doubleBuffer) {
+        for (uint8_t bits = PANEL_COLOR_DEPTH_BITS; bits >= PANEL_MIN_DOUBLE_BUFFER_DEPTH; bits--) {
+            if (2 * panelDmaBufferBytes(bits) <= budget) {
+                plan.doubleBuffer = true;
+                plan.colorDepthBits = bits;
+                break;
+            }
+        }
+    }
+    if (!plan.doubleBuffer) {
+        // One buffer at the deepest colour that fits, never below one plane
+        while (plan.colorDepthBits > 1 && panelDmaBufferBytes(plan.colorDepthBits) > budget) {
+            plan.colorDepthBits--;
+        }
+    }
+    plan.bufferBytes = panelDmaBufferBytes(plan.colorDepthBits);
+    plan.totalBytes = plan.bufferBytes * (plan.doubleBuffer ? 2 : 1);
+
+    if (doubleBuffer && !plan.doubleBuffer) {
+        Serial.printf("Double buffering needs %lu DMA bytes at %d bits, budget is %lu: using one buffer\n",
+                      (unsigned long)(2 * panelDmaBufferBytes(PANEL_MIN_DOUBLE_BUFFER_DEPTH)),
+                      PANEL_MIN_DOUBLE_BUFFER_DEPTH, (unsigned long)budget);
+    }
+    Serial.printf("Panel DMA: %s buffer, %d bit colour, %lu of %lu bytes\n", plan.doubleBuffer ? "double" : "single",
+                  plan.colorDepthBits, (unsigned long)plan.totalBytes, (unsigned long)budget);
+    return plan;
+}
+
+// Configure the panel before begin(); the plan is what presentation follows
+void applyPanelDmaPlan(HUB75_I2S_CFG &config, const PanelDmaPlan &plan) {
+    config.double_buff = plan.doubleBuffer;
+    config.min_refresh_rate = PANEL_MIN_REFRESH_RATE;
+    config.setPixelColorDepthBits(plan.colorDepthBits);
+    panelDmaPlan = plan;
+}
+
+// Double buffered: whether the last flip has landed, so the buffer drawn into
+// next is no longer the one on the panel
+bool panelBackBufferReady() {
+    return !panelDmaPlan.doubleBuffer || micros() - lastFlipUs.load() >= 1000000UL / PANEL_MIN_REFRESH_RATE;
+}
+
+// Wait for that before drawing a new frame
+void panelWaitForBackBuffer() {
+    while (!panelBackBufferReady()) {
+        vTaskDelay(1);
+    }
+}
+
+// Show what was drawn. Double buffered, the panel switches buffers at the end
+// of its current refresh, so a frame never appears half drawn; otherwise the
+// drawing is already live and there is nothing to do.
+void panelPresent() {
+    if (!panelDmaPlan.doubleBuffer) return;
+    dma_display->flipDMABuffer();
+    lastFlipUs.store(micros());
+    backBuffer ^= 1;
+}
+
+// Present task, once when it starts: every flip after this is its own
+void panelAttachPresentTask() {
+    presentTaskRunning.store(true, std::memory_order_release);
+}
+
+// Any task but the present task: show a status screen drawn outside the frame
+// path. Once the present task runs, it owns the flip and the buffer
+// bookkeeping, so the flip is asked of it and this waits until it is done.
+void panelPresentStatus() {
+    if (!panelDmaPlan.doubleBuffer) return;
+    if (!presentTaskRunning.load(std::memory_order_acquire)) {
+        panelPresent();
+        return;
+    }
+    flipRequested.store(true, std::memory_order_release);
+    while (flipRequested.load(std::memory_order_acquire)) {
+        vTaskDelay(1);
+    }
+}
+
+// Present task, while the ring is empty: do a flip panelPresentStatus() asked for
+void panelServiceFlipRequest() {
+    if (flipRequested.load(std::memory_order_acquire)) {
+        panelPresent();
+        flipRequested.store(false, std::memory_order_release);
+    }
+}
+
+// Present task: a frame taken from the ring changed these rows and columns
+void panelAddDamage(uint32_t rows, int x0, int x1) {
+    for (int b = 0; b < 2; b++) {
+        if (rows == 0) break;
+        if (damage[b].rows == 0) {
+            damage[b].x0 = x0;
+            damage[b].x1 = x1;
+        } else {
+            if (x0 < damage[b].x0) damage[b].x0 = x0;
+            if (x1 > damage[b].x1) damage[b].x1 = x1;
+        }
+        damage[b].rows |= rows;
+    }
+}
+
+// Any task: the panel was drawn on outside panelDrawFrame(), e.g. a status
+// screen, so the next frames are drawn in full
+void panelInvalidate() {
+    invalidated.store(true, std::memory_order_release);
+}
+
+// Present task: bring the buffer being drawn into up to date with a frame
+void panelDrawFrame(const uint16_t *pixels) {
+    if (invalidated.exchange(false, std::memory_order_acq_rel)) {
+        for (int b = 0; b < 2; b++) {
+            damage[b] = {0xFFFFFFFFu, 0, MATRIX_WIDTH};
+        }
+        fullRedraws.fetch_add(1, std::memory_order_relaxed);
+    }
+    BufferDamage &d = damage[backBuffer];
+    uint32_t written = 0;
+    for (int y = 0; y < MATRIX_HEIGHT; y++) {
+        if (d.rows & (1u << y)) {
+            blitRow565(dma_display, d.x0, y, pixels + y * MATRIX_WIDTH + d.x0, d.x1 - d.x0);
+            written++;
+        }
+    }
+    d.rows = 0;
+    rowsWritten.fetch_add(written, std::memory_order_relaxed);
+    rowsSkipped.fetch_add(MATRIX_HEIGHT - written, std::memory_order_relaxed);
+    lastFrameRowsWritten.store(written, std::memory_order_relaxed);
+}
+
+PanelDrawStats getPanelDrawStats() {
+    PanelDrawStats stats;
+    stats.rowsWritten = rowsWritten.load(std::memory_order_relaxed);
+    stats.rowsSkipped = rowsSkipped.load(std::memory_order_relaxed);
+    stats.lastFrameRowsWritten = lastFrameRowsWritten.load(std::memory_order_relaxed);
+    stats.fullRedraws = fullRedraws.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,617 @@
+#include "panelanim.h"
+#include "gif.h"
+#include "sdcard.h"
+#include "pipeline.h"
+#include "playcontrol.h"
+#include "sdreader.h"
+#include "scale.h"
+#include "colorcorrect.h"
+#include "ramplan.h"
+#include <new>
+
+#define PANEL_ANIM_REMOVALS 32 // Invalidated GIFs waiting for their file to be removed
+
+// Everything the converter needs for one GIF; allocated with the first job
+// (PSRAM when there is some, see ramplan.h) and kept, so conversions do not
+// churn the heap
+struct ConvertWork {
+    AnimatedGIF gif;
+    FsFile src;
+    FsFile out;
+    Scaler scaler;
+    GifCanvas canvas;
+    uint16_t pixels[MATRIX_WIDTH * MATRIX_HEIGHT]; // Canvas the GIF decodes onto
+    uint16_t shown[MATRIX_WIDTH * MATRIX_HEIGHT];  // Panel after the frames written so far
+    uint8_t record[sizeof(uint32_t) + PANEL_ANIM_MAX_FRAME_BYTES]; // Size of this payload, then the payload
+    PanelAnimTableEntry table[PANEL_ANIM_MAX_FRAMES];
+};
+
+static ConvertWork *work = nullptr;
+static QueueHandle_t jobQueue = nullptr; // GIF paths; an empty one only wakes the task
+
+// Path hashes of converted GIFs, sorted. Read by the decode task and the web
+// API, changed by the converter and the web API.
+static uint32_t indexHashes[PANEL_ANIM_MAX_FILES];
+static uint32_t indexCount = 0;
+static uint32_t removals[PANEL_ANIM_REMOVALS]; // Files the converter still has to remove
+static uint32_t removalCount = 0;
+static bool purgePending = false;              // Remove every file, the index is already empty
+static portMUX_TYPE indexMux = portMUX_INITIALIZER_UNLOCKED;
+
+static PanelAnimStats stats = {};
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Frame payload and the size of the next one; owned by the decode task
+static uint8_t readBuffer[PANEL_ANIM_MAX_FRAME_BYTES + sizeof(uint32_t)];
+static_assert(sizeof(readBuffer) >= sizeof(PanelAnimHeader) + MAX_GIF_PATH_LEN, "Header and path fit one read");
+
+static uint32_t hashPath(const char *path) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    while (*path) {
+        hash ^= (uint8_t)*path++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void animPath(uint32_t hash, const char *ext, char *buf, size_t len) {
+    snprintf(buf, len, PANEL_ANIM_DIR "/%08lx%s", (unsigned long)hash, ext);
+}
+
+// First index entry >= hash; callers hold indexMux
+static uint32_t indexLowerBound(uint32_t hash) {
+    uint32_t lo = 0, hi = indexCount;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (indexHashes[mid] < hash) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static bool indexHas(uint32_t hash) {
+    portENTER_CRITICAL(&indexMux);
+    uint32_t i = indexLowerBound(hash);
+    bool found = i < indexCount && indexHashes[i] == hash;
+    portEXIT_CRITICAL(&indexMux);
+    return found;
+}
+
+static bool indexAdd(uint32_t hash) {
+    portENTER_CRITICAL(&indexMux);
+    uint32_t i = indexLowerBound(hash);
+    bool added = false;
+    if (i < indexCount && indexHashes[i] == hash) {
+        added = true;
+    } else if (indexCount < PANEL_ANIM_MAX_FILES) {
+        memmove(&indexHashes[i + 1], &indexHashes[i], (indexCount - i) * sizeof(uint32_t));
+        indexHashes[i] = hash;
+        indexCount++;
+        added = true;
+    }
+    portEXIT_CRITICAL(&indexMux);
+    return added;
+}
+
+static void indexRemove(uint32_t hash) {
+    portENTER_CRITICAL(&indexMux);
+    uint32_t i = indexLowerBound(hash);
+    if (i < indexCount && indexHashes[i] == hash) {
+        memmove(&indexHashes[i], &indexHashes[i + 1], (indexCount - i - 1) * sizeof(uint32_t));
+        indexCount--;
+    }
+    portEXIT_CRITICAL(&indexMux);
+}
+
+// Whether the file for hash is about to be removed, so a conversion of it is stale
+static bool removalPending(uint32_t hash) {
+    portENTER_CRITICAL(&indexMux);
+    bool pending = purgePending;
+    for (uint32_t i = 0; i < removalCount && !pending; i++) {
+        pending = removals[i] == hash;
+    }
+    portEXIT_CRITICAL(&indexMux);
+    return pending;
+}
+
+static void wakeConverter() {
+    char empty[MAX_GIF_PATH_LEN] = "";
+    if (jobQueue != nullptr) xQueueSend(jobQueue, empty, 0); // A full queue wakes it anyway
+}
+
+// Index the finished panel animations in PANEL_ANIM_DIR and remove anything
+// else, or remove every file if all is set
+static void sweepDirectory(bool all) {
+    sdLock(SD_IO_BULK);
+    FsFile dir = sd.open(PANEL_ANIM_DIR, O_RDONLY);
+    FsFile entry;
+    char name[64];
+    char path[sizeof(PANEL_ANIM_DIR) + sizeof(name)]; // The terminator of the first makes room for the '/'
+    while (dir && entry.openNext(&dir, O_RDONLY)) {
+        entry.getName(name, sizeof(name));
+        bool isDir = entry.isDirectory();
+        entry.close();
+        if (isDir) continue;
+        char *end;
+        uint32_t hash = strtoul(name, &end, 16);
+        if (!all && end == name + 8 && strcmp(end, ".pna") == 0) {
+            if (!indexAdd(hash)) Serial.printf("Panel animation index full, %s not used\n", name);
+            continue;
+        }
+        snprintf(path, sizeof(path), PANEL_ANIM_DIR "/%s", name);
+        sd.remove(path);
+    }
+    if (dir) dir.close();
+    sdUnlock();
+}
+
+// Remove the files of invalidated GIFs; runs on the converter task
+static void applyRemovals() {
+    uint32_t pending[PANEL_ANIM_REMOVALS];
+    portENTER_CRITICAL(&indexMux);
+    bool purge = purgePending;
+    uint32_t count = removalCount;
+    memcpy(pending, removals, count * sizeof(uint32_t));
+    removalCount = 0;
+    portEXIT_CRITICAL(&indexMux);
+
+    if (purge) {
+        sweepDirectory(true);
+        portENTER_CRITICAL(&indexMux);
+        indexCount = 0; // Conversions that finished while sweeping went too
+        purgePending = false;
+        portEXIT_CRITICAL(&indexMux);
+        Serial.println("Panel animations purged");
+        return;
+    }
+    char path[PANEL_ANIM_PATH_LEN];
+    for (uint32_t i = 0; i < count; i++) {
+        indexRemove(pending[i]); // Again, in case a conversion finished meanwhile
+        animPath(pending[i], ".pna", path, sizeof(path));
+        sdLock(SD_IO_BULK);
+        sd.remove(path);
+        sdUnlock();
+    }
+}
+
+// AnimatedGIF callbacks of the converter; it reads the card directly, the
+// read-ahead reader belongs to playback
+static void *convertOpen(const char *path, int32_t *size) {
+    sdLock(SD_IO_BULK);
+    work->src = sd.open(path, O_RDONLY);
+    sdUnlock();
+    if (!work->src) return NULL;
+    *size = work->src.size();
+    return &work->src;
+}
+
+static void convertClose(void *handle) {
+    sdLock(SD_IO_BULK);
+    static_cast<FsFile *>(handle)->close();
+    sdUnlock();
+}
+
+static int32_t convertRead(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen) {
+    int32_t iBytesRead = iLen;
+    if ((pFile->iSize - pFile->iPos) < iLen)
+        iBytesRead = pFile->iSize - pFile->iPos;
+    if (iBytesRead <= 0)
+        return 0;
+    FsFile *file = static_cast<FsFile *>(pFile->fHandle);
+    sdLock(SD_IO_BULK);
+    if (!file->seekSet(pFile->iPos))
+        iBytesRead = 0;
+    else
+        iBytesRead = file->read(pBuf, iBytesRead);
+    sdUnlock();
+    if (iBytesRead < 0)
+        iBytesRead = 0;
+    pFile->iPos += iBytesRead;
+    return iBytesRead;
+}
+
+static int32_t convertSeek(GIFFILE *pFile, int32_t iPosition) {
+    if (iPosition < 0)
+        iPosition = 0;
+    if (iPosition > pFile->iSize)
+        iPosition = pFile->iSize;
+    pFile->iPos = iPosition;
+    return pFile->iPos;
+}
+
+static void convertDraw(GIFDRAW *pDraw) {
+    drawGifLine(pDraw, work->canvas);
+}
+
+// Diff the decoded canvas against the panel so far into work->record, after
+// the size slot. Returns the payload size.
+static uint32_t encodeFrame(uint16_t delayMs) {
+    uint8_t *start = work->record + sizeof(uint32_t);
+    uint8_t *p = start + sizeof(PanelAnimFrame);
+    PanelAnimFrame frame = {delayMs, 0};
+    for (int y = 0; y < MATRIX_HEIGHT; y++) {
+        const uint16_t *row = &work->pixels[y * MATRIX_WIDTH];
+        uint16_t *shown = &work->shown[y * MATRIX_WIDTH];
+        int first = 0, last = MATRIX_WIDTH;
+        while (first < last && row[first] == shown[first])
+            first++;
+        if (first == last) continue;
+        while (row[last - 1] == shown[last - 1])
+            last--;
+        PanelAnimSpan span = {(uint16_t)y, (uint16_t)first, (uint16_t)(last - first)};
+        memcpy(p, &span, sizeof(span));
+        p += sizeof(span);
+        memcpy(p, &row[first], span.count * sizeof(uint16_t));
+        p += span.count * sizeof(uint16_t);
+        memcpy(&shown[first], &row[first], span.count * sizeof(uint16_t));
+        frame.spanCount++;
+    }
+    memcpy(start, &frame, sizeof(frame));
+    return p - start;
+}
+
+static bool writeOut(const void *data, size_t len) {
+    sdLock(SD_IO_BULK);
+    bool ok = work->out.write(data, len) == len;
+    sdUnlock();
+    return ok;
+}
+
+// Whether hash already has a file rendered with the current settings
+static bool upToDate(uint32_t hash) {
+    if (!indexHas(hash)) return false;
+    char path[PANEL_ANIM_PATH_LEN];
+    animPath(hash, ".pna", path, sizeof(path));
+    PanelAnimHeader hdr;
+    sdLock(SD_IO_BULK);
+    FsFile file = sd.open(path, O_RDONLY);
+    bool ok = file && file.read(&hdr, sizeof(hdr)) == (int)sizeof(hdr);
+    if (file) file.close();
+    sdUnlock();
+    return ok && hdr.magic == PANEL_ANIM_MAGIC && hdr.curve == colorCurve && hdr.filter == scaleFilter &&
+           hdr.fit == scaleFit;
+}
+
+// Render one GIF into PANEL_ANIM_DIR: written to a temporary file, renamed
+// into place once complete
+static bool convertGif(const char *gifPath) {
+    uint32_t hash = hashPath(gifPath);
+    if (upToDate(hash)) return true;
+    char tmpPath[PANEL_ANIM_PATH_LEN], finalPath[PANEL_ANIM_PATH_LEN];
+    animPath(hash, ".tmp", tmpPath, sizeof(tmpPath));
+    animPath(hash, ".pna", finalPath, sizeof(finalPath));
+    size_t pathBytes = strlen(gifPath);
+    if (pathBytes >= MAX_GIF_PATH_LEN) return false;
+
+    work->canvas.curve = colorCurve;
+    work->canvas.palette = NULL;
+    if (!work->gif.open(gifPath, convertOpen, convertClose, convertRead, convertSeek, convertDraw)) {
+        Serial.printf("Panel animation: cannot open %s\n", gifPath);
+        return false;
+    }
+    planScale(work->scaler, work->gif.getCanvasWidth(), work->gif.getCanvasHeight());
+    memset(work->pixels, 0, sizeof(work->pixels));
+    memset(work->shown, 0, sizeof(work->shown));
+
+    PanelAnimHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = PANEL_ANIM_MAGIC;
+    hdr.width = MATRIX_WIDTH;
+    hdr.height = MATRIX_HEIGHT;
+    hdr.pathBytes = pathBytes;
+    hdr.curve = work->canvas.curve;
+    hdr.filter = work->scaler.filter;
+    hdr.fit = work->scaler.fit;
+    hdr.dataOffset = sizeof(hdr) + ((pathBytes + 3) & ~3u);
+
+    uint8_t pathRecord[MAX_GIF_PATH_LEN + 4] = {0};
+    memcpy(pathRecord, gifPath, pathBytes);
+    sdLock(SD_IO_BULK);
+    sd.remove(tmpPath);
+    work->out = sd.open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC);
+    bool ok = work->out && work->out.write(&hdr, sizeof(hdr)) == sizeof(hdr) &&
+              work->out.write(pathRecord, hdr.dataOffset - sizeof(hdr)) == hdr.dataOffset - sizeof(hdr);
+    sdUnlock();
+
+    uint32_t pos = hdr.dataOffset;
+    uint32_t frames = 0;
+    int delayMs = 0;
+    int rc = 0;
+    while (ok) {
+        scaleBeginFrame(work->scaler);
+        rc = work->gif.playFrame(false, &delayMs);
+        if (rc < 0 || frames >= PANEL_ANIM_MAX_FRAMES || removalPending(hash)) {
+            ok = false;
+            break;
+        }
+        uint32_t bytes = encodeFrame(delayMs);
+        if (frames == 0) {
+            hdr.firstFrameBytes = bytes;
+            ok = writeOut(work->record + sizeof(uint32_t), bytes);
+        } else {
+            memcpy(work->record, &bytes, sizeof(bytes)); // Read along with the frame before
+            pos += sizeof(uint32_t);
+            ok = writeOut(work->record, sizeof(uint32_t) + bytes);
+        }
+        work->table[frames].offset = pos;
+        work->table[frames].bytes = bytes;
+        work->table[frames].delayMs = delayMs;
+        pos += bytes;
+        frames++;
+        if (rc == 0) break;
+    }
+    work->gif.close();
+
+    uint32_t end = 0; // No frame after the last
+    ok = ok && frames > 0 && writeOut(&end, sizeof(end));
+    hdr.frameCount = frames;
+    hdr.tableOffset = pos + sizeof(end);
+    ok = ok && writeOut(work->table, frames * sizeof(PanelAnimTableEntry));
+
+    sdLock(SD_IO_BULK);
+    if (ok) ok = work->out.seekSet(0) && work->out.write(&hdr, sizeof(hdr)) == sizeof(hdr) && work->out.sync();
+    if (work->out) work->out.close();
+    // Settings changed meanwhile: what was written is a mix, render it again
+    bool settingsChanged = hdr.curve != colorCurve || hdr.filter != scaleFilter || hdr.fit != scaleFit;
+    ok = ok && !settingsChanged && !removalPending(hash);
+    if (ok) {
+        sd.remove(finalPath);
+        ok = sd.rename(tmpPath, finalPath);
+    }
+    if (!ok) sd.remove(tmpPath);
+    sdUnlock();
+    if (settingsChanged && !removalPending(hash)) panelAnimQueue(gifPath);
+    return ok && indexAdd(hash);
+}
+
+static void convertTask(void *param) {
+    char gifPath[MAX_GIF_PATH_LEN];
+    for (;;) {
+        if (xQueueReceive(jobQueue, gifPath, portMAX_DELAY) != pdTRUE) continue;
+        applyRemovals();
+        if (gifPath[0] == '\0') continue;
+
+        if (work == nullptr) {
+            void *mem = ramPlan.psram ? ps_malloc(sizeof(ConvertWork)) : malloc(sizeof(ConvertWork));
+            if (mem == nullptr) {
+                Serial.printf("Panel animation: no memory for the converter (%u bytes)\n", (unsigned)sizeof(ConvertWork));
+                portENTER_CRITICAL(&statsMux);
+                stats.failed++;
+                portEXIT_CRITICAL(&statsMux);
+                continue;
+            }
+            work = new (mem) ConvertWork;
+            work->gif.begin(LITTLE_ENDIAN_PIXELS);
+            work->canvas.pixels = work->pixels;
+            work->canvas.scaler = &work->scaler;
+        }
+
+        portENTER_CRITICAL(&statsMux);
+        stats.converting = true;
+        stats.jobsStarted++;
+        stats.workBytes = sizeof(ConvertWork);
+        portEXIT_CRITICAL(&statsMux);
+        unsigned long startMs = millis();
+        bool ok = convertGif(gifPath);
+        uint32_t elapsedMs = millis() - startMs;
+        portENTER_CRITICAL(&statsMux);
+        stats.converting = false;
+        if (ok) stats.converted++;
+        else stats.failed++;
+        stats.lastConvertMs = elapsedMs;
+        portEXIT_CRITICAL(&statsMux);
+        Serial.printf("Panel animation %s: %s (%lu ms)\n", ok ? "ready" : "failed", gifPath, (unsigned long)elapsedMs);
+    }
+}
+
+// Load the index of converted GIFs and start the converter; call once the card is up
+bool initPanelAnim() {
+    sdLock(SD_IO_BULK);
+    if (!sd.exists(PANEL_ANIM_DIR)) sd.mkdir(PANEL_ANIM_DIR);
+    sdUnlock();
+    sweepDirectory(false); // Leftovers of conversions cut short by a reset go
+    Serial.printf("Panel animations: %lu converted GIFs%s\n", (unsigned long)indexCount,
+                  ramPlan.converter ? "" : ", converter off: no PSRAM");
+
+    jobQueue = xQueueCreate(PANEL_ANIM_QUEUE_LEN, MAX_GIF_PATH_LEN);
+    if (jobQueue == nullptr) {
+        Serial.println("Panel animation converter disabled: queue allocation failed");
+        return false;
+    }
+    // Idle priority on the decode core: it only runs while the decoder waits for the presenter
+    if (xTaskCreatePinnedToCore(convertTask, "anim_convert", 6144, NULL, tskIDLE_PRIORITY, NULL,
+                                PANEL_ANIM_TASK_CORE) != pdPASS) {
+        Serial.println("Panel animation converter disabled: task creation failed");
+        return false;
+    }
+    return true;
+}
+
+// Converter state, in internal RAM unless there is PSRAM
+uint32_t panelAnimWorkBytes() {
+    return sizeof(ConvertWork);
+}
+
+// Previous frame plus the spans of the payload in readBuffer. Returns the
+// rows and columns [*x0, *x1) they touched, false if the payload is corrupt.
+static bool applyFrame(Frame *frame, const Frame *previous, uint32_t bytes, uint16_t *delayMs,
+                       uint32_t *rows, int *x0, int *x1) {
+    if (previous != NULL)
+        memcpy(frame->pixels, previous->pixels, sizeof(frame->pixels));
+    else
+        memset(frame->pixels, 0, sizeof(frame->pixels));
+
+    PanelAnimFrame header;
+    memcpy(&header, readBuffer, sizeof(header));
+    *delayMs = header.delayMs;
+    *rows = 0;
+    *x0 = MATRIX_WIDTH;
+    *x1 = 0;
+    const uint8_t *p = readBuffer + sizeof(header);
+    const uint8_t *end = readBuffer + bytes;
+    for (uint16_t i = 0; i < header.spanCount; i++) {
+        PanelAnimSpan span;
+        if (end - p < (long)sizeof(span)) return false;
+        memcpy(&span, p, sizeof(span));
+        p += sizeof(span);
+        uint32_t spanBytes = span.count * sizeof(uint16_t);
+        if (span.y >= MATRIX_HEIGHT || span.x0 + span.count > MATRIX_WIDTH || (uint32_t)(end - p) < spanBytes)
+            return false;
+        memcpy(&frame->pixels[span.y * MATRIX_WIDTH + span.x0], p, spanBytes);
+        p += spanBytes;
+        *rows |= 1u << span.y;
+        if (span.x0 < *x0) *x0 = span.x0;
+        if (span.x0 + span.count > *x1) *x1 = span.x0 + span.count;
+    }
+    return true;
+}
+
+// Play gifPath from its panel animation, like ShowGIF() does from the GIF.
+// Returns false, having queued nothing, if there is none usable; otherwise
+// *complete tells whether it played to the end.
+bool panelAnimPlay(const char *gifPath, uint32_t generation, bool *complete) {
+    uint32_t hash = hashPath(gifPath);
+    if (!indexHas(hash)) return false;
+
+    char path[PANEL_ANIM_PATH_LEN];
+    animPath(hash, ".pna", path, sizeof(path));
+    int32_t size = 0;
+    void *file = sdReaderOpen(path, &size);
+    PanelAnimHeader hdr;
+    size_t pathBytes = strlen(gifPath);
+    int32_t headBytes = sizeof(hdr) + pathBytes;
+    bool valid = file != NULL && size >= headBytes && sdReaderRead(file, 0, readBuffer, headBytes) == headBytes;
+    if (valid) {
+        memcpy(&hdr, readBuffer, sizeof(hdr));
+        valid = hdr.magic == PANEL_ANIM_MAGIC && hdr.width == MATRIX_WIDTH && hdr.height == MATRIX_HEIGHT &&
+                hdr.frameCount > 0;
+    }
+    // Not another GIF with the same hash
+    bool mine = valid && hdr.pathBytes == pathBytes && memcmp(readBuffer + sizeof(hdr), gifPath, pathBytes) == 0;
+    bool current = mine && hdr.curve == colorCurve && hdr.filter == scaleFilter && hdr.fit == scaleFit;
+    if (!current) {
+        if (file != NULL) sdReaderClose(file);
+        portENTER_CRITICAL(&statsMux);
+        stats.fallbacks++;
+        portEXIT_CRITICAL(&statsMux);
+        if (!valid)
+            panelAnimInvalidate(gifPath); // Missing or damaged
+        if (!valid || mine)
+            panelAnimQueue(gifPath); // Render it again, with the current settings
+        return false;
+    }
+    bool ok = true;
+
+    // The previous frame stays intact in the ring until the one after this is acquired
+    const Frame *previous = NULL;
+    uint32_t pos = hdr.dataOffset;
+    uint32_t bytes = hdr.firstFrameBytes;
+    uint16_t n = 0;
+    for (; n < hdr.frameCount && !playbackInterrupted(generation); n++) {
+        int32_t len = bytes + sizeof(uint32_t);
+        uint32_t started = frameClockUs();
+        if (bytes < sizeof(PanelAnimFrame) || len > (int32_t)sizeof(readBuffer) ||
+            sdReaderRead(file, pos, readBuffer, len) != len) {
+            ok = false;
+            break;
+        }
+        uint32_t readUs = frameClockUs() - started;
+        Frame *frame = frameRingAcquire();
+        started = frameClockUs();
+        uint16_t delayMs;
+        uint32_t rows;
+        int x0, x1;
+        if (!applyFrame(frame, previous, bytes, &delayMs, &rows, &x0, &x1)) {
+            ok = false;
+            break;
+        }
+        if (previous == NULL) // Cleared, anything may differ from the last GIF
+            frameMarkDirty(frame, FRAME_ALL_ROWS, 0, MATRIX_WIDTH);
+        else
+            frameMarkDirty(frame, rows, x0, x1);
+        frame->delayMs = delayMs;
+        frame->firstInGif = (n == 0);
+        frame->lastInGif = (n == hdr.frameCount - 1);
+        frame->generation = generation;
+        frame->decodeUs = readUs + (frameClockUs() - started);
+        frameRingCommit();
+        previous = frame;
+        pos += len;
+        memcpy(&bytes, readBuffer + bytes, sizeof(bytes));
+    }
+    sdReaderClose(file);
+    if (!ok && n > 0 && !playbackInterrupted(generation))
+        frameRingEndGif(generation); // No frame was the last one
+
+    portENTER_CRITICAL(&statsMux);
+    stats.plays++;
+    stats.framesPlayed += n;
+    portEXIT_CRITICAL(&statsMux);
+    if (!ok) {
+        Serial.printf("Panel animation of %s is damaged, converting it again\n", gifPath);
+        panelAnimInvalidate(gifPath);
+        panelAnimQueue(gifPath);
+    }
+    *complete = ok && n == hdr.frameCount && !playbackInterrupted(generation);
+    return true;
+}
+
+// Whether gifPath has a panel animation; no card access
+bool panelAnimHas(const char *gifPath) {
+    return indexHas(hashPath(gifPath));
+}
+
+// The file playing gifPath actually reads, for sdReaderHint(); gifPath
+// itself if it is not converted. Passes NULL through.
+const char *panelAnimResolve(const char *gifPath, char *buf, size_t len) {
+    if (gifPath == NULL) return NULL;
+    uint32_t hash = hashPath(gifPath);
+    if (!indexHas(hash)) return gifPath;
+    animPath(hash, ".pna", buf, len);
+    return buf;
+}
+
+// Convert gifPath in the background; false if the queue is full or the
+// converter is off. The task still runs without it, to remove stale files.
+bool panelAnimQueue(const char *gifPath) {
+    if (jobQueue == nullptr || !ramPlan.converter || strlen(gifPath) >= MAX_GIF_PATH_LEN) return false;
+    char job[MAX_GIF_PATH_LEN];
+    strlcpy(job, gifPath, sizeof(job));
+    return xQueueSend(jobQueue, job, 0) == pdTRUE;
+}
+
+// The GIF changed or went away: stop playing its panel animation now, the
+// converter removes the file
+void panelAnimInvalidate(const char *gifPath) {
+    uint32_t hash = hashPath(gifPath);
+    indexRemove(hash);
+    portENTER_CRITICAL(&indexMux);
+    if (removalCount < PANEL_ANIM_REMOVALS) {
+        removals[removalCount++] = hash;
+    } else {
+        purgePending = true; // Lost track, start over
+        indexCount = 0;
+    }
+    portEXIT_CRITICAL(&indexMux);
+    wakeConverter();
+}
+
+// Directories were renamed or removed: drop every panel animation
+void panelAnimInvalidateAll() {
+    portENTER_CRITICAL(&indexMux);
+    purgePending = true;
+    indexCount = 0;
+    portEXIT_CRITICAL(&indexMux);
+    wakeConverter();
+}
+
+PanelAnimStats getPanelAnimStats() {
+    portENTER_CRITICAL(&statsMux);
+    PanelAnimStats result = stats;
+    portEXIT_CRITICAL(&statsMux);
+    portENTER_CRITICAL(&indexMux);
+    result.indexed = indexCount;
+    portEXIT_CRITICAL(&indexMux);
+    result.pending = jobQueue != nullptr ? uxQueueMessagesWaiting(jobQueue) : 0;
+    return result;
+}
@@ -0,0 +1,311 @@
+#include "pipeline.h"
+#include "panel.h"
+#include "dither.h"
+#include <atomic>
+
+// Single-producer/single-consumer ring of composed frames.
+// The decode task is the only writer of ringHead, the present task the only
+// writer of ringTail, so no lock is needed: each side publishes its index with
+// release ordering after it is done with the slot.
+static Frame *ring[FRAME_RING_SIZE];
+static std::atomic<uint32_t> ringHead(0);
+static std::atomic<uint32_t> ringTail(0);
+
+static std::atomic<uint32_t> peakQueueDepth(0);
+static std::atomic<uint32_t> underruns(0);
+static std::atomic<uint32_t> framesPresented(0);
+
+// Bumped by frameRingFlush(); frames stamped with an older generation are
+// discarded by the presenter instead of shown
+static std::atomic<uint32_t> ringGeneration(1);
+static std::atomic<uint32_t> flushes(0);
+
+// Preemption latency: the first frame of generation latencyGeneration is timed
+// from latencyRequestUs (0 = nothing to time)
+static std::atomic<uint32_t> latencyGeneration(0);
+static unsigned long latencyRequestUs = 0;
+static std::atomic<uint32_t> lastPreemptUs(0);
+static std::atomic<uint32_t> maxPreemptUs(0);
+
+// Row hashes of the last frame the decoder committed, for frameMarkDirty()
+static uint32_t committedRowHash[MATRIX_HEIGHT];
+
+static void (*decodeLoopFn)() = nullptr;
+static frame_observer_cb frameObserver = nullptr;
+static frame_clock_cb frameClock = nullptr;
+
+// Frame timing, owned by the present task
+static FramePacer pacer;
+static PacingStats lastPacingStats;
+static portMUX_TYPE pacingStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Allocate the frame ring, call once after the display is up
+bool initPlaybackPipeline() {
+    for (int i = 0; i < FRAME_RING_SIZE; i++) {
+        ring[i] = new (std::nothrow) Frame;
+        if (ring[i] == nullptr) {
+            Serial.println("ERROR: Failed to allocate frame ring!");
+            return false;
+        }
+    }
+    Serial.printf("Frame ring: %d x %u bytes\n", FRAME_RING_SIZE, (unsigned)sizeof(Frame));
+    return true;
+}
+
+// Producer: return the next free slot, waiting while the ring is full
+Frame *frameRingAcquire() {
+    uint32_t head = ringHead.load(std::memory_order_relaxed);
+    while (head - ringTail.load(std::memory_order_acquire) >= FRAME_RING_SIZE) {
+        vTaskDelay(1);
+    }
+    Frame *frame = ring[head % FRAME_RING_SIZE];
+    frame->endsGif = false;
+    return frame;
+}
+
+// Producer: work out which rows of a frame about to be committed differ from
+// the frame committed before it. Only candidate rows, the ones the GIF frame's
+// rectangle covered, are hashed; the others cannot have changed. Columns
+// [x0, x1) bound what the rectangle covered.
+void frameMarkDirty(Frame *frame, uint32_t candidateRows, int x0, int x1) {
+    frame->dirtyRows = 0;
+    for (int y = 0; y < MATRIX_HEIGHT; y++) {
+        if (!(candidateRows & (1u << y))) continue;
+        const uint16_t *row = &frame->pixels[y * MATRIX_WIDTH];
+        uint32_t hash = 2166136261u; // FNV-1a over the RGB565 words
+        for (int x = 0; x < MATRIX_WIDTH; x++) {
+            hash ^= row[x];
+            hash *= 16777619u;
+        }
+        if (hash != committedRowHash[y]) {
+            committedRowHash[y] = hash;
+            frame->dirtyRows |= 1u << y;
+        }
+    }
+    frame->dirtyX0 = frame->dirtyRows ? x0 : 0;
+    frame->dirtyX1 = frame->dirtyRows ? x1 : 0;
+}
+
+// Producer: publish the slot returned by frameRingAcquire()
+void frameRingCommit() {
+    Frame *frame = ring[ringHead.load(std::memory_order_relaxed) % FRAME_RING_SIZE];
+    if (frameObserver && !frame->endsGif) {
+        frameObserver(frame);
+    }
+    uint32_t head = ringHead.load(std::memory_order_relaxed) + 1;
+    ringHead.store(head, std::memory_order_release);
+
+    uint32_t depth = head - ringTail.load(std::memory_order_acquire);
+    if (depth > peakQueueDepth.load(std::memory_order_relaxed)) {
+        peakQueueDepth.store(depth, std::memory_order_relaxed);
+    }
+}
+
+// Producer: a GIF failed after some of its frames were committed, so none of
+// them is its last. Queue a marker that ends it, otherwise the presenter waits
+// in the GIF for a frame that never comes and counts an underrun.
+void frameRingEndGif(uint32_t generation) {
+    Frame *frame = frameRingAcquire();
+    frame->endsGif = true;
+    frame->delayMs = 0;
+    frame->firstInGif = false;
+    frame->lastInGif = true;
+    frame->generation = generation;
+    frame->dirtyRows = 0;
+    frame->dirtyX0 = frame->dirtyX1 = 0;
+    frame->decodeUs = 0;
+    frameRingCommit();
+}
+
+// Producer: wait until the presenter has shown every queued frame
+void frameRingWaitEmpty() {
+    while (ringHead.load(std::memory_order_relaxed) != ringTail.load(std::memory_order_acquire)) {
+        vTaskDelay(1);
+    }
+}
+
+uint32_t frameRingGeneration() {
+    return ringGeneration.load(std::memory_order_acquire);
+}
+
+// Any task: drop every queued frame and the one the presenter is waiting on.
+// With timeNextGif, the first frame of the next GIF is timed from requestUs.
+void frameRingFlush(bool timeNextGif, unsigned long requestUs) {
+    uint32_t generation = ringGeneration.fetch_add(1, std::memory_order_acq_rel) + 1;
+    flushes.fetch_add(1, std::memory_order_relaxed);
+    if (timeNextGif) {
+        latencyRequestUs = requestUs;
+        latencyGeneration.store(generation, std::memory_order_release);
+    }
+}
+
+PipelineStats getPipelineStats() {
+    PipelineStats stats;
+    stats.queueDepth = ringHead.load(std::memory_order_acquire) - ringTail.load(std::memory_order_acquire);
+    stats.peakQueueDepth = peakQueueDepth.load(std::memory_order_relaxed);
+    stats.underruns = underruns.load(std::memory_order_relaxed);
+    stats.framesPresented = framesPresented.load(std::memory_order_relaxed);
+    stats.flushes = flushes.load(std::memory_order_relaxed);
+    stats.lastPreemptUs = lastPreemptUs.load(std::memory_order_relaxed);
+    stats.maxPreemptUs = maxPreemptUs.load(std::memory_order_relaxed);
+    return stats;
+}
+
+static void decodeTask(void *param) {
+    for (;;) {
+        decodeLoopFn();
+    }
+}
+
+// Present task: hand a finished GIF's timing to getLastPacingStats() and the log
+static void publishPacingStats() {
+    portENTER_CRITICAL(&pacingStatsMux);
+    lastPacingStats = pacer.lastGifStats();
+    portEXIT_CRITICAL(&pacingStatsMux);
+    const PacingStats &stats = pacer.lastGifStats();
+    Serial.printf("Pacing: %lu frames, %lu dropped, %lu resyncs, lateness avg %lu us max %lu us, jitter %lu us, %lu/%lu ms\n",
+                  (unsigned long)stats.frames, (unsigned long)stats.dropped, (unsigned long)stats.resyncs,
+                  (unsigned long)stats.avgLatenessUs, (unsigned long)stats.maxLatenessUs,
+                  (unsigned long)stats.jitterUs, (unsigned long)stats.actualMs, (unsigned long)stats.authoredMs);
+}
+
+// Consumer: show each frame at its deadline, dropping late ones per the pacer's policy
+static void presentTask(void *param) {
+    bool underrunCounted = false;
+    uint32_t seenGeneration = ringGeneration.load(std::memory_order_acquire);
+    uint32_t damagedTail = ~0u; // Ring index whose damage went to the panel
+    panelAttachPresentTask();
+
+    for (;;) {
+        uint32_t generation = ringGeneration.load(std::memory_order_acquire);
+        if (generation != seenGeneration) {
+            // Flushed: forget the interrupted GIF's schedule so the next one starts right away
+            seenGeneration = generation;
+            pacer.abortGif();
+            underrunCounted = false;
+        }
+
+        uint32_t tail = ringTail.load(std::memory_order_relaxed);
+        if (ringHead.load(std::memory_order_acquire) == tail) {
+            if (pacer.inGif() && !underrunCounted && (long)(micros() - pacer.nextDeadline()) >= 0) {
+                underruns.fetch_add(1, std::memory_order_relaxed);
+                underrunCounted = true;
+            }
+            if (pacer.inGif() && ditherRefreshDue()) {
+                ditherRefresh(dma_display); // Keep dithering a frame held past its deadline
+            }
+            panelServiceFlipRequest(); // A status screen drawn by the decode task
+            vTaskDelay(1);
+            continue;
+        }
+        underrunCounted = false;
+
+        Frame *frame = ring[tail % FRAME_RING_SIZE];
+        if (frame->generation != generation) {
+            if (frame->generation != ringGeneration.load(std::memory_order_acquire)) {
+                if (damagedTail != tail) // Later frames only list their own changes
+                    panelAddDamage(frame->dirtyRows, frame->dirtyX0, frame->dirtyX1);
+                ringTail.store(tail + 1, std::memory_order_release); // Queued before a flush
+            }
+            continue; // Otherwise a flush just happened, pick it up at the top
+        }
+
+        if (frame->endsGif) {
+            bool gifDone = pacer.endGif(micros());
+            ringTail.store(tail + 1, std::memory_order_release);
+            if (gifDone) publishPacingStats();
+            continue;
+        }
+
+        panelWaitForBackBuffer(); // Double buffered only; before a GIF's clock starts
+        unsigned long deadline = pacer.beginFrame(frame->firstInGif, micros());
+        bool drop = pacer.shouldDrop(frame->delayMs, frame->lastInGif, micros());
+        if (damagedTail != tail) {
+            // Dropped frames count too, as later frames only list their own changes
+            panelAddDamage(frame->dirtyRows, frame->dirtyX0, frame->dirtyX1);
+            damagedTail = tail;
+        }
+        if (!drop) {
+            // Dithered frames are redrawn while waiting, so they are drawn at the
+            // deadline; otherwise, double buffered, the frame is drawn ahead into
+            // the back buffer and only the flip waits for the deadline
+            bool dither = ditherActive();
+            if (panelDmaPlan.doubleBuffer && !dither) {
+                panelDrawFrame(frame->pixels);
+            }
+            while ((long)(deadline - micros()) >= 1000 &&
+                   ringGeneration.load(std::memory_order_acquire) == generation) {
+                if (dither && ditherRefreshDue()) {
+                    ditherRefresh(dma_display); // Next thresholds for the frame still on the panel
+                }
+                vTaskDelay(1);
+            }
+            if (ringGeneration.load(std::memory_order_acquire) != generation) {
+                continue; // Flushed while waiting, the frame is discarded above
+            }
+            if (dither) {
+                ditherPresent(dma_display, frame->pixels);
+            } else if (panelDmaPlan.doubleBuffer) {
+                panelPresent();
+            } else {
+                panelDrawFrame(frame->pixels);
+            }
+            framesPresented.fetch_add(1, std::memory_order_relaxed);
+
+            if (frame->firstInGif && latencyGeneration.load(std::memory_order_acquire) == generation) {
+                uint32_t latency = (uint32_t)(micros() - latencyRequestUs);
+                latencyGeneration.store(0, std::memory_order_relaxed);
+                lastPreemptUs.store(latency, std::memory_order_relaxed);
+                if (latency > maxPreemptUs.load(std::memory_order_relaxed)) {
+                    maxPreemptUs.store(latency, std::memory_order_relaxed);
+                }
+                Serial.printf("Preempt latency: %lu us\n", (unsigned long)latency);
+            }
+        }
+        bool gifDone = pacer.endFrame(frame->delayMs, frame->lastInGif, drop, micros());
+
+        ringTail.store(tail + 1, std::memory_order_release);
+
+        if (gifDone) {
+            publishPacingStats();
+        }
+    }
+}
+
+// Any task
+void setFrameDropPolicy(frame_drop_policy_t policy) {
+    pacer.setPolicy(policy);
+}
+
+frame_drop_policy_t getFrameDropPolicy() {
+    return pacer.policy();
+}
+
+// Install before startPlaybackPipeline(); nullptr removes it
+void setFrameObserver(frame_observer_cb observer) {
+    frameObserver = observer;
+}
+
+// Install before startPlaybackPipeline(); nullptr goes back to micros()
+void setFrameClock(frame_clock_cb clock) {
+    frameClock = clock;
+}
+
+// Producer: timestamps for Frame::decodeUs
+uint32_t frameClockUs() {
+    return frameClock ? frameClock() : (uint32_t)micros();
+}
+
+PacingStats getLastPacingStats() {
+    portENTER_CRITICAL(&pacingStatsMux);
+    PacingStats stats = lastPacingStats;
+    portEXIT_CRITICAL(&pacingStatsMux);
+    return stats;
+}
+
+// Start decoding on the core AsyncTCP is not using and presenting on the other
+void startPlaybackPipeline(void (*decodeLoop)()) {
+    decodeLoopFn = decodeLoop;
+    xTaskCreatePinnedToCore(decodeTask, "gif_decode", 8192, NULL, 1, NULL, DECODE_TASK_CORE);
+    xTaskCreatePinnedToCore(presentTask, "gif_present", 4096, NULL, 2, NULL, PRESENT_TASK_CORE);
+}
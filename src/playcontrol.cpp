@@ -0,0 +1,53 @@
+#include "playcontrol.h"
+#include "globals.h"
+#include "pipeline.h"
+
+static char pendingPath[PLAY_REQUEST_PATH_LEN];
+static volatile bool pendingPlay = false;
+static portMUX_TYPE requestMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Play a GIF right away; the library continues after it
+void requestPlayNow(const char *path, unsigned long receivedUs) {
+    portENTER_CRITICAL(&requestMux);
+    strlcpy(pendingPath, path, sizeof(pendingPath));
+    pendingPlay = true;
+    portEXIT_CRITICAL(&requestMux);
+    interruptGif = true;
+    frameRingFlush(true, receivedUs);
+}
+
+// End the current GIF and continue with the next one
+void requestNextGif(unsigned long receivedUs) {
+    interruptGif = true;
+    frameRingFlush(true, receivedUs);
+}
+
+// Take the current GIF off the panel after gifPlaybackEnabled was cleared
+void requestPlaybackStop() {
+    frameRingFlush(false, 0);
+}
+
+// Decode side: a GIF starts. Earlier requests are satisfied by it, so the
+// interrupt flag is cleared; the returned generation identifies its frames.
+uint32_t beginPlayback() {
+    interruptGif = false;
+    return frameRingGeneration();
+}
+
+// Decode side: whether the GIF started in this generation should stop now
+bool playbackInterrupted(uint32_t generation) {
+    return pendingPlay || !gifPlaybackEnabled || frameRingGeneration() != generation;
+}
+
+// Decode side: fetch a pending play request
+bool takePlayNowRequest(char *path, size_t len) {
+    bool taken = false;
+    portENTER_CRITICAL(&requestMux);
+    if (pendingPlay) {
+        strlcpy(path, pendingPath, len);
+        pendingPlay = false;
+        taken = true;
+    }
+    portEXIT_CRITICAL(&requestMux);
+    return taken;
+}
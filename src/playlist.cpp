@@ -0,0 +1,842 @@
+#include "playlist.h"
+#include "globals.h"
+#include "sdcard.h"
+#include <stddef.h>
+#include <strings.h>
+
+// Playlist positions: [0, header.count) are records of the index file and
+// [header.count, header.count + addedCount) are GIFs added through the journal.
+// A removed GIF keeps its position, flagged in deadBits, until the next
+// compaction writes a fresh index without it.
+// All state below is owned by the decode task and guarded by sdLock().
+
+static FsFile indexFile;   // Kept open for the whole session
+static FsFile journalFile; // Append-only change journal
+static IndexHeader header;
+static uint32_t liveCount = 0;
+static uint32_t liveFingerprint = 0;
+static uint8_t *deadBits = nullptr;
+static uint16_t *nameTags = nullptr;   // Low 16 bits of each position's name hash, so
+static bool nameTagsBuilt = false;     // findLive() reads only the names that may match
+static uint32_t addedOffsets[PLAYLIST_MAX_ADDED]; // Journal offset of each added GIF's record
+static uint32_t addedCount = 0;
+
+// Changes reported by the web API, applied by playlistSync() between two GIFs
+#define PENDING_RESCAN 3
+struct PendingChange {
+    uint8_t op;   // journal_op_t or PENDING_RESCAN
+    char *name;   // strdup()'ed file name, freed by playlistSync()
+};
+static QueueHandle_t pendingChanges = nullptr;
+static volatile bool rescanRequested = false;
+
+// Background compaction: a snapshot of the overlay is folded into a new index
+// by compactTask(); playlistSync() swaps it in once it is ready
+static volatile bool compactRunning = false;
+static volatile bool compactReady = false;
+static uint32_t compactRetryAt = PLAYLIST_COMPACT_THRESHOLD;
+static IndexHeader compactHeader;
+static uint32_t compactJournalPos = 0;
+static uint32_t compactAddedCount = 0;
+static uint32_t *compactAdded = nullptr;
+static uint8_t *compactDead = nullptr;
+
+typedef bool (*entry_visitor)(uint32_t pos, const IndexRecord &rec, const char *name, void *ctx);
+
+static bool isGifName(const char *name) {
+    size_t len = strlen(name);
+    return len > 4 && strcasecmp(name + len - 4, ".gif") == 0;
+}
+
+static uint32_t nameHash(const char *name) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// What a GIF adds to the fingerprint: its name and size, so a file replaced
+// under the same name changes it too
+static uint32_t entryHash(const char *name, uint32_t fileSize) {
+    return nameHash(name) ^ (fileSize * 2654435761u);
+}
+
+// "/gifs/cat.gif" -> "cat.gif"; nullptr for anything that is not a GIF directly in GIF_DIR
+static const char *gifNameFromPath(const char *path) {
+    size_t dirLen = strlen(GIF_DIR);
+    if (strncmp(path, GIF_DIR, dirLen) != 0 || path[dirLen] != '/') return nullptr;
+    const char *name = path + dirLen + 1;
+    if (strchr(name, '/') != nullptr || !isGifName(name)) return nullptr;
+    return name;
+}
+
+static bool bitSet(const uint8_t *bits, uint32_t pos) {
+    return bits != nullptr && (bits[pos >> 3] & (1 << (pos & 7)));
+}
+
+static uint32_t positionCount() {
+    return header.count + addedCount;
+}
+
+// GIF_DIR's modification date and time; 0 when the card does not keep one
+static bool readDirStamp(uint32_t *stamp) {
+    FsFile gifRoot = sd.open(GIF_DIR);
+    if (!gifRoot) return false;
+    uint16_t date = 0, time = 0;
+    *stamp = gifRoot.getModifyDateTime(&date, &time) ? ((uint32_t)date << 16) | time : 0;
+    gifRoot.close();
+    return true;
+}
+
+// One pass over GIF_DIR: number of GIFs, the sum of their entry hashes and the
+// directory's time before the walk. No paths are built and nothing is
+// allocated, but it still reads every directory entry.
+static bool scanGifDir(uint32_t *count, uint32_t *fingerprint, uint32_t *stamp) {
+    if (!readDirStamp(stamp)) return false;
+    FsFile gifRoot = sd.open(GIF_DIR);
+    if (!gifRoot) return false;
+
+    FsFile file;
+    char name[MAX_GIF_PATH_LEN];
+    *count = 0;
+    *fingerprint = 0;
+    while (file.openNext(&gifRoot, O_RDONLY)) {
+        if (file.isFile()) {
+            file.getName(name, sizeof(name));
+            if (isGifName(name)) {
+                *fingerprint += entryHash(name, (uint32_t)file.size());
+                (*count)++;
+            }
+        }
+        file.close();
+        yield();
+    }
+    gifRoot.close();
+    return true;
+}
+
+// Write the index to a temp file and rename it into place, so a power cut
+// never leaves a half-written index behind
+static bool buildIndex(uint32_t count, uint32_t fingerprint, uint32_t stamp) {
+    sd.remove(PLAYLIST_INDEX_TMP_PATH);
+    FsFile out = sd.open(PLAYLIST_INDEX_TMP_PATH, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!out) return false;
+
+    IndexHeader hdr;
+    hdr.magic = PLAYLIST_INDEX_MAGIC;
+    hdr.version = PLAYLIST_INDEX_VERSION;
+    hdr.recordSize = sizeof(IndexRecord);
+    hdr.count = 0;
+    hdr.stringsSize = 0;
+    hdr.fingerprint = fingerprint;
+    hdr.dirStamp = stamp;
+    out.write(&hdr, sizeof(hdr));
+
+    // Two passes in the same directory order: records first, then the names,
+    // so the file is written strictly sequentially
+    for (int pass = 0; pass < 2; pass++) {
+        FsFile gifRoot = sd.open(GIF_DIR);
+        if (!gifRoot) {
+            out.close();
+            return false;
+        }
+        FsFile file;
+        char name[MAX_GIF_PATH_LEN];
+        uint32_t n = 0;
+        uint32_t offset = 0;
+        while (n < count && file.openNext(&gifRoot, O_RDONLY)) {
+            if (file.isFile()) {
+                file.getName(name, sizeof(name));
+                if (isGifName(name)) {
+                    uint16_t len = strlen(name);
+                    if (pass == 0) {
+                        IndexRecord rec;
+                        rec.nameOffset = offset;
+                        rec.nameLength = len;
+                        rec.frameCount = 0;
+                        rec.fileSize = (uint32_t)file.size();
+                        out.write(&rec, sizeof(rec));
+                    } else {
+                        out.write(name, len + 1);
+                    }
+                    offset += len + 1;
+                    n++;
+                }
+            }
+            file.close();
+            yield();
+        }
+        gifRoot.close();
+        hdr.count = n;
+        hdr.stringsSize = offset;
+    }
+
+    out.seek(0);
+    out.write(&hdr, sizeof(hdr));
+    bool ok = out.sync();
+    out.close();
+    if (!ok) return false;
+
+    sd.remove(PLAYLIST_INDEX_PATH);
+    return sd.rename(PLAYLIST_INDEX_TMP_PATH, PLAYLIST_INDEX_PATH);
+}
+
+static bool readHeader(FsFile &file, IndexHeader &hdr) {
+    file.seek(0);
+    return file.read(&hdr, sizeof(hdr)) == (int)sizeof(hdr) &&
+           hdr.magic == PLAYLIST_INDEX_MAGIC && hdr.version == PLAYLIST_INDEX_VERSION &&
+           hdr.recordSize == sizeof(IndexRecord) &&
+           file.size() == sizeof(hdr) + (uint64_t)hdr.count * sizeof(IndexRecord) + hdr.stringsSize;
+}
+
+// Visit base entries [start, start + count) of an index together with their
+// names. Records are read 16 at a time and their names with one sequential
+// read, since names are stored in record order. Stops when visit returns false.
+static bool visitIndex(FsFile &file, const IndexHeader &hdr, uint32_t start, uint32_t count,
+                       entry_visitor visit, void *ctx) {
+    if (start >= hdr.count) return true;
+    if (count > hdr.count - start) count = hdr.count - start;
+
+    IndexRecord recs[16];
+    char name[MAX_GIF_PATH_LEN];
+    uint64_t strings = sizeof(hdr) + (uint64_t)hdr.count * sizeof(IndexRecord);
+    uint32_t done = 0;
+
+    while (done < count) {
+        uint32_t n = count - done;
+        if (n > sizeof(recs) / sizeof(recs[0])) n = sizeof(recs) / sizeof(recs[0]);
+
+        sdLock();
+        bool ok = file.seek(sizeof(hdr) + (uint64_t)(start + done) * sizeof(IndexRecord)) &&
+                  file.read(recs, n * sizeof(IndexRecord)) == (int)(n * sizeof(IndexRecord)) &&
+                  file.seek(strings + recs[0].nameOffset);
+        for (uint32_t i = 0; ok && i < n; i++) {
+            ok = recs[i].nameLength < sizeof(name) &&
+                 file.read(name, recs[i].nameLength + 1) == recs[i].nameLength + 1;
+            if (ok) {
+                name[recs[i].nameLength] = '\0';
+                ok = visit(start + done + i, recs[i], name, ctx);
+            }
+        }
+        sdUnlock();
+        if (!ok) return false;
+        done += n;
+    }
+    return true;
+}
+
+// Name and size of a GIF added through the journal, from its journal record
+static bool readJournalName(FsFile &journal, uint32_t offset, char *name, size_t len,
+                            uint32_t *fileSize = nullptr) {
+    JournalRecord rec;
+    if (!journal.seek(offset) || journal.read(&rec, sizeof(rec)) != (int)sizeof(rec)) return false;
+    if (rec.nameLength >= len) return false;
+    if (journal.read(name, rec.nameLength) != rec.nameLength) return false;
+    name[rec.nameLength] = '\0';
+    if (fileSize) *fileSize = rec.fileSize;
+    return true;
+}
+
+// File name of position 'pos'; the caller holds the SD lock
+static bool readName(uint32_t pos, char *name, size_t len) {
+    if (pos >= header.count) return readJournalName(journalFile, addedOffsets[pos - header.count], name, len);
+    IndexRecord rec;
+    bool ok = indexFile.seek(sizeof(header) + (uint64_t)pos * sizeof(IndexRecord)) &&
+              indexFile.read(&rec, sizeof(rec)) == (int)sizeof(rec) &&
+              rec.nameLength < len &&
+              indexFile.seek(sizeof(header) + (uint64_t)header.count * sizeof(IndexRecord) + rec.nameOffset) &&
+              indexFile.read(name, rec.nameLength) == rec.nameLength;
+    if (ok) name[rec.nameLength] = '\0';
+    return ok;
+}
+
+// File size of position 'pos' as the index or journal recorded it; the caller
+// holds the SD lock
+static uint32_t readSize(uint32_t pos) {
+    uint32_t fileSize = 0;
+    if (pos >= header.count) {
+        char name[MAX_GIF_PATH_LEN];
+        readJournalName(journalFile, addedOffsets[pos - header.count], name, sizeof(name), &fileSize);
+        return fileSize;
+    }
+    if (indexFile.seek(sizeof(header) + (uint64_t)pos * sizeof(IndexRecord) + offsetof(IndexRecord, fileSize)) &&
+        indexFile.read(&fileSize, sizeof(fileSize)) == (int)sizeof(fileSize)) {
+        return fileSize;
+    }
+    return 0;
+}
+
+static bool tagVisitor(uint32_t pos, const IndexRecord &rec, const char *name, void *ctx) {
+    nameTags[pos] = (uint16_t)nameHash(name);
+    return true;
+}
+
+// Position of a live GIF by file name, or -1. The tags of the index entries
+// are read with the first lookup after a load; added GIFs are tagged as they
+// are added.
+static int32_t findLive(const char *name) {
+    if (!nameTagsBuilt) {
+        nameTagsBuilt = visitIndex(indexFile, header, 0, header.count, tagVisitor, nullptr);
+    }
+    uint16_t tag = (uint16_t)nameHash(name);
+    char candidate[MAX_GIF_PATH_LEN];
+    for (uint32_t pos = 0; pos < positionCount(); pos++) {
+        if (bitSet(deadBits, pos) || (nameTagsBuilt && nameTags[pos] != tag)) continue;
+        if (readName(pos, candidate, sizeof(candidate)) && strcmp(candidate, name) == 0) return pos;
+    }
+    return -1;
+}
+
+// Frame count field of index record 'index'; the caller holds the SD lock
+static void writeFrameCount(uint32_t index, uint16_t frames) {
+    if (indexFile.seek(sizeof(header) + (uint64_t)index * sizeof(IndexRecord) + offsetof(IndexRecord, frameCount)) &&
+        indexFile.write(&frames, sizeof(frames)) == sizeof(frames)) {
+        indexFile.sync();
+    }
+}
+
+// Size field of index record 'index'; the caller holds the SD lock
+static void writeSize(uint32_t index, uint32_t fileSize) {
+    if (indexFile.seek(sizeof(header) + (uint64_t)index * sizeof(IndexRecord) + offsetof(IndexRecord, fileSize)) &&
+        indexFile.write(&fileSize, sizeof(fileSize)) == sizeof(fileSize)) {
+        indexFile.sync();
+    }
+}
+
+static void applyChange(uint8_t op, const char *name, uint32_t offset, uint32_t fileSize) {
+    if (op == JOURNAL_ADD) {
+        int32_t pos = findLive(name);
+        if (pos >= 0) { // Overwritten in place, already playable; its frame count is stale
+            liveFingerprint += entryHash(name, fileSize) - entryHash(name, readSize(pos));
+            if ((uint32_t)pos < header.count) {
+                writeFrameCount(pos, 0);
+                writeSize(pos, fileSize);
+            } else {
+                addedOffsets[pos - header.count] = offset;
+            }
+            return;
+        }
+        if (addedCount >= PLAYLIST_MAX_ADDED) {
+            rescanRequested = true; // Compaction could not keep up, start over from the directory
+            return;
+        }
+        nameTags[header.count + addedCount] = (uint16_t)nameHash(name);
+        addedOffsets[addedCount++] = offset;
+        liveCount++;
+        liveFingerprint += entryHash(name, fileSize);
+    } else if (op == JOURNAL_REMOVE) {
+        int32_t pos = findLive(name);
+        if (pos < 0) return;
+        liveFingerprint -= entryHash(name, readSize(pos));
+        deadBits[pos >> 3] |= 1 << (pos & 7);
+        liveCount--;
+    }
+}
+
+static uint32_t appendJournal(uint8_t op, const char *name, uint32_t fileSize) {
+    JournalRecord rec;
+    rec.op = op;
+    rec.reserved = 0;
+    rec.nameLength = strlen(name);
+    rec.fileSize = fileSize;
+    uint32_t offset = (uint32_t)journalFile.size();
+    journalFile.seek(offset);
+    journalFile.write(&rec, sizeof(rec));
+    journalFile.write(name, rec.nameLength);
+    journalFile.sync();
+    return offset;
+}
+
+// Apply every complete journal record on top of the freshly opened index
+static bool replayJournal() {
+    JournalRecord rec;
+    char name[MAX_GIF_PATH_LEN];
+    uint32_t offset = 0;
+    // Seek each time: applying a record may read other journal records
+    while (journalFile.seek(offset) && journalFile.read(&rec, sizeof(rec)) == (int)sizeof(rec)) {
+        if (rec.nameLength >= sizeof(name) || journalFile.read(name, rec.nameLength) != rec.nameLength) break;
+        name[rec.nameLength] = '\0';
+        applyChange(rec.op, name, offset, rec.fileSize);
+        offset += sizeof(rec) + rec.nameLength;
+    }
+    if (offset != journalFile.size()) {
+        journalFile.truncate(offset); // Drop a record cut short by a power loss
+    }
+    return true;
+}
+
+// Open index and journal and rebuild the overlay from the journal
+static bool loadIndex() {
+    if (indexFile) indexFile.close();
+    if (journalFile) journalFile.close();
+
+    indexFile = sd.open(PLAYLIST_INDEX_PATH, O_RDWR); // Frame counts are written back in place
+    if (!indexFile || !readHeader(indexFile, header)) {
+        if (indexFile) indexFile.close();
+        return false;
+    }
+    journalFile = sd.open(PLAYLIST_JOURNAL_PATH, O_RDWR | O_CREAT);
+    if (!journalFile) {
+        indexFile.close();
+        return false;
+    }
+
+    free(deadBits);
+    free(nameTags);
+    deadBits = (uint8_t *)calloc((header.count + PLAYLIST_MAX_ADDED + 7) / 8, 1);
+    nameTags = (uint16_t *)malloc(sizeof(uint16_t) * (header.count + PLAYLIST_MAX_ADDED));
+    nameTagsBuilt = false;
+    if (deadBits == nullptr || nameTags == nullptr) {
+        indexFile.close();
+        journalFile.close();
+        return false;
+    }
+    addedCount = 0;
+    liveCount = header.count;
+    liveFingerprint = header.fingerprint;
+    rescanRequested = false;
+    return replayJournal();
+}
+
+static bool rebuildFromDirectory(uint32_t count, uint32_t fingerprint, uint32_t stamp) {
+    if (indexFile) indexFile.close();
+    if (journalFile) journalFile.close();
+    if (!buildIndex(count, fingerprint, stamp)) return false;
+    sd.remove(PLAYLIST_JOURNAL_PATH);
+    compactRetryAt = PLAYLIST_COMPACT_THRESHOLD;
+    return loadIndex();
+}
+
+// Open the index. It is trusted with its journal while GIF_DIR's time matches
+// the header's; otherwise the directory is walked and the index rebuilt if
+// its GIFs differ.
+bool playlistOpen(MatrixPanel_I2S_DMA *dma_display) {
+    uint32_t count, fingerprint, stamp;
+    unsigned long start = millis();
+
+    if (pendingChanges == nullptr) {
+        pendingChanges = xQueueCreate(PLAYLIST_PENDING_MAX, sizeof(PendingChange));
+    }
+
+    sdLock();
+    bool dirFound = readDirStamp(&stamp);
+    bool loaded = dirFound && loadIndex();
+    sdUnlock();
+    if (!dirFound) {
+        Serial.println("Failed to open /gifs directory on SD card!");
+        displayStatus(dma_display, "No /gifs Dir", dma_display->color565(255, 0, 0));
+        return false;
+    }
+    if (loaded && stamp != 0 && header.dirStamp == stamp) {
+        Serial.printf("Playlist index trusted: %lu GIFs, %lu journaled changes (checked in %lu ms)\n",
+                      (unsigned long)liveCount, (unsigned long)addedCount, millis() - start);
+        return true;
+    }
+
+    sdLock();
+    bool scanned = scanGifDir(&count, &fingerprint, &stamp);
+    bool valid = scanned && loaded && liveCount == count && liveFingerprint == fingerprint;
+    if (valid && header.dirStamp != stamp) { // Skip the walk next boot
+        header.dirStamp = stamp;
+        if (indexFile.seek(offsetof(IndexHeader, dirStamp)) &&
+            indexFile.write(&header.dirStamp, sizeof(header.dirStamp)) == sizeof(header.dirStamp)) {
+            indexFile.sync();
+        }
+    }
+    sdUnlock();
+    if (!scanned) {
+        Serial.println("Failed to open /gifs directory on SD card!");
+        displayStatus(dma_display, "No /gifs Dir", dma_display->color565(255, 0, 0));
+        return false;
+    }
+    if (valid) {
+        Serial.printf("Playlist index valid: %lu GIFs, %lu journaled changes (checked in %lu ms)\n",
+                      (unsigned long)count, (unsigned long)addedCount, millis() - start);
+        return true;
+    }
+
+    Serial.printf("Building playlist index for %lu GIFs...\n", (unsigned long)count);
+    target_state = INDEXING;
+    displayStatus(dma_display, "Indexing...", dma_display->color565(255, 255, 255));
+    sdLock();
+    bool built = rebuildFromDirectory(count, fingerprint, stamp);
+    sdUnlock();
+    if (!built) {
+        Serial.println("Failed to write playlist index!");
+        displayStatus(dma_display, "Index Error!", dma_display->color565(255, 0, 0));
+        return false;
+    }
+    Serial.printf("Playlist index built: %lu GIFs in %lu ms\n", (unsigned long)header.count, millis() - start);
+    return true;
+}
+
+// Number of playlist positions, including removed GIFs not yet compacted away
+uint32_t playlistCount() {
+    return indexFile ? positionCount() : 0;
+}
+
+uint32_t playlistLiveCount() {
+    return indexFile ? liveCount : 0;
+}
+
+bool playlistIsLive(uint32_t index) {
+    return index < positionCount() && !bitSet(deadBits, index);
+}
+
+// Full path of position 'index', e.g. "/gifs/cat.gif"
+bool playlistGetPath(uint32_t index, char *path, size_t len) {
+    if (!indexFile || index >= positionCount()) return false;
+
+    int prefix = snprintf(path, len, "%s/", GIF_DIR);
+    if (prefix < 0 || prefix >= (int)len) return false;
+
+    sdLock(SD_IO_PLAYBACK);
+    bool ok = readName(index, path + prefix, len - prefix);
+    sdUnlock();
+    return ok;
+}
+
+// Frames of the GIF at position 'index' as of its last full play; 0 if unknown,
+// including GIFs added since the last compaction
+uint16_t playlistFrameCount(uint32_t index) {
+    if (!indexFile || index >= header.count) return 0;
+    IndexRecord rec;
+    sdLock(SD_IO_PLAYBACK);
+    bool ok = indexFile.seek(sizeof(header) + (uint64_t)index * sizeof(IndexRecord)) &&
+              indexFile.read(&rec, sizeof(rec)) == (int)sizeof(rec);
+    sdUnlock();
+    return ok ? rec.frameCount : 0;
+}
+
+// Remember how many frames the GIF at position 'index' has
+void playlistSetFrameCount(uint32_t index, uint16_t frames) {
+    if (!indexFile || index >= header.count) return;
+    sdLock(SD_IO_PLAYBACK);
+    writeFrameCount(index, frames);
+    sdUnlock();
+}
+
+struct RangeCtx {
+    playlist_path_cb onPath;
+    char *path;
+    int prefix;
+    uint32_t delivered;
+};
+
+static bool rangeVisitor(uint32_t pos, const IndexRecord &rec, const char *name, void *ctx) {
+    RangeCtx *range = (RangeCtx *)ctx;
+    if (bitSet(deadBits, pos)) return true;
+    if (range->prefix + rec.nameLength + 1 > MAX_GIF_PATH_LEN) return true;
+    memcpy(range->path + range->prefix, name, rec.nameLength + 1);
+    range->onPath(pos, range->path);
+    range->delivered++;
+    return true;
+}
+
+// Hand the live entries among positions [start, start + count) to onPath.
+// Index entries take one read for the records and one sequential read for the
+// names. Returns the number of entries delivered.
+uint32_t playlistReadRange(uint32_t start, uint32_t count, playlist_path_cb onPath) {
+    if (!indexFile || start >= positionCount()) return 0;
+    if (count > positionCount() - start) count = positionCount() - start;
+
+    char path[MAX_GIF_PATH_LEN];
+    RangeCtx range = { onPath, path, snprintf(path, sizeof(path), "%s/", GIF_DIR), 0 };
+    visitIndex(indexFile, header, start, count, rangeVisitor, &range);
+
+    for (uint32_t pos = max(start, header.count); pos < start + count; pos++) {
+        if (bitSet(deadBits, pos)) continue;
+        sdLock(SD_IO_PLAYBACK);
+        bool ok = readJournalName(journalFile, addedOffsets[pos - header.count], path + range.prefix,
+                                  sizeof(path) - range.prefix);
+        sdUnlock();
+        if (ok) {
+            onPath(pos, path);
+            range.delivered++;
+        }
+    }
+    return range.delivered;
+}
+
+struct CompactCtx {
+    FsFile *out;
+    int pass;               // 0 writes records, 1 writes names
+    uint32_t offset;        // Next name offset in the new string table
+    uint32_t count;
+    uint32_t fingerprint;
+};
+
+static bool compactWrite(CompactCtx *compact, const char *name, uint16_t len, uint16_t frameCount,
+                         uint32_t fileSize) {
+    if (compact->pass == 0) {
+        IndexRecord rec;
+        rec.nameOffset = compact->offset;
+        rec.nameLength = len;
+        rec.frameCount = frameCount;
+        rec.fileSize = fileSize;
+        if (compact->out->write(&rec, sizeof(rec)) != sizeof(rec)) return false;
+    } else {
+        if (compact->out->write(name, len + 1) != (size_t)len + 1) return false;
+        compact->fingerprint += entryHash(name, fileSize);
+    }
+    compact->offset += len + 1;
+    compact->count++;
+    return true;
+}
+
+static bool compactVisitor(uint32_t pos, const IndexRecord &rec, const char *name, void *ctx) {
+    if (bitSet(compactDead, pos)) return true;
+    return compactWrite((CompactCtx *)ctx, name, rec.nameLength, rec.frameCount, rec.fileSize);
+}
+
+// Fold the snapshot taken by startCompaction() into PLAYLIST_INDEX_TMP_PATH.
+// Runs at idle priority and only holds the SD lock for one block at a time,
+// so playback reads keep flowing.
+static void compactTask(void *param) {
+    sdLock(SD_IO_BULK);
+    FsFile src = sd.open(PLAYLIST_INDEX_PATH, O_RDONLY);
+    FsFile journal = sd.open(PLAYLIST_JOURNAL_PATH, O_RDONLY);
+    sd.remove(PLAYLIST_INDEX_TMP_PATH);
+    FsFile out = sd.open(PLAYLIST_INDEX_TMP_PATH, O_WRONLY | O_CREAT | O_TRUNC);
+    IndexHeader hdr = compactHeader;
+    hdr.count = 0;
+    hdr.stringsSize = 0;
+    hdr.fingerprint = 0;
+    bool ok = src && journal && out && out.write(&hdr, sizeof(hdr)) == sizeof(hdr);
+    sdUnlock();
+
+    CompactCtx compact;
+    compact.out = &out;
+    for (int pass = 0; ok && pass < 2; pass++) {
+        compact.pass = pass;
+        compact.offset = 0;
+        compact.count = 0;
+        compact.fingerprint = 0;
+        ok = visitIndex(src, compactHeader, 0, compactHeader.count, compactVisitor, &compact);
+
+        char name[MAX_GIF_PATH_LEN];
+        uint32_t fileSize;
+        for (uint32_t i = 0; ok && i < compactAddedCount; i++) {
+            if (bitSet(compactDead, compactHeader.count + i)) continue;
+            sdLock(SD_IO_BULK);
+            ok = readJournalName(journal, compactAdded[i], name, sizeof(name), &fileSize) &&
+                 compactWrite(&compact, name, strlen(name), 0, fileSize);
+            sdUnlock();
+        }
+        vTaskDelay(1);
+    }
+
+    sdLock(SD_IO_BULK);
+    if (ok) {
+        hdr.count = compact.count;
+        hdr.stringsSize = compact.offset;
+        hdr.fingerprint = compact.fingerprint;
+        ok = out.seek(0) && out.write(&hdr, sizeof(hdr)) == sizeof(hdr) && out.sync();
+    }
+    if (src) src.close();
+    if (journal) journal.close();
+    if (out) out.close();
+    if (!ok) sd.remove(PLAYLIST_INDEX_TMP_PATH);
+    sdUnlock();
+
+    Serial.printf("Playlist compaction %s: %lu GIFs\n", ok ? "done" : "failed", (unsigned long)compact.count);
+    compactReady = ok;
+    compactRunning = false;
+    vTaskDelete(NULL);
+}
+
+static void startCompaction() {
+    size_t deadBytes = (positionCount() + 7) / 8;
+    compactDead = (uint8_t *)malloc(deadBytes ? deadBytes : 1);
+    compactAdded = (uint32_t *)malloc(sizeof(uint32_t) * (addedCount ? addedCount : 1));
+    if (compactDead == nullptr || compactAdded == nullptr) {
+        free(compactDead);
+        free(compactAdded);
+        compactDead = nullptr;
+        compactAdded = nullptr;
+        return;
+    }
+    memcpy(compactDead, deadBits, deadBytes);
+    memcpy(compactAdded, addedOffsets, sizeof(uint32_t) * addedCount);
+    compactHeader = header;
+    compactAddedCount = addedCount;
+    compactJournalPos = (uint32_t)journalFile.size();
+    compactRetryAt = compactJournalPos + PLAYLIST_COMPACT_THRESHOLD;
+
+    Serial.printf("Playlist journal at %lu bytes, compacting in the background\n", (unsigned long)compactJournalPos);
+    compactRunning = true;
+    // Idle priority on the decode core: it only runs while the decoder waits for the presenter
+    if (xTaskCreatePinnedToCore(compactTask, "idx_compact", 6144, NULL, tskIDLE_PRIORITY, NULL, 0) != pdPASS) {
+        compactRunning = false;
+    }
+}
+
+// Number of live positions before 'pos' in the compaction snapshot
+static uint32_t snapshotLiveBefore(uint32_t pos) {
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < pos; i++) {
+        if (!bitSet(compactDead, i)) live++;
+    }
+    return live;
+}
+
+// Position 'pos' had before the compaction -> position after it. Compaction
+// drops the removed GIFs and keeps the order, and GIFs added since the
+// snapshot follow the compacted ones in journal order.
+static uint32_t compactedPosition(uint32_t pos) {
+    uint32_t snapshotPositions = compactHeader.count + compactAddedCount;
+    uint32_t newPos = snapshotLiveBefore(min(pos, snapshotPositions));
+    if (pos > snapshotPositions) newPos += pos - snapshotPositions;
+    return newPos;
+}
+
+// Where the GIF at 'path' is now, for a batch loaded before positions moved
+static uint32_t currentPosition(uint32_t oldPosition, const char *path) {
+    const char *name = gifNameFromPath(path);
+    int32_t pos = name ? findLive(name) : -1;
+    return pos >= 0 ? (uint32_t)pos : PLAYLIST_NO_POSITION;
+}
+
+// Swap in the compacted index, keeping journal records written since the snapshot
+static void finishCompaction() {
+    uint32_t newStart = compactedPosition(current_batch_start);
+    uint32_t newEnd = compactedPosition(current_batch_end);
+
+    indexFile.close();
+    journalFile.close();
+    sd.remove(PLAYLIST_INDEX_PATH);
+    bool ok = sd.rename(PLAYLIST_INDEX_TMP_PATH, PLAYLIST_INDEX_PATH);
+
+    FsFile oldJournal = sd.open(PLAYLIST_JOURNAL_PATH, O_RDONLY);
+    sd.remove(PLAYLIST_JOURNAL_TMP_PATH);
+    FsFile newJournal = sd.open(PLAYLIST_JOURNAL_TMP_PATH, O_WRONLY | O_CREAT | O_TRUNC);
+    if (oldJournal && newJournal && oldJournal.seek(compactJournalPos)) {
+        uint8_t buf[128];
+        int n;
+        while ((n = oldJournal.read(buf, sizeof(buf))) > 0) {
+            newJournal.write(buf, n);
+        }
+    }
+    if (oldJournal) oldJournal.close();
+    if (newJournal) newJournal.close();
+    sd.remove(PLAYLIST_JOURNAL_PATH);
+    sd.rename(PLAYLIST_JOURNAL_TMP_PATH, PLAYLIST_JOURNAL_PATH);
+
+    free(compactDead);
+    free(compactAdded);
+    compactDead = nullptr;
+    compactAdded = nullptr;
+    compactReady = false;
+    compactRetryAt = PLAYLIST_COMPACT_THRESHOLD;
+
+    if (!ok || !loadIndex()) {
+        rescanRequested = true;
+        return;
+    }
+    current_batch_start = newStart;
+    current_batch_end = newEnd;
+    remapGifPathIndices(currentPosition); // The loaded batch keeps its paths; their positions moved
+}
+
+// Called by the decode task between two GIFs: journal and apply the changes
+// the web API reported, and swap in a finished compaction.
+// Returns true when playlist positions may have changed.
+bool playlistSync() {
+    if (pendingChanges == nullptr) return false;
+
+    bool changed = false;
+    PendingChange change;
+    while (xQueueReceive(pendingChanges, &change, 0) == pdTRUE) {
+        if (change.op == PENDING_RESCAN) {
+            rescanRequested = true;
+        } else {
+            sdLock();
+            uint32_t fileSize = 0;
+            if (change.op == JOURNAL_ADD) {
+                char path[MAX_GIF_PATH_LEN];
+                snprintf(path, sizeof(path), "%s/%s", GIF_DIR, change.name);
+                FsFile file = sd.open(path, O_RDONLY);
+                if (file) {
+                    fileSize = (uint32_t)file.size();
+                    file.close();
+                }
+            }
+            uint32_t offset = appendJournal(change.op, change.name, fileSize);
+            applyChange(change.op, change.name, offset, fileSize);
+            sdUnlock();
+        }
+        free(change.name);
+        changed = true;
+    }
+
+    if (compactRunning) return changed;
+
+    sdLock();
+    if (rescanRequested) {
+        // The journal cannot describe this change; fall back to the directory
+        if (compactReady) {
+            sd.remove(PLAYLIST_INDEX_TMP_PATH);
+            free(compactDead);
+            free(compactAdded);
+            compactDead = nullptr;
+            compactAdded = nullptr;
+            compactReady = false;
+        }
+        uint32_t count, fingerprint, stamp;
+        if (scanGifDir(&count, &fingerprint, &stamp) && rebuildFromDirectory(count, fingerprint, stamp)) {
+            Serial.printf("Playlist rescanned: %lu GIFs\n", (unsigned long)count);
+        }
+        if (current_batch_start > positionCount()) current_batch_start = 0;
+        if (current_batch_end > positionCount()) current_batch_end = positionCount();
+        remapGifPathIndices(currentPosition);
+        changed = true;
+    } else if (compactReady) {
+        finishCompaction();
+        changed = true;
+    } else if (journalFile && journalFile.size() >= compactRetryAt) {
+        startCompaction();
+    }
+    sdUnlock();
+    return changed;
+}
+
+static void queueChange(uint8_t op, const char *name) {
+    if (pendingChanges == nullptr) return; // Not open yet, the boot scan will see it
+
+    PendingChange change;
+    change.op = op;
+    change.name = name ? strdup(name) : nullptr;
+    if (xQueueSend(pendingChanges, &change, 0) != pdTRUE) {
+        free(change.name);
+        rescanRequested = true; // Too many changes at once, rescan instead
+    }
+}
+
+void playlistNotifyAdded(const char *path) {
+    const char *name = gifNameFromPath(path);
+    if (name) queueChange(JOURNAL_ADD, name);
+}
+
+void playlistNotifyRemoved(const char *path) {
+    if (strcmp(path, GIF_DIR) == 0) {
+        queueChange(PENDING_RESCAN, nullptr);
+        return;
+    }
+    const char *name = gifNameFromPath(path);
+    if (name) queueChange(JOURNAL_REMOVE, name);
+}
+
+void playlistNotifyRenamed(const char *from, const char *to) {
+    if (strcmp(from, GIF_DIR) == 0 || strcmp(to, GIF_DIR) == 0) {
+        queueChange(PENDING_RESCAN, nullptr);
+        return;
+    }
+    playlistNotifyRemoved(from);
+    playlistNotifyAdded(to);
+}
+
+void playlistNotifyRescan() {
+    queueChange(PENDING_RESCAN, nullptr);
+}
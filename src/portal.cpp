@@ -61,7 +61,7 @@ void setupWebAPI() {
                 file.close();
                 
                 // Replace template variables with actual values
-                content.replace("%CURRENT_GIF%", current_gif);
+                content.replace("%CURRENT_GIF%", currentGif());
                 content.replace("%SSID%", WiFi.SSID());
                 content.replace("%IP%", WiFi.localIP().toString());
                 content.replace("%BRIGHTNESS%", String(brightness));
@@ -0,0 +1,28 @@
+#include "ramplan.h"
+#include "pipeline.h"
+#include "framecache.h"
+#include "filecache.h"
+#include "panelanim.h"
+#include "upload.h"
+#include <AnimatedGIF.h>
+
+RamPlan ramPlan = {};
+
+RamPlan planInternalRam(bool psram) {
+    RamPlan plan = {};
+    plan.psram = psram;
+    plan.converter = psram || PANEL_ANIM_HEAP_CONVERTER;
+    plan.frameRingBytes = FRAME_RING_SIZE * sizeof(Frame);
+#ifdef TURBO_BUFFER_SIZE
+    plan.turboBytes = TURBO_BUFFER_SIZE + 256; // What allocTurboBuf() asks for
+#endif
+    plan.uploadBytes = UPLOAD_MAX_WRITERS * 2 * UPLOAD_BUFFER_BYTES;
+    if (!psram) {
+        plan.frameCacheBytes = FRAME_CACHE_HEAP_BUDGET;
+        plan.fileCacheBytes = FILE_CACHE_HEAP_BUDGET;
+        plan.converterBytes = plan.converter ? panelAnimWorkBytes() : 0;
+    }
+    plan.totalBytes = plan.frameRingBytes + plan.turboBytes + plan.uploadBytes + plan.frameCacheBytes +
+                      plan.fileCacheBytes + plan.converterBytes;
+    return plan;
+}
@@ -0,0 +1,241 @@
+#include "scale.h"
+
+scale_filter_t scaleFilter = SCALE_FILTER_DEFAULT;
+scale_fit_t scaleFit = SCALE_FIT_DEFAULT;
+Scaler playbackScaler;
+
+static void addDamage(Scaler &s, int y, int x0, int x1) {
+    s.damageRows |= 1u << y;
+    if (x0 < s.damageX0) s.damageX0 = x0;
+    if (x1 > s.damageX1) s.damageX1 = x1;
+}
+
+// Average two RGB565 pixels per channel without unpacking them
+static inline uint16_t average565(uint16_t a, uint16_t b) {
+    return (((a ^ b) & 0xF7DE) >> 1) + (a & b);
+}
+
+// Size and place the scaled canvas for the current fit policy
+static void placeCanvas(Scaler &s, int srcW, int srcH) {
+    int w = srcW, h = srcH;
+    bool wider = (long)srcW * MATRIX_HEIGHT >= (long)srcH * MATRIX_WIDTH;
+    bool scale = s.fit != SCALE_FIT_FIT || srcW > MATRIX_WIDTH || srcH > MATRIX_HEIGHT;
+    if (scale) {
+        // Letterbox and fit match the panel on the wider side, fill on the narrower one
+        if (wider == (s.fit != SCALE_FIT_FILL)) {
+            w = MATRIX_WIDTH;
+            h = (int)(((long)srcH * MATRIX_WIDTH + srcW / 2) / srcW);
+        } else {
+            h = MATRIX_HEIGHT;
+            w = (int)(((long)srcW * MATRIX_HEIGHT + srcH / 2) / srcH);
+        }
+        if (w < 1) w = 1;
+        if (h < 1) h = 1;
+    }
+    s.outW = w;
+    s.outH = h;
+    s.outX = (MATRIX_WIDTH - w) / 2;
+    s.outY = (MATRIX_HEIGHT - h) / 2;
+}
+
+// Source index for output index i of n over a source of size src. Nearest
+// samples the middle of each output pixel, box starts a 2-wide block there.
+static uint16_t mapIndex(int i, int n, int src, bool box) {
+    long s = box ? (long)i * src / n : ((2L * i + 1) * src) / (2L * n);
+    return s < src ? s : src - 1;
+}
+
+// Build the maps for a GIF that has just opened, with the current settings
+void planScale(Scaler &s, int srcWidth, int srcHeight) {
+    if (srcWidth < 1) srcWidth = 1;
+    if (srcHeight < 1) srcHeight = 1;
+    s.filter = scaleFilter;
+    s.fit = scaleFit;
+    s.srcW = srcWidth;
+    s.srcH = srcHeight;
+    placeCanvas(s, srcWidth, srcHeight);
+    s.unscaled = s.outW == srcWidth && s.outH == srcHeight;
+    s.box = s.filter == SCALE_FILTER_BOX && (s.outW < srcWidth || s.outH < srcHeight);
+
+    s.x0 = s.outX > 0 ? s.outX : 0;
+    s.x1 = s.outX + s.outW < MATRIX_WIDTH ? s.outX + s.outW : MATRIX_WIDTH;
+    s.y0 = s.outY > 0 ? s.outY : 0;
+    s.y1 = s.outY + s.outH < MATRIX_HEIGHT ? s.outY + s.outH : MATRIX_HEIGHT;
+    for (int x = s.x0; x < s.x1; x++) {
+        s.colMap[x] = mapIndex(x - s.outX, s.outW, srcWidth, s.box);
+    }
+    for (int y = s.y0; y < s.y1; y++) {
+        s.rowMap[y] = mapIndex(y - s.outY, s.outH, srcHeight, s.box);
+    }
+    scaleBeginFrame(s);
+}
+
+void scaleBeginFrame(Scaler &s) {
+    memset(s.rowTouched, 0, sizeof(s.rowTouched));
+    s.damageRows = 0;
+    s.damageX0 = MATRIX_WIDTH;
+    s.damageX1 = 0;
+}
+
+// Panel rows and columns [*x0, *x1) the frame decoded since scaleBeginFrame() drew into
+uint32_t scaleFrameDamage(const Scaler &s, int *x0, int *x1) {
+    *x0 = s.damageX0 < s.damageX1 ? s.damageX0 : 0;
+    *x1 = s.damageX0 < s.damageX1 ? s.damageX1 : 0;
+    return s.damageRows;
+}
+
+// First index in [lo, hi) whose map entry is >= value; the maps never decrease
+static int lowerBound(const uint16_t *map, int lo, int hi, int value) {
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (map[mid] < value) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Panel rows [*first, *last) that source row srcY is drawn into
+static void panelRows(const Scaler &s, int srcY, int *first, int *last) {
+    if (s.unscaled) {
+        int y = srcY + s.outY;
+        bool visible = y >= 0 && y < MATRIX_HEIGHT;
+        *first = visible ? y : 0;
+        *last = visible ? y + 1 : 0;
+        return;
+    }
+    // With the box filter a row is also the bottom half of the panel rows mapped to the row above
+    *first = lowerBound(s.rowMap, s.y0, s.y1, s.box ? srcY - 1 : srcY);
+    *last = lowerBound(s.rowMap, *first, s.y1, srcY + 1);
+}
+
+// Whether a decoded line lands on the panel at all; lines that do not are
+// counted and skipped before any pixel work
+bool scaleRowVisible(Scaler &s, int srcY) {
+    int first, last;
+    panelRows(s, srcY, &first, &last);
+    if (first < last) return true;
+    s.rowsSkipped++;
+    return false;
+}
+
+// 1:1, a source line is one span of one panel row
+static void drawUnscaledRow(Scaler &scaler, uint16_t *canvas, const uint8_t *s, int frameX, int frameWidth,
+                            int y, const uint16_t *palette, int transparent) {
+    int left = frameX + scaler.outX; // Panel column of s[0]
+    int first = left < 0 ? -left : 0;
+    int last = left + frameWidth > MATRIX_WIDTH ? MATRIX_WIDTH - left : frameWidth;
+    if (first >= last) return;
+    addDamage(scaler, y, left + first, left + last);
+    uint16_t *d = &canvas[y * MATRIX_WIDTH + left];
+    if (transparent >= 0) {
+        int x = first;
+        while (x < last) {
+            // skip a run of transparent pixels, the canvas keeps what is there
+            while (x < last && s[x] == transparent)
+                x++;
+            // translate the following run of opaque pixels
+            while (x < last && s[x] != transparent) {
+                d[x] = palette[s[x]];
+                x++;
+            }
+        }
+    } else {
+        for (int x = first; x < last; x++)
+            d[x] = palette[s[x]];
+    }
+}
+
+// Draw a decoded line of the frame at frameX..frameX+frameWidth of the canvas
+void scaleDrawRow(Scaler &s, uint16_t *canvas, const uint8_t *pixels, int frameX, int frameWidth,
+                  int srcY, const uint16_t *palette, int transparent) {
+    int first, last;
+    panelRows(s, srcY, &first, &last);
+    if (first >= last) return;
+    s.rowsDrawn++;
+    if (s.unscaled) {
+        drawUnscaledRow(s, canvas, pixels, frameX, frameWidth, first, palette, transparent);
+        return;
+    }
+
+    // Panel columns whose source column lies inside this frame
+    int x0 = lowerBound(s.colMap, s.x0, s.x1, frameX);
+    int x1 = lowerBound(s.colMap, x0, s.x1, frameX + frameWidth);
+    if (x0 >= x1) return;
+    for (int y = first; y < last; y++) {
+        addDamage(s, y, x0, x1);
+        uint16_t *d = &canvas[y * MATRIX_WIDTH];
+        if (!s.box) {
+            for (int x = x0; x < x1; x++) {
+                uint8_t p = pixels[s.colMap[x] - frameX];
+                if (p != transparent)
+                    d[x] = palette[p];
+            }
+            continue;
+        }
+        // Box: average the horizontal pair, then with the other source row of
+        // the block if it was drawn first. Transparent samples take the canvas.
+        bool blend = s.rowTouched[y];
+        for (int x = x0; x < x1; x++) {
+            int sx = s.colMap[x] - frameX;
+            uint8_t a = pixels[sx];
+            uint8_t b = sx + 1 < frameWidth ? pixels[sx + 1] : a;
+            uint16_t ca = a == transparent ? d[x] : palette[a];
+            uint16_t cb = b == transparent ? d[x] : palette[b];
+            uint16_t c = average565(ca, cb);
+            d[x] = blend ? average565(d[x], c) : c;
+        }
+        s.rowTouched[y] = true;
+    }
+}
+
+// Playback's plan and counters
+ScaleStats getScaleStats() {
+    const Scaler &s = playbackScaler;
+    ScaleStats stats;
+    stats.srcWidth = s.srcW;
+    stats.srcHeight = s.srcH;
+    stats.outX = s.outX;
+    stats.outY = s.outY;
+    stats.outWidth = s.outW;
+    stats.outHeight = s.outH;
+    stats.rowsDrawn = s.rowsDrawn;
+    stats.rowsSkipped = s.rowsSkipped;
+    return stats;
+}
+
+const char *scaleFilterName(scale_filter_t filter) {
+    switch (filter) {
+        case SCALE_FILTER_NEAREST: return "nearest";
+        case SCALE_FILTER_BOX: return "box";
+        default: return "unknown";
+    }
+}
+
+const char *scaleFitName(scale_fit_t fit) {
+    switch (fit) {
+        case SCALE_FIT_LETTERBOX: return "letterbox";
+        case SCALE_FIT_FIT: return "fit";
+        case SCALE_FIT_FILL: return "fill";
+        default: return "unknown";
+    }
+}
+
+bool parseScaleFilter(const String &name, scale_filter_t *filter) {
+    for (int i = 0; i < SCALE_FILTER_COUNT; i++) {
+        if (name == scaleFilterName((scale_filter_t)i)) {
+            *filter = (scale_filter_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseScaleFit(const String &name, scale_fit_t *fit) {
+    for (int i = 0; i < SCALE_FIT_COUNT; i++) {
+        if (name == scaleFitName((scale_fit_t)i)) {
+            *fit = (scale_fit_t)i;
+            return true;
+        }
+    }
+    return false;
+}
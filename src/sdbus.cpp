@@ -0,0 +1,182 @@
+#include "sdbus.h"
+
+struct SdJob {
+    sd_job_fn fn;
+    void *arg;
+    uint32_t postedUs;
+};
+
+struct ClassCounters {
+    uint32_t locks;
+    uint32_t contended;
+    uint64_t lockWaitUs;
+    uint32_t maxLockWaitUs;
+    uint32_t jobs;
+    uint64_t queueWaitUs;
+    uint32_t maxQueueWaitUs;
+};
+
+// Card ownership. A task releasing the card hands it straight to the waiter
+// picked by pickWaiter(): reserved keeps it for that waiter until it runs.
+static TaskHandle_t owner = nullptr;
+static uint32_t depth = 0;
+static bool reserved = false;
+static uint16_t waiting[SD_IO_CLASSES];
+static uint32_t waitingSince[SD_IO_CLASSES]; // millis() the class's oldest waiter started
+static SemaphoreHandle_t wake[SD_IO_CLASSES];
+static portMUX_TYPE busMux = portMUX_INITIALIZER_UNLOCKED;
+
+static QueueHandle_t jobQueues[SD_IO_CLASSES];
+static SemaphoreHandle_t workReady = nullptr;
+
+static ClassCounters counters[SD_IO_CLASSES];
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Most urgent class waiting, unless a lower one has waited too long; busMux held
+static int pickWaiter() {
+    uint32_t now = millis();
+    for (int c = SD_IO_CLASSES - 1; c > 0; c--) {
+        if (waiting[c] && now - waitingSince[c] >= SD_BUS_STARVE_MS) {
+            for (int h = 0; h < c; h++) {
+                if (waiting[h]) return c; // Starved behind a more urgent class
+            }
+        }
+    }
+    for (int c = 0; c < SD_IO_CLASSES; c++) {
+        if (waiting[c]) return c;
+    }
+    return -1;
+}
+
+// Take the card for the calling task; nests like a recursive mutex
+void sdLock(sd_io_class_t ioClass) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    portENTER_CRITICAL(&busMux);
+    if (owner == self) {
+        depth++;
+        portEXIT_CRITICAL(&busMux);
+        return;
+    }
+    if (owner == nullptr && !reserved) {
+        owner = self;
+        depth = 1;
+        portEXIT_CRITICAL(&busMux);
+        portENTER_CRITICAL(&statsMux);
+        counters[ioClass].locks++;
+        portEXIT_CRITICAL(&statsMux);
+        return;
+    }
+    if (waiting[ioClass]++ == 0) waitingSince[ioClass] = millis();
+    portEXIT_CRITICAL(&busMux);
+
+    uint32_t start = micros();
+    xSemaphoreTake(wake[ioClass], portMAX_DELAY);
+    portENTER_CRITICAL(&busMux);
+    owner = self;
+    depth = 1;
+    reserved = false;
+    portEXIT_CRITICAL(&busMux);
+
+    uint32_t waited = micros() - start;
+    portENTER_CRITICAL(&statsMux);
+    ClassCounters &c = counters[ioClass];
+    c.locks++;
+    c.contended++;
+    c.lockWaitUs += waited;
+    if (waited > c.maxLockWaitUs) c.maxLockWaitUs = waited;
+    portEXIT_CRITICAL(&statsMux);
+}
+
+void sdUnlock() {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    portENTER_CRITICAL(&busMux);
+    if (owner != self || --depth > 0) {
+        portEXIT_CRITICAL(&busMux);
+        return;
+    }
+    owner = nullptr;
+    int next = pickWaiter();
+    if (next >= 0) {
+        reserved = true;
+        if (--waiting[next] > 0) waitingSince[next] = millis();
+    }
+    portEXIT_CRITICAL(&busMux);
+    if (next >= 0) xSemaphoreGive(wake[next]);
+}
+
+// The next job, most urgent class first; -1 when every queue is empty
+static int nextJob(SdJob *job) {
+    for (int c = 0; c < SD_IO_CLASSES; c++) {
+        if (xQueueReceive(jobQueues[c], job, 0) == pdTRUE) return c;
+    }
+    return -1;
+}
+
+static void ioTask(void *param) {
+    for (;;) {
+        xSemaphoreTake(workReady, portMAX_DELAY);
+        SdJob job;
+        int c;
+        while ((c = nextJob(&job)) >= 0) {
+            uint32_t waited = micros() - job.postedUs;
+            portENTER_CRITICAL(&statsMux);
+            ClassCounters &counter = counters[c];
+            counter.jobs++;
+            counter.queueWaitUs += waited;
+            if (waited > counter.maxQueueWaitUs) counter.maxQueueWaitUs = waited;
+            portEXIT_CRITICAL(&statsMux);
+            job.fn(job.arg);
+        }
+    }
+}
+
+bool initSdBus() {
+    workReady = xSemaphoreCreateBinary();
+    bool ok = workReady != nullptr;
+    for (int c = 0; c < SD_IO_CLASSES && ok; c++) {
+        wake[c] = xSemaphoreCreateBinary();
+        jobQueues[c] = xQueueCreate(SD_BUS_QUEUE_LEN, sizeof(SdJob));
+        ok = wake[c] != nullptr && jobQueues[c] != nullptr;
+    }
+    if (!ok) {
+        Serial.println("SD bus setup failed: out of memory");
+        return false;
+    }
+    xTaskCreatePinnedToCore(ioTask, "sd_io", 4096, NULL, 1, NULL, SD_BUS_TASK_CORE);
+    return true;
+}
+
+// Run fn(arg) on the SD I/O task; false when the class's queue is full.
+// fn takes sdLock() itself, with the same class.
+bool sdBusSubmit(sd_io_class_t ioClass, sd_job_fn fn, void *arg) {
+    if (workReady == nullptr) return false;
+    SdJob job = {fn, arg, (uint32_t)micros()};
+    if (xQueueSend(jobQueues[ioClass], &job, 0) != pdTRUE) return false;
+    xSemaphoreGive(workReady);
+    return true;
+}
+
+SdBusClassStats getSdBusStats(sd_io_class_t ioClass) {
+    portENTER_CRITICAL(&statsMux);
+    ClassCounters c = counters[ioClass];
+    portEXIT_CRITICAL(&statsMux);
+    SdBusClassStats stats;
+    stats.locks = c.locks;
+    stats.contended = c.contended;
+    stats.avgLockWaitUs = c.contended ? c.lockWaitUs / c.contended : 0;
+    stats.maxLockWaitUs = c.maxLockWaitUs;
+    stats.jobs = c.jobs;
+    stats.avgQueueWaitUs = c.jobs ? c.queueWaitUs / c.jobs : 0;
+    stats.maxQueueWaitUs = c.maxQueueWaitUs;
+    stats.queued = jobQueues[ioClass] ? uxQueueMessagesWaiting(jobQueues[ioClass]) : 0;
+    return stats;
+}
+
+const char *sdIoClassName(sd_io_class_t ioClass) {
+    switch (ioClass) {
+        case SD_IO_PLAYBACK: return "playback";
+        case SD_IO_INTERACTIVE: return "interactive";
+        case SD_IO_BULK: return "bulk";
+        default: return "unknown";
+    }
+}
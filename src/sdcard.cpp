@@ -1,33 +1,62 @@
 #include "sdcard.h"
 #include "globals.h" // For SD_SCK_PIN, SD_MISO_PIN, SD_MOSI_PIN, SD_CS_PIN, GIF_DIR, frame_status_t, SD_CARD_ERROR, NO_FILES, PLAYING_ART
+#include "playlist.h"
+#include "panel.h"
+#include "pipeline.h"
 #include <SPI.h>
 
 // Global SD-related variables definitions
 SdFs sd;
 bool sdError = false;
-std::vector<char*> gifFilePaths; // Vector of C-style strings for current batch
+HeapStats heapBeforeBatch = {0, 0, 0};
+HeapStats heapAfterBatch = {0, 0, 0};
+
+// Paths of the current batch: exact-length strings bump-allocated from one
+// static arena, found through an offset table. Reset wholesale per batch, so
+// loading a batch never touches the heap.
+static char gifPathArena[GIF_PATH_ARENA_SIZE];
+static size_t gifPathArenaUsed = 0;
+static uint16_t gifPathOffsets[BATCH_SIZE];
+static uint32_t gifPathIndices[BATCH_SIZE]; // Playlist position of each path
+static size_t gifPathTotal = 0;
 unsigned long total_files = 0;
-String current_gif = "";
+// The GIF playing, set by the playback task and read by the web API; copied
+// under the lock, so a reader never sees it half replaced
+static char currentGifPath[MAX_GIF_PATH_LEN] = "";
+static portMUX_TYPE currentGifMux = portMUX_INITIALIZER_UNLOCKED;
 
 // Batch processing variables
 unsigned long total_gifs_count = 0;
 unsigned long current_batch_start = 0;
+unsigned long current_batch_end = 0;
 bool batch_processing_complete = false;
 
+// While the pipeline runs, status screens are drawn by the decode task. Wait
+// until the present task has shown every queued frame so the two never draw
+// into the same buffer, and until its last flip has landed.
+static void beginStatusScreen() {
+    frameRingWaitEmpty();
+    panelWaitForBackBuffer();
+}
+
 // Helper function for displaying status on the matrix display
 void displayStatus(MatrixPanel_I2S_DMA *dma_display, const char* message, uint16_t color) {
     if (dma_display == nullptr) return;
 
+    beginStatusScreen();
     dma_display->fillScreen(dma_display->color565(0, 0, 0));
     dma_display->setCursor(10, 10);
     dma_display->setTextColor(color);
     dma_display->setTextSize(1);
     dma_display->print(message);
+    panelInvalidate(); // Drawn outside the frame path
+    panelPresentStatus();
 }
 
 void displayStatus(MatrixPanel_I2S_DMA *dma_display, const char* line1, const char* line2, uint16_t color) {
     if (dma_display == nullptr) return;
 
+    beginStatusScreen();
     dma_display->fillScreen(dma_display->color565(0, 0, 0));
     dma_display->setTextSize(1);
     dma_display->setTextColor(color);
@@ -35,11 +64,14 @@ void displayStatus(MatrixPanel_I2S_DMA *dma_display, const char* line1, const ch
     dma_display->print(line1);
     dma_display->setCursor(10, 18);
     dma_display->print(line2);
+    panelInvalidate(); // Drawn outside the frame path
+    panelPresentStatus();
 }
 
 void displayStatus(MatrixPanel_I2S_DMA *dma_display, const char* line1, const char* line2, const char* line3, uint16_t color) {
     if (dma_display == nullptr) return;
 
+    beginStatusScreen();
     dma_display->fillScreen(dma_display->color565(0, 0, 0));
     dma_display->setTextSize(1);
     dma_display->setTextColor(color);
@@ -49,18 +81,52 @@ void displayStatus(MatrixPanel_I2S_DMA *dma_display, const char* line1, const ch
     dma_display->print(line2);
     dma_display->setCursor(10, 22);
     dma_display->print(line3);
+    panelInvalidate(); // Drawn outside the frame path
+    panelPresentStatus();
 }
-// Utility to clear the paths and free memory
+// Utility to clear the paths of the current batch
 void clearGifFilePaths() {
-    for (char* path : gifFilePaths) {
-        delete[] path; // Free each individual char array allocated with new[]
+    gifPathArenaUsed = 0;
+    gifPathTotal = 0;
+}
+
+size_t gifPathCount() {
+    return gifPathTotal;
+}
+
+const char *gifPath(size_t i) {
+    return &gifPathArena[gifPathOffsets[i]];
+}
+
+uint32_t gifPathIndex(size_t i) {
+    return gifPathIndices[i];
+}
+
+// Playlist positions moved under the loaded batch: look each path up again
+void remapGifPathIndices(uint32_t (*remap)(uint32_t position, const char *path)) {
+    for (size_t i = 0; i < gifPathTotal; i++) {
+        gifPathIndices[i] = remap(gifPathIndices[i], gifPath(i));
     }
-    gifFilePaths.clear(); // Clear the vector itself
+}
+
+HeapStats sampleHeap() {
+    HeapStats stats;
+    stats.freeHeap = ESP.getFreeHeap();
+    stats.minFreeHeap = ESP.getMinFreeHeap();
+    stats.largestFreeBlock = ESP.getMaxAllocHeap();
+    return stats;
+}
+
+static void printHeap(const char *label, const HeapStats &stats) {
+    Serial.printf("Heap %s: %lu bytes free, %lu min free, %lu largest block\n", label,
+                  (unsigned long)stats.freeHeap, (unsigned long)stats.minFreeHeap,
+                  (unsigned long)stats.largestFreeBlock);
 }
 
 // Function to initialize the SD card
 bool initSD(MatrixPanel_I2S_DMA *dma_display) {
     Serial.println("Initializing SD card...");
+    initSdBus();
     displayStatus(dma_display, "Init SD...", dma_display->color565(255, 255, 255));
 
     SPI.begin(SD_SCK_PIN, SD_MISO_PIN, SD_MOSI_PIN, SD_CS_PIN);
@@ -132,29 +198,13 @@ void listRootDirectories(MatrixPanel_I2S_DMA *dma_display) {
     delay(2000);
 }
 
-// Function to count total number of GIF files without loading them into memory
-
-// Optimized function to count total number of files in GIF_DIR
-// (Previously counted only GIF files, now counts all files)
+// Open (and if needed rebuild) the playlist index and take the GIF count from it
 bool countTotalGifs(MatrixPanel_I2S_DMA *dma_display) {
-    FsFile gifRoot = sd.open(GIF_DIR);
-    if (!gifRoot) {
-        Serial.println("Failed to open /gifs directory on SD card!");
-        displayStatus(dma_display, "No /gifs Dir", dma_display->color565(255, 0, 0));
+    if (!playlistOpen(dma_display)) {
         return false;
     }
 
-    FsFile file;
-    total_gifs_count = 0;
-
-    while (file.openNext(&gifRoot, O_RDONLY)) {
-        yield(); 
-        if (file.isFile()) {
-            total_gifs_count++;
-        }
-        file.close();
-    }
-    gifRoot.close();
+    total_gifs_count = playlistCount();
 
     if (total_gifs_count == 0) {
         Serial.println("No GIF files found in /gifs directory!");
@@ -165,7 +215,23 @@ bool countTotalGifs(MatrixPanel_I2S_DMA *dma_display) {
     return true;
 }
 
-// Function to load the next batch of GIF file paths
+static bool batchArenaFull = false;
+
+static void addBatchPath(uint32_t index, const char *path) {
+    size_t len = strlen(path) + 1;
+    if (gifPathTotal >= BATCH_SIZE || gifPathArenaUsed + len > GIF_PATH_ARENA_SIZE) {
+        batchArenaFull = true;
+        return;
+    }
+    memcpy(&gifPathArena[gifPathArenaUsed], path, len);
+    gifPathOffsets[gifPathTotal] = gifPathArenaUsed;
+    gifPathIndices[gifPathTotal] = index;
+    gifPathArenaUsed += len;
+    gifPathTotal++;
+    Serial.printf("Loaded GIF #%lu: %s\n", (unsigned long)index + 1, path);
+}
+
+// Function to load the next batch of GIF file paths from the playlist index
 bool loadNextGifBatch(MatrixPanel_I2S_DMA *dma_display) {
     Serial.printf("Loading batch starting from GIF #%lu...\n", current_batch_start + 1);
     char status_msg[32];
@@ -175,73 +241,38 @@ bool loadNextGifBatch(MatrixPanel_I2S_DMA *dma_display) {
         displayStatus(dma_display, status_msg, dma_display->color565(255, 255, 255));
     }
     
-    Serial.printf("Heap before batch load: %lu bytes\n", ESP.getFreeHeap());
+    heapBeforeBatch = sampleHeap();
+    printHeap("before batch load", heapBeforeBatch);
 
     // Clear previous batch
     clearGifFilePaths();
 
-    FsFile gifRoot = sd.open(GIF_DIR);
-    if (!gifRoot) {
-        Serial.println("Failed to open /gifs directory!");
-        displayStatus(dma_display, "Dir Error!", dma_display->color565(255, 0, 0));
+    // One seek and read in the index instead of walking the directory
+    batchArenaFull = false;
+    current_batch_end = current_batch_start + BATCH_SIZE;
+    playlistReadRange(current_batch_start, BATCH_SIZE, addBatchPath);
+    heapAfterBatch = sampleHeap(); // Before any return, so it always pairs with heapBeforeBatch
+    if (batchArenaFull) {
+        Serial.println("ERROR: GIF path arena full!");
+        displayStatus(dma_display, "MEMORY ERROR!", dma_display->color565(255, 0, 0));
+        clearGifFilePaths();
         return false;
     }
 
-    FsFile file;
-    unsigned long current_gif_index = 0;
-    unsigned long loaded_in_batch = 0;
-    unsigned long lastYieldTime = millis();
-
-    while (file.openNext(&gifRoot, O_RDONLY) && loaded_in_batch < BATCH_SIZE) {
-        yield();
-        if (file.isFile()) {
-            char fileName[256];
-            file.getName(fileName, sizeof(fileName));
-            
-            String fileNameStr = String(fileName);
-            fileNameStr.toLowerCase();
-            if (fileNameStr.endsWith(".gif")) {
-                // Check if this GIF is in our current batch range
-                if (current_gif_index >= current_batch_start && current_gif_index < current_batch_start + BATCH_SIZE) {
-                    // Allocate memory for the full path
-                    char* pathBuffer = new (std::nothrow) char[MAX_GIF_PATH_LEN];
-                    if (pathBuffer == nullptr) {
-                        Serial.println("ERROR: Failed to allocate memory for GIF path!");
-                        displayStatus(dma_display, "MEMORY ERROR!", dma_display->color565(255, 0, 0));
-                        clearGifFilePaths();
-                        gifRoot.close();
-                        file.close();
-                        return false;
-                    }
-                    
-                    snprintf(pathBuffer, MAX_GIF_PATH_LEN, "%s/%s", GIF_DIR, fileName);
-                    gifFilePaths.push_back(pathBuffer);
-                    
-                    Serial.printf("Loaded GIF #%lu: %s\n", current_gif_index + 1, pathBuffer);
-                    loaded_in_batch++;
-                }
-                current_gif_index++;
-            }
-        }
-        file.close();
-
-        if (millis() - lastYieldTime > 50) {
-            yield();
-            lastYieldTime = millis();
-        }
-    }
-    gifRoot.close();
-
-    total_files = gifFilePaths.size();
+    total_files = gifPathTotal;
     
-    if (gifFilePaths.empty()) {
+    if (gifPathTotal == 0 && current_batch_start < playlistCount()) {
+        Serial.println("Every GIF in this batch was deleted, skipping it");
+        return true;
+    }
+    if (gifPathTotal == 0) {
         Serial.println("No GIFs loaded in this batch!");
         displayStatus(dma_display, "Batch Empty!", dma_display->color565(255, 0, 0));
         return false;
     }
 
-    Serial.printf("Loaded %lu GIFs in current batch\n", total_files);
-    Serial.printf("Heap after batch load: %lu bytes\n", ESP.getFreeHeap());
+    Serial.printf("Loaded %lu GIFs in current batch (%u path bytes)\n", total_files, (unsigned)gifPathArenaUsed);
+    printHeap("after batch load", heapAfterBatch);
     
     if(SHOW_PROGRESS) {
         sprintf(status_msg, "Loaded %lu GIFs", total_files);
@@ -254,4 +285,22 @@ bool loadNextGifBatch(MatrixPanel_I2S_DMA *dma_display) {
 // Legacy function for backward compatibility - now just calls the counting function
 bool loadGifFilePaths(MatrixPanel_I2S_DMA *dma_display) {
     return countTotalGifs(dma_display);
-}
\ No newline at end of file
+}
+
+void setCurrentGif(const char *path) {
+    portENTER_CRITICAL(&currentGifMux);
+    strlcpy(currentGifPath, path, sizeof(currentGifPath));
+    portEXIT_CRITICAL(&currentGifMux);
+}
+
+void getCurrentGif(char *buf, size_t len) {
+    portENTER_CRITICAL(&currentGifMux);
+    strlcpy(buf, currentGifPath, len);
+    portEXIT_CRITICAL(&currentGifMux);
+}
+
+String currentGif() {
+    char path[MAX_GIF_PATH_LEN];
+    getCurrentGif(path, sizeof(path));
+    return String(path);
+}
@@ -0,0 +1,416 @@
+#include "sdreader.h"
+#include "globals.h"
+#include "sdcard.h"
+#include <atomic>
+
+enum {
+    WINDOW_EMPTY = 0,
+    WINDOW_PENDING,   // Queued for the SD I/O task
+    WINDOW_READY,
+};
+
+struct ReadWindow {
+    uint8_t data[SD_READ_WINDOW];
+    uint32_t start;   // File offset, a multiple of SD_READ_WINDOW
+    uint32_t length;
+    bool readAhead;   // Filled ahead by the SD I/O task and not used yet
+    std::atomic<uint8_t> state;
+};
+
+enum {
+    SLOT_CLOSED = 0,
+    SLOT_OPENING,     // Prefetch task is opening the file
+    SLOT_PREFETCHED,  // Open with its first window read, waiting for GIFOpenFile
+    SLOT_OPEN,        // In use by the decoder
+    SLOT_PARKED,      // Closed by the decoder but kept open, a reopen is free
+};
+
+struct ReaderSlot {
+    FsFile file;
+    char path[MAX_GIF_PATH_LEN];
+    uint32_t pathHash;
+    uint32_t generation;      // staleGeneration when the file was opened
+    uint32_t size;
+    ReadWindow windows[2];
+    uint8_t lastWindow;
+    std::atomic<uint8_t> state;
+    std::atomic<uint32_t> pendingJobs;
+};
+
+// Prefetch jobs run on the SD I/O task (sdbus.h). The argument packs the
+// slot and the window to fill, -1 to open the slot's file and read its first.
+static inline void *jobArg(int slot, int window) {
+    return (void *)(intptr_t)((slot << 8) | (uint8_t)window);
+}
+
+// One slot holds the decoder's file, the other the next playlist entry.
+// Slot roles and window bookkeeping belong to the decode task; the SD I/O
+// task only fills what it is handed and publishes it through the states.
+static ReaderSlot slots[2];
+static int currentSlot = 0;
+static char deferredNext[MAX_GIF_PATH_LEN];
+static bool hasDeferred = false;
+static std::atomic<bool> handlesStale(false); // Card changed under parked or prefetched files
+// Paths invalidated, by generation: the last SD_READER_STALE_PATHS, 0 for all of them
+static uint32_t staleHashes[SD_READER_STALE_PATHS];
+static uint32_t staleGeneration = 0;
+static portMUX_TYPE staleMux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t jobDone = nullptr; // Given after every job; only the decode task waits on it
+
+static uint32_t statReads = 0;
+static uint64_t statBytes = 0;
+static uint64_t statBusyUs = 0;
+static uint32_t latencyHistogram[SD_LATENCY_BUCKETS];
+static uint32_t readAheadHits = 0;
+static uint32_t prefetchHits = 0;
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// 0-3 us get a bucket each, then 4 buckets per power of two
+static int latencyBucket(uint32_t us) {
+    if (us < 4) return us;
+    int log2 = 31 - __builtin_clz(us);
+    int bucket = (log2 - 1) * 4 + ((us >> (log2 - 2)) & 3);
+    return bucket < SD_LATENCY_BUCKETS ? bucket : SD_LATENCY_BUCKETS - 1;
+}
+
+static uint32_t bucketUpperBound(int bucket) {
+    if (bucket < 4) return bucket + 1;
+    int log2 = bucket / 4 + 1;
+    return (uint32_t)(5 + bucket % 4) << (log2 - 2);
+}
+
+static void recordRead(uint32_t bytes, uint32_t us) {
+    portENTER_CRITICAL(&statsMux);
+    statReads++;
+    statBytes += bytes;
+    statBusyUs += us;
+    latencyHistogram[latencyBucket(us)]++;
+    portEXIT_CRITICAL(&statsMux);
+}
+
+static uint32_t hashPath(const char *path) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    while (*path) {
+        hash ^= (uint8_t)*path++;
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1; // 0 stands for every path
+}
+
+// Whether the slot's file was invalidated since it was opened
+static bool slotStale(const ReaderSlot &slot) {
+    portENTER_CRITICAL(&staleMux);
+    uint32_t since = staleGeneration - slot.generation;
+    bool stale = since > SD_READER_STALE_PATHS;
+    for (uint32_t i = 0; i < since && !stale; i++) {
+        uint32_t hash = staleHashes[(slot.generation + i) % SD_READER_STALE_PATHS];
+        stale = hash == 0 || hash == slot.pathHash;
+    }
+    portEXIT_CRITICAL(&staleMux);
+    return stale;
+}
+
+// Note what the slot is about to open; call right before opening it
+static void stampSlot(ReaderSlot &slot) {
+    slot.pathHash = hashPath(slot.path);
+    portENTER_CRITICAL(&staleMux);
+    slot.generation = staleGeneration;
+    portEXIT_CRITICAL(&staleMux);
+}
+
+// Read the window at window.start; the caller sets start before handing it
+// over. Fails once the file is invalidated: it may be replaced or removed
+// next, and the card lock orders this check before that.
+static bool fillWindow(ReaderSlot &slot, ReadWindow &window) {
+    uint32_t start = window.start;
+    uint32_t length = slot.size - start;
+    if (length > SD_READ_WINDOW) length = SD_READ_WINDOW;
+
+    unsigned long startUs = micros();
+    sdLock(SD_IO_PLAYBACK);
+    bool ok = !slotStale(slot) && slot.file.seekSet(start) && slot.file.read(window.data, length) == (int)length;
+    sdUnlock();
+    recordRead(length, micros() - startUs);
+
+    window.length = ok ? length : 0;
+    return ok;
+}
+
+static void prefetchJob(void *arg) {
+    ReaderSlot &slot = slots[((intptr_t)arg >> 8) & 1];
+    int8_t windowIndex = (int8_t)((intptr_t)arg & 0xff);
+
+    if (windowIndex < 0) {
+        stampSlot(slot);
+        sdLock(SD_IO_PLAYBACK);
+        slot.file = FILESYSTEM.open(slot.path, O_RDONLY);
+        sdUnlock();
+        bool ok = slot.file;
+        if (ok) {
+            slot.size = slot.file.size();
+            ReadWindow &first = slot.windows[0];
+            first.start = 0;
+            first.readAhead = fillWindow(slot, first);
+            first.state.store(first.readAhead ? WINDOW_READY : WINDOW_EMPTY, std::memory_order_release);
+        }
+        slot.state.store(ok ? SLOT_PREFETCHED : SLOT_CLOSED, std::memory_order_release);
+    } else {
+        ReadWindow &window = slot.windows[windowIndex];
+        window.readAhead = fillWindow(slot, window);
+        window.state.store(window.readAhead ? WINDOW_READY : WINDOW_EMPTY, std::memory_order_release);
+    }
+    slot.pendingJobs.fetch_sub(1, std::memory_order_release);
+    xSemaphoreGive(jobDone);
+}
+
+static bool postJob(int slot, int window) {
+    if (jobDone == nullptr) return false;
+    slots[slot].pendingJobs.fetch_add(1, std::memory_order_acq_rel);
+    if (!sdBusSubmit(SD_IO_PLAYBACK, prefetchJob, jobArg(slot, window))) {
+        slots[slot].pendingJobs.fetch_sub(1, std::memory_order_acq_rel);
+        return false;
+    }
+    return true;
+}
+
+static void waitIdle(ReaderSlot &slot) {
+    while (slot.pendingJobs.load(std::memory_order_acquire) > 0) {
+        xSemaphoreTake(jobDone, portMAX_DELAY);
+    }
+}
+
+static void closeSlot(ReaderSlot &slot) {
+    waitIdle(slot);
+    if (slot.file) {
+        sdLock(SD_IO_PLAYBACK);
+        slot.file.close();
+        sdUnlock();
+    }
+    slot.path[0] = '\0';
+    slot.size = 0;
+    slot.lastWindow = 0;
+    for (int i = 0; i < 2; i++) {
+        slot.windows[i].state.store(WINDOW_EMPTY, std::memory_order_relaxed);
+        slot.windows[i].readAhead = false;
+    }
+    slot.state.store(SLOT_CLOSED, std::memory_order_release);
+}
+
+// Open path in the spare slot in the background, unless it is already there
+static void startPrefetch(const char *path) {
+    ReaderSlot &current = slots[currentSlot];
+    ReaderSlot &next = slots[1 - currentSlot];
+    if (current.state.load(std::memory_order_acquire) != SLOT_CLOSED && strcmp(current.path, path) == 0) return;
+    if (next.state.load(std::memory_order_acquire) != SLOT_CLOSED && strcmp(next.path, path) == 0) return;
+
+    closeSlot(next);
+    strlcpy(next.path, path, sizeof(next.path));
+    next.state.store(SLOT_OPENING, std::memory_order_release);
+    if (!postJob(1 - currentSlot, -1)) {
+        next.path[0] = '\0';
+        next.state.store(SLOT_CLOSED, std::memory_order_release);
+    }
+}
+
+bool initSdReader() {
+    jobDone = xSemaphoreCreateBinary();
+    if (jobDone == nullptr) {
+        Serial.println("SD prefetch disabled: semaphore allocation failed");
+        return false;
+    }
+    return true;
+}
+
+// Between GIFs, close files that may have been replaced or removed since
+static void dropStaleHandles() {
+    if (handlesStale.exchange(false, std::memory_order_acq_rel)) {
+        for (int i = 0; i < 2; i++) {
+            waitIdle(slots[i]); // An open in flight stamps the slot first
+            if (slots[i].state.load(std::memory_order_acquire) != SLOT_CLOSED && slotStale(slots[i])) {
+                closeSlot(slots[i]);
+            }
+        }
+    }
+}
+
+// The playback loop names the GIF it is about to show and the one after it
+void sdReaderHint(const char *current, const char *next) {
+    dropStaleHandles();
+    hasDeferred = false;
+    if (next == nullptr) return;
+
+    ReaderSlot &spare = slots[1 - currentSlot];
+    if (current != nullptr && spare.state.load(std::memory_order_acquire) != SLOT_CLOSED &&
+        strcmp(spare.path, current) == 0) {
+        // The spare slot holds the GIF about to open; prefetch next once it is taken
+        strlcpy(deferredNext, next, sizeof(deferredNext));
+        hasDeferred = true;
+        return;
+    }
+    startPrefetch(next);
+}
+
+void *sdReaderOpen(const char *path, int32_t *size) {
+    dropStaleHandles();
+    ReaderSlot *slot = &slots[currentSlot];
+    ReaderSlot &spare = slots[1 - currentSlot];
+    bool ready = false;
+
+    if (slot->state.load(std::memory_order_acquire) == SLOT_PARKED && strcmp(slot->path, path) == 0) {
+        ready = true; // Reopened right after a close, e.g. after counting frames
+    } else if (spare.state.load(std::memory_order_acquire) != SLOT_CLOSED && strcmp(spare.path, path) == 0) {
+        waitIdle(spare); // Still opening: finishing that beats starting over
+        if (spare.state.load(std::memory_order_acquire) == SLOT_PREFETCHED) {
+            closeSlot(*slot);
+            currentSlot = 1 - currentSlot;
+            slot = &spare;
+            ready = true;
+            portENTER_CRITICAL(&statsMux);
+            prefetchHits++;
+            portEXIT_CRITICAL(&statsMux);
+        } else {
+            closeSlot(spare);
+        }
+    }
+
+    if (!ready) {
+        closeSlot(*slot);
+        strlcpy(slot->path, path, sizeof(slot->path));
+        stampSlot(*slot);
+        sdLock(SD_IO_PLAYBACK);
+        slot->file = FILESYSTEM.open(path, O_RDONLY);
+        sdUnlock();
+        if (!slot->file) {
+            slot->path[0] = '\0';
+            return NULL;
+        }
+        slot->size = slot->file.size();
+    }
+    slot->state.store(SLOT_OPEN, std::memory_order_release);
+
+    if (hasDeferred) {
+        hasDeferred = false;
+        startPrefetch(deferredNext);
+    }
+
+    *size = slot->size;
+    return slot;
+}
+
+// Keep the file open: AnimatedGIF is often reopened on the same file
+void sdReaderClose(void *handle) {
+    ReaderSlot *slot = static_cast<ReaderSlot *>(handle);
+    slot->state.store(SLOT_PARKED, std::memory_order_release);
+}
+
+// Window holding pos, waiting for it if the SD I/O task is reading it; -1 if none
+static int findWindow(ReaderSlot &slot, uint32_t pos) {
+    for (int i = 0; i < 2; i++) {
+        ReadWindow &window = slot.windows[i];
+        uint8_t state = window.state.load(std::memory_order_acquire);
+        if (state == WINDOW_PENDING && window.start == pos - pos % SD_READ_WINDOW) {
+            while ((state = window.state.load(std::memory_order_acquire)) == WINDOW_PENDING) {
+                xSemaphoreTake(jobDone, portMAX_DELAY);
+            }
+        }
+        if (state == WINDOW_READY && pos >= window.start && pos < window.start + window.length) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int32_t sdReaderRead(void *handle, uint32_t pos, uint8_t *buf, int32_t len) {
+    ReaderSlot &slot = *static_cast<ReaderSlot *>(handle);
+    int32_t total = 0;
+
+    while (len > 0 && pos < slot.size) {
+        int index = findWindow(slot, pos);
+        if (index < 0) {
+            // Miss: read the window synchronously into the slot not in flight
+            bool pending0 = slot.windows[0].state.load(std::memory_order_acquire) == WINDOW_PENDING;
+            bool pending1 = slot.windows[1].state.load(std::memory_order_acquire) == WINDOW_PENDING;
+            if (pending0 && pending1) {
+                waitIdle(slot);
+                continue;
+            }
+            index = pending0 ? 1 : pending1 ? 0 : 1 - slot.lastWindow;
+            ReadWindow &window = slot.windows[index];
+            window.readAhead = false;
+            window.start = pos - pos % SD_READ_WINDOW;
+            bool ok = fillWindow(slot, window);
+            window.state.store(ok ? WINDOW_READY : WINDOW_EMPTY, std::memory_order_release);
+            if (!ok) break;
+        }
+
+        ReadWindow &window = slot.windows[index];
+        if (window.readAhead) {
+            window.readAhead = false;
+            portENTER_CRITICAL(&statsMux);
+            readAheadHits++;
+            portEXIT_CRITICAL(&statsMux);
+        }
+        slot.lastWindow = index;
+
+        uint32_t offset = pos - window.start;
+        uint32_t count = window.length - offset;
+        if (count > (uint32_t)len) count = len;
+        memcpy(buf, window.data + offset, count);
+        buf += count;
+        pos += count;
+        len -= count;
+        total += count;
+
+        // Have the other window read the one after this while we decode
+        uint32_t nextStart = window.start + SD_READ_WINDOW;
+        ReadWindow &other = slot.windows[1 - index];
+        uint8_t otherState = other.state.load(std::memory_order_acquire);
+        if (nextStart < slot.size && otherState != WINDOW_PENDING &&
+            !(otherState == WINDOW_READY && other.start == nextStart)) {
+            other.start = nextStart;
+            other.state.store(WINDOW_PENDING, std::memory_order_release);
+            int slotIndex = &slot == &slots[0] ? 0 : 1;
+            if (!postJob(slotIndex, 1 - index)) {
+                other.state.store(WINDOW_EMPTY, std::memory_order_release);
+            }
+        }
+    }
+    return total;
+}
+
+// Called by the web API before path is replaced, moved or removed, or with
+// null before anything may be. Reads of it fail from then on, so a GIF
+// playing it ends early rather than read a file that changed under it.
+void sdReaderInvalidate(const char *path) {
+    portENTER_CRITICAL(&staleMux);
+    staleHashes[staleGeneration % SD_READER_STALE_PATHS] = path ? hashPath(path) : 0;
+    staleGeneration++;
+    portEXIT_CRITICAL(&staleMux);
+    handlesStale.store(true, std::memory_order_release);
+}
+
+SdReadStats getSdReadStats() {
+    SdReadStats stats;
+    uint32_t histogram[SD_LATENCY_BUCKETS];
+    portENTER_CRITICAL(&statsMux);
+    stats.reads = statReads;
+    stats.bytes = statBytes;
+    uint64_t busyUs = statBusyUs;
+    stats.readAheadHits = readAheadHits;
+    stats.prefetchHits = prefetchHits;
+    memcpy(histogram, latencyHistogram, sizeof(histogram));
+    portEXIT_CRITICAL(&statsMux);
+
+    stats.bytesPerSec = busyUs ? (uint32_t)(stats.bytes * 1000000ULL / busyUs) : 0;
+    stats.avgLatencyUs = stats.reads ? (uint32_t)(busyUs / stats.reads) : 0;
+    stats.p99LatencyUs = 0;
+    uint32_t seen = 0;
+    for (int i = 0; i < SD_LATENCY_BUCKETS && stats.reads > 0; i++) {
+        seen += histogram[i];
+        if ((uint64_t)seen * 100 >= (uint64_t)stats.reads * 99) {
+            stats.p99LatencyUs = bucketUpperBound(i);
+            break;
+        }
+    }
+    return stats;
+}
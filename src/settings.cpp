@@ -1,6 +1,12 @@
 #include "FS.h"
 #include "settings.h"
 #include "globals.h"
+#include "shuffle.h"
+#include "panel.h"
+#include "colorcorrect.h"
+#include "dither.h"
+#include "scale.h"
+#include "pipeline.h"
 
 Preferences preferences;
 
@@ -39,3 +45,137 @@ void saveGifPlaybackToPreferences() {
     
     Serial.printf("Saved GIF playback state to preferences: %s\n", gifPlaybackEnabled ? "enabled" : "disabled");
 }
+
+// Function to load the playback mode and the shuffle cycle from preferences
+void loadPlaybackModeFromPreferences() {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    playbackMode = preferences.getUChar("play_mode", PLAYBACK_SEQUENTIAL) == PLAYBACK_SHUFFLE ? PLAYBACK_SHUFFLE : PLAYBACK_SEQUENTIAL;
+    shuffleSeed = preferences.getUInt("shuf_seed", 0);
+    shufflePosition = preferences.getUInt("shuf_pos", 0);
+    shuffleDomain = preferences.getUInt("shuf_domain", 0);
+    preferences.end();
+
+    Serial.printf("Loaded playback mode from preferences: %s (shuffle %lu/%lu)\n", playbackModeName(playbackMode),
+                  (unsigned long)shufflePosition, (unsigned long)shuffleDomain);
+}
+
+// Function to save the playback mode to preferences
+void savePlaybackModeToPreferences() {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    preferences.putUChar("play_mode", playbackMode);
+    preferences.end();
+
+    Serial.printf("Saved playback mode to preferences: %s\n", playbackModeName(playbackMode));
+}
+
+// Function to save a new shuffle cycle to preferences, resuming at 'position'
+void saveShuffleStateToPreferences(uint32_t position) {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    preferences.putUInt("shuf_seed", shuffleSeed);
+    preferences.putUInt("shuf_pos", position);
+    preferences.putUInt("shuf_domain", shuffleDomain);
+    preferences.end();
+}
+
+// Function to save the shuffle position to preferences, every SHUFFLE_SAVE_INTERVAL_MS
+void saveShufflePositionToPreferences(uint32_t position) {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    preferences.putUInt("shuf_pos", position);
+    preferences.end();
+}
+
+// Function to load the panel buffering choice from preferences
+void loadPanelBufferingFromPreferences() {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    panelDoubleBufferRequested = preferences.getBool("double_buf", PANEL_DOUBLE_BUFFER_DEFAULT);
+    preferences.end();
+
+    Serial.printf("Loaded panel buffering from preferences: %s\n", panelDoubleBufferRequested ? "double" : "single");
+}
+
+// Function to save the panel buffering choice to preferences
+void savePanelBufferingToPreferences() {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    preferences.putBool("double_buf", panelDoubleBufferRequested);
+    preferences.end();
+
+    Serial.printf("Saved panel buffering to preferences: %s\n", panelDoubleBufferRequested ? "double" : "single");
+}
+
+// Function to load the colour curve from preferences
+void loadColorCurveFromPreferences() {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    uint8_t curve = preferences.getUChar("color_curve", COLOR_CURVE_DEFAULT);
+    colorCurve = curve < COLOR_CURVE_COUNT ? (color_curve_t)curve : COLOR_CURVE_DEFAULT;
+    preferences.end();
+
+    Serial.printf("Loaded colour curve from preferences: %s\n", colorCurveName(colorCurve));
+}
+
+// Function to save the colour curve to preferences
+void saveColorCurveToPreferences() {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    preferences.putUChar("color_curve", colorCurve);
+    preferences.end();
+
+    Serial.printf("Saved colour curve to preferences: %s\n", colorCurveName(colorCurve));
+}
+
+// Function to load the dithering switch from preferences
+void loadDitherFromPreferences() {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    ditherEnabled = preferences.getBool("dither", DITHER_DEFAULT_ENABLED);
+    preferences.end();
+
+    Serial.printf("Loaded dithering from preferences: %s\n", ditherEnabled ? "on" : "off");
+}
+
+// Function to save the dithering switch to preferences
+void saveDitherToPreferences() {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    preferences.putBool("dither", ditherEnabled);
+    preferences.end();
+
+    Serial.printf("Saved dithering to preferences: %s\n", ditherEnabled ? "on" : "off");
+}
+
+// Function to load the scaling filter and fit policy from preferences
+void loadScalingFromPreferences() {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    uint8_t filter = preferences.getUChar("scale_filter", SCALE_FILTER_DEFAULT);
+    uint8_t fit = preferences.getUChar("scale_fit", SCALE_FIT_DEFAULT);
+    scaleFilter = filter < SCALE_FILTER_COUNT ? (scale_filter_t)filter : SCALE_FILTER_DEFAULT;
+    scaleFit = fit < SCALE_FIT_COUNT ? (scale_fit_t)fit : SCALE_FIT_DEFAULT;
+    preferences.end();
+
+    Serial.printf("Loaded scaling from preferences: %s, %s\n", scaleFilterName(scaleFilter), scaleFitName(scaleFit));
+}
+
+// Function to save the scaling filter and fit policy to preferences
+void saveScalingToPreferences() {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    preferences.putUChar("scale_filter", scaleFilter);
+    preferences.putUChar("scale_fit", scaleFit);
+    preferences.end();
+
+    Serial.printf("Saved scaling to preferences: %s, %s\n", scaleFilterName(scaleFilter), scaleFitName(scaleFit));
+}
+
+// Function to load the frame drop policy from preferences
+void loadFrameDropPolicyFromPreferences() {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    uint8_t policy = preferences.getUChar("frame_drop", DEFAULT_FRAME_DROP_POLICY);
+    setFrameDropPolicy(policy < FRAME_DROP_POLICY_COUNT ? (frame_drop_policy_t)policy : DEFAULT_FRAME_DROP_POLICY);
+    preferences.end();
+
+    Serial.printf("Loaded frame drop policy from preferences: %s\n", frameDropPolicyName(getFrameDropPolicy()));
+}
+
+// Function to save the frame drop policy to preferences
+void saveFrameDropPolicyToPreferences() {
+    preferences.begin("matrix_settings", false); // false = read/write mode
+    preferences.putUChar("frame_drop", getFrameDropPolicy());
+    preferences.end();
+
+    Serial.printf("Saved frame drop policy to preferences: %s\n", frameDropPolicyName(getFrameDropPolicy()));
+}
@@ -0,0 +1,114 @@
+#include "shuffle.h"
+#include "settings.h"
+
+playback_mode_t playbackMode = PLAYBACK_SEQUENTIAL;
+uint32_t shuffleSeed = 0;
+uint32_t shufflePosition = 0;
+uint32_t shuffleDomain = 0;
+
+static unsigned long lastSaveMs = 0;
+static bool cycleSaved = true;   // The cycle's seed is in NVS; a new one is written once it shows a GIF
+
+// Integer hash used as the Feistel round function
+static uint32_t feistelRound(uint32_t value, uint32_t seed, uint32_t round) {
+    uint32_t h = value * 0x9E3779B1u ^ seed ^ (round * 0x85EBCA6Bu);
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// Map a slot of the cycle to a playlist position. Bijective on [0, domain):
+// the Feistel network permutes [0, 2^bits), and re-applying it to results
+// outside the domain (cycle walking) stays inside the same permutation cycle.
+// 2^bits < 4 * domain, so a lookup takes fewer than four passes on average.
+uint32_t shufflePermute(uint32_t position, uint32_t domain, uint32_t seed) {
+    if (domain <= 1) {
+        return 0;
+    }
+
+    uint32_t bits = 2;
+    while (bits < 32 && (1ULL << bits) < domain) {
+        bits += 2;
+    }
+    uint32_t half = bits / 2;
+    uint32_t mask = (1UL << half) - 1;
+
+    uint32_t x = position;
+    do {
+        uint32_t left = x >> half;
+        uint32_t right = x & mask;
+        for (uint32_t round = 0; round < SHUFFLE_FEISTEL_ROUNDS; round++) {
+            uint32_t next = left ^ (feistelRound(right, seed, round) & mask);
+            left = right;
+            right = next;
+        }
+        x = (left << half) | right;
+    } while (x >= domain);
+
+    return x;
+}
+
+void shuffleBeginCycle(uint32_t domain) {
+    shuffleSeed = esp_random();
+    shufflePosition = 0;
+    shuffleDomain = domain;
+    cycleSaved = false;
+    Serial.printf("Shuffle: new cycle of %lu GIFs (seed %08lx)\n",
+                  (unsigned long)domain, (unsigned long)shuffleSeed);
+}
+
+// Next playlist position to play; 0 without starting a cycle when the
+// playlist is empty
+uint32_t shuffleNext(uint32_t domain) {
+    if (domain == 0) {
+        return 0;
+    }
+    if (shuffleDomain == 0 || shufflePosition >= shuffleDomain) {
+        shuffleBeginCycle(domain);
+    }
+    return shufflePermute(shufflePosition++, shuffleDomain, shuffleSeed);
+}
+
+// Called just before the GIF shuffleNext() returned is shown. Its slot is
+// stored, so a reboot shows it again instead of skipping it: with the seed
+// for the cycle's first shown GIF, then every SHUFFLE_SAVE_INTERVAL_MS, so a
+// reboot resumes at most that far back in the cycle.
+void shuffleShowing() {
+    uint32_t slot = shufflePosition - 1;
+    if (!cycleSaved) {
+        saveShuffleStateToPreferences(slot);
+        cycleSaved = true;
+        lastSaveMs = millis();
+    } else if (millis() - lastSaveMs >= SHUFFLE_SAVE_INTERVAL_MS) {
+        saveShufflePositionToPreferences(slot);
+        lastSaveMs = millis();
+    }
+}
+
+// Position shuffleNext() will return, without advancing; false at the end of
+// the cycle, where the next seed is not known yet
+bool shufflePeek(uint32_t *index) {
+    if (shuffleDomain == 0 || shufflePosition >= shuffleDomain) {
+        return false;
+    }
+    *index = shufflePermute(shufflePosition, shuffleDomain, shuffleSeed);
+    return true;
+}
+
+const char *playbackModeName(playback_mode_t mode) {
+    return mode == PLAYBACK_SHUFFLE ? "shuffle" : "sequential";
+}
+
+bool parsePlaybackMode(const String &name, playback_mode_t *mode) {
+    if (name == "sequential") {
+        *mode = PLAYBACK_SEQUENTIAL;
+    } else if (name == "shuffle") {
+        *mode = PLAYBACK_SHUFFLE;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,189 @@
+#include "statusfeed.h"
+#include "globals.h"
+#include "sdcard.h"
+#include "shuffle.h"
+#include "colorcorrect.h"
+#include "dither.h"
+#include "scale.h"
+#include <WiFi.h>
+#include <stdarg.h>
+
+// What the UI shows, compared field by field to find what changed
+struct StatusSnapshot {
+    char currentGif[MAX_GIF_PATH_LEN];
+    int brightness;
+    bool playbackEnabled;
+    playback_mode_t playbackMode;
+    color_curve_t colorCurve;
+    bool ditherEnabled;
+    scale_filter_t scaleFilter;
+    scale_fit_t scaleFit;
+};
+
+// A JSON object being written into a fixed buffer
+struct JsonText {
+    char *out;
+    size_t size;
+    size_t len;
+    bool empty;                // No field written yet
+};
+
+static AsyncEventSource events("/api/events");
+// Only touched from AsyncTCP callbacks, which all run on its one task, the
+// same task that walks the event source's client list
+static StatusSnapshot lastSent;  // As of the last "change" event
+static uint32_t eventId = 0;
+static uint32_t lastSampleMs = 0;
+static uint32_t lastEventMs = 0;
+static StatusFeedStats counters;
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void takeSnapshot(StatusSnapshot *s) {
+    getCurrentGif(s->currentGif, sizeof(s->currentGif));
+    s->brightness = brightness;
+    s->playbackEnabled = gifPlaybackEnabled;
+    s->playbackMode = playbackMode;
+    s->colorCurve = colorCurve;
+    s->ditherEnabled = ditherEnabled;
+    s->scaleFilter = scaleFilter;
+    s->scaleFit = scaleFit;
+}
+
+static void append(JsonText &t, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(t.out + t.len, t.size - t.len, fmt, args);
+    va_end(args);
+    if (n > 0) t.len = t.len + n < t.size ? t.len + n : t.size - 1;
+}
+
+static void key(JsonText &t, const char *name) {
+    append(t, "%s\"%s\":", t.empty ? "" : ",", name);
+    t.empty = false;
+}
+
+// s as a JSON string; empty when escaping it would not fit
+static void appendString(JsonText &t, const char *s) {
+    size_t start = t.len;
+    append(t, "\"");
+    for (; *s; s++) {
+        uint8_t c = (uint8_t)*s;
+        if (t.size - t.len < 8) {
+            t.len = start;
+            append(t, "\"");
+            break;
+        }
+        if (c == '"' || c == '\\') append(t, "\\%c", c);
+        else if (c < 0x20) append(t, "\\u%04x", c);
+        else t.out[t.len++] = (char)c;
+    }
+    append(t, "\"");
+}
+
+// The fields of now that differ from prev, or all of them with the connection
+// details when prev is null. Returns the length, 0 when nothing differs.
+static size_t serialize(const StatusSnapshot &now, const StatusSnapshot *prev, char *out, size_t size) {
+    JsonText t = {out, size, 0, true};
+    append(t, "{");
+    if (prev == nullptr) {
+        key(t, "status");
+        append(t, "\"connected\"");
+        key(t, "ssid");
+        appendString(t, WiFi.SSID().c_str());
+        key(t, "ip");
+        appendString(t, WiFi.localIP().toString().c_str());
+    }
+    if (!prev || strcmp(now.currentGif, prev->currentGif) != 0) {
+        key(t, "current_gif");
+        appendString(t, now.currentGif);
+    }
+    if (!prev || now.brightness != prev->brightness) {
+        key(t, "brightness");
+        append(t, "%d", now.brightness);
+    }
+    if (!prev || now.playbackEnabled != prev->playbackEnabled) {
+        key(t, "gif_playback_enabled");
+        append(t, now.playbackEnabled ? "true" : "false");
+    }
+    if (!prev || now.playbackMode != prev->playbackMode) {
+        key(t, "playback_mode");
+        appendString(t, playbackModeName(now.playbackMode));
+    }
+    if (!prev || now.colorCurve != prev->colorCurve) {
+        key(t, "color_curve");
+        appendString(t, colorCurveName(now.colorCurve));
+    }
+    if (!prev || now.ditherEnabled != prev->ditherEnabled) {
+        key(t, "dither_enabled");
+        append(t, now.ditherEnabled ? "true" : "false");
+    }
+    if (!prev || now.scaleFilter != prev->scaleFilter) {
+        key(t, "scale_filter");
+        appendString(t, scaleFilterName(now.scaleFilter));
+    }
+    if (!prev || now.scaleFit != prev->scaleFit) {
+        key(t, "scale_fit");
+        appendString(t, scaleFitName(now.scaleFit));
+    }
+    if (t.empty) return 0;
+    append(t, "}");
+    return t.len;
+}
+
+// Samples the state and sends what changed. Runs from each client's poll, so
+// on the AsyncTCP task; with several clients polling, the first one due samples
+// for all of them.
+static void pollFeed() {
+    static char text[STATUS_FEED_TEXT_BYTES];
+    uint32_t nowMs = millis();
+    if (nowMs - lastSampleMs < STATUS_FEED_INTERVAL_MS / 2) return;
+    lastSampleMs = nowMs;
+
+    StatusSnapshot now;
+    takeSnapshot(&now);
+    size_t len = serialize(now, &lastSent, text, sizeof(text));
+    if (len > 0) {
+        events.send(text, "change", ++eventId);
+        lastSent = now;
+        lastEventMs = nowMs;
+        portENTER_CRITICAL(&statsMux);
+        counters.changes++;
+        counters.bytes += len;
+        portEXIT_CRITICAL(&statsMux);
+    } else if (nowMs - lastEventMs >= STATUS_FEED_PING_MS) {
+        events.send("{}", "ping", eventId);
+        lastEventMs = nowMs;
+    }
+}
+
+void setupStatusFeed(AsyncWebServer &server) {
+    takeSnapshot(&lastSent);
+    lastEventMs = millis();
+    // A new client starts from the whole state. Changes not sent yet reach it
+    // twice, which does no harm.
+    events.onConnect([](AsyncEventSourceClient *client) {
+        StatusSnapshot now;
+        takeSnapshot(&now);
+        char text[STATUS_FEED_TEXT_BYTES];
+        size_t len = serialize(now, nullptr, text, sizeof(text));
+        client->send(text, "status", eventId);
+        portENTER_CRITICAL(&statsMux);
+        counters.connects++;
+        counters.bytes += len;
+        portEXIT_CRITICAL(&statsMux);
+        // Take over the connection's poll, keeping the library's own work
+        client->client()->onPoll([](void *arg, AsyncClient *c) {
+            ((AsyncEventSourceClient *)arg)->_onPoll();
+            pollFeed();
+        }, client);
+    });
+    server.addHandler(&events);
+}
+
+StatusFeedStats getStatusFeedStats() {
+    portENTER_CRITICAL(&statsMux);
+    StatusFeedStats stats = counters;
+    portEXIT_CRITICAL(&statsMux);
+    stats.clients = events.count();
+    return stats;
+}
@@ -0,0 +1,261 @@
+#include "upload.h"
+#include "sdcard.h"
+
+static UploadStats stats = {};
+static void (*replaceHook)(const char *path) = nullptr;
+static uint32_t buffersHeld = 0; // Writers holding a buffer, at most UPLOAD_MAX_WRITERS
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// A buffer for w, unless UPLOAD_MAX_WRITERS uploads already hold one
+static bool takeBuffer(UploadWriter &w) {
+    portENTER_CRITICAL(&statsMux);
+    bool allowed = buffersHeld < UPLOAD_MAX_WRITERS;
+    if (allowed) buffersHeld++;
+    portEXIT_CRITICAL(&statsMux);
+    if (!allowed) return false;
+    w.buffer = (uint8_t *)malloc(2 * UPLOAD_BUFFER_BYTES);
+    if (w.buffer == nullptr) {
+        portENTER_CRITICAL(&statsMux);
+        buffersHeld--;
+        portEXIT_CRITICAL(&statsMux);
+    }
+    return w.buffer != nullptr;
+}
+
+static void releaseWriter(UploadWriter &w) {
+    if (w.buffer != nullptr) {
+        free(w.buffer);
+        portENTER_CRITICAL(&statsMux);
+        buffersHeld--;
+        portEXIT_CRITICAL(&statsMux);
+    }
+    w.buffer = nullptr;
+    w.buffered = 0;
+    w.active = false;
+}
+
+static bool writeOut(UploadWriter &w, const uint8_t *data, size_t len) {
+    sdLock(SD_IO_BULK);
+    uint32_t start = millis();
+    size_t written = w.file.write(data, len);
+    w.writeMs += millis() - start;
+    sdUnlock();
+    w.writes++;
+    return written == len;
+}
+
+static void flushJob(void *arg) {
+    UploadWriter &w = *static_cast<UploadWriter *>(arg);
+    w.flushOk = writeOut(w, w.buffer + (1 - w.half) * UPLOAD_BUFFER_BYTES, UPLOAD_BUFFER_BYTES);
+    xSemaphoreGive(w.flushDone);
+}
+
+// Wait for the write in flight, if there is one; false when it failed
+static bool waitFlush(UploadWriter &w) {
+    if (!w.flushing) return true;
+    uint32_t start = millis();
+    xSemaphoreTake(w.flushDone, portMAX_DELAY);
+    w.stallMs += millis() - start;
+    w.flushing = false;
+    return w.flushOk;
+}
+
+// Hand the full half to the SD I/O task and start filling the other. Every
+// flush but the last is a full half, so the file offset of each one stays a
+// multiple of the sector size.
+static bool flushBuffer(UploadWriter &w) {
+    if (!waitFlush(w)) return false;
+    w.half = 1 - w.half;
+    w.buffered = 0;
+    w.flushing = true;
+    if (sdBusSubmit(SD_IO_BULK, flushJob, &w)) return true;
+    // Queue full: write it from here
+    w.flushing = false;
+    return writeOut(w, w.buffer + (1 - w.half) * UPLOAD_BUFFER_BYTES, UPLOAD_BUFFER_BYTES);
+}
+
+static bool startWriter(UploadWriter &w, const char *path, bool resume, uint64_t offset, uint64_t expectedBytes) {
+    if (w.active) uploadAbort(w);
+    w.path = path;
+    w.resumed = resume;
+    w.base = offset;
+    w.buffered = 0;
+    w.received = 0;
+    w.writes = 0;
+    w.writeMs = 0;
+    w.stallMs = 0;
+    w.half = 0;
+    w.flushing = false;
+    w.elapsedMs = 0;
+    w.kbps = 0;
+    w.error = nullptr;
+    w.startMs = millis();
+
+    if (!w.flushDone) w.flushDone = xSemaphoreCreateBinary();
+    if (!w.flushDone || !takeBuffer(w)) {
+        Serial.printf("Upload refused, no buffer free: %s\n", path);
+        w.error = "Too many uploads at once, or out of memory";
+        w.errorStatus = 503;
+        return false;
+    }
+
+    sdLock(SD_IO_BULK);
+    bool ok;
+    if (resume) {
+        // Anything past offset was never verified
+        w.file = sd.open(path, O_WRONLY | O_CREAT);
+        ok = w.file && w.file.fileSize() >= offset && w.file.truncate(offset) && w.file.seekSet(offset);
+        if (!ok) w.file.close();
+    } else {
+        if (sd.exists(path)) sd.remove(path);
+        w.file = sd.open(path, O_WRONLY | O_CREAT | O_TRUNC);
+        ok = w.file;
+        // Contiguous clusters up front spare a FAT update per cluster; the card
+        // may not have a run that long, which only costs speed
+        if (ok && expectedBytes > 0 && !w.file.preAllocate(expectedBytes)) {
+            Serial.printf("Upload preallocation of %llu bytes failed, writing without: %s\n",
+                          (unsigned long long)expectedBytes, path);
+        }
+    }
+    sdUnlock();
+    if (!ok) {
+        Serial.printf("SD card error or full: %s\n", path);
+        releaseWriter(w);
+        w.error = "SD card error or full";
+        w.errorStatus = 507;
+        portENTER_CRITICAL(&statsMux);
+        stats.failed++;
+        portEXIT_CRITICAL(&statsMux);
+        return false;
+    }
+    w.active = true;
+    return true;
+}
+
+// Create path, replacing any file there, and get ready for expectedBytes
+// (0 when unknown). A previous upload that never finished is dropped.
+bool uploadBegin(UploadWriter &w, const char *path, uint64_t expectedBytes) {
+    return startWriter(w, path, false, 0, expectedBytes);
+}
+
+// Continue writing path at offset, creating it when offset is 0. Whatever the
+// file holds past offset is cut off; an abort keeps the file.
+bool uploadResume(UploadWriter &w, const char *path, uint64_t offset) {
+    return startWriter(w, path, true, offset, 0);
+}
+
+bool uploadWrite(UploadWriter &w, const uint8_t *data, size_t len) {
+    if (!w.active) return false;
+    while (len > 0) {
+        size_t n = UPLOAD_BUFFER_BYTES - w.buffered;
+        if (n > len) n = len;
+        memcpy(w.buffer + w.half * UPLOAD_BUFFER_BYTES + w.buffered, data, n);
+        w.buffered += n;
+        w.received += n;
+        data += n;
+        len -= n;
+        if (w.buffered == UPLOAD_BUFFER_BYTES && !flushBuffer(w)) {
+            Serial.printf("Write error during upload: %s\n", w.path.c_str());
+            uploadAbort(w);
+            w.error = "Write error during upload";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Write the tail, give back the preallocation past it and close the file
+bool uploadFinish(UploadWriter &w) {
+    if (!w.active) return false;
+    bool ok = waitFlush(w) &&
+              (w.buffered == 0 || writeOut(w, w.buffer + w.half * UPLOAD_BUFFER_BYTES, w.buffered));
+    sdLock(SD_IO_BULK);
+    ok = ok && w.file.truncate(w.base + w.received);
+    ok = w.file.close() && ok;
+    sdUnlock();
+    if (!ok) {
+        Serial.printf("Write error finishing upload: %s\n", w.path.c_str());
+        uploadAbort(w);
+        w.error = "Write error during upload";
+        return false;
+    }
+    releaseWriter(w);
+
+    w.elapsedMs = millis() - w.startMs;
+    w.kbps = (uint32_t)(w.received * 1000 / 1024 / (w.elapsedMs ? w.elapsedMs : 1));
+    portENTER_CRITICAL(&statsMux);
+    stats.completed++;
+    stats.bytes += w.received;
+    stats.lastBytes = w.received;
+    stats.lastMs = w.elapsedMs;
+    stats.lastKBps = w.kbps;
+    stats.lastWriteMs = w.writeMs;
+    stats.lastWrites = w.writes;
+    stats.lastStallMs = w.stallMs;
+    portEXIT_CRITICAL(&statsMux);
+    Serial.printf("Upload complete: %s, %llu bytes in %lu ms (%lu KB/s, %lu ms in %lu card writes, %lu ms waiting on them)\n",
+                  w.path.c_str(), (unsigned long long)w.received, (unsigned long)w.elapsedMs,
+                  (unsigned long)w.kbps, (unsigned long)w.writeMs, (unsigned long)w.writes,
+                  (unsigned long)w.stallMs);
+    return true;
+}
+
+// Drop an upload that failed or was cut off, with its partial file unless
+// it is to be resumed
+void uploadAbort(UploadWriter &w) {
+    if (!w.active) return;
+    waitFlush(w);
+    sdLock(SD_IO_BULK);
+    w.file.close();
+    if (!w.resumed) sd.remove(w.path.c_str());
+    sdUnlock();
+    releaseWriter(w);
+    w.error = "Upload aborted";
+    w.errorStatus = 507;
+    portENTER_CRITICAL(&statsMux);
+    stats.failed++;
+    portEXIT_CRITICAL(&statsMux);
+}
+
+// Drop what a writer holds before it goes away, aborting its upload if
+// one is still running
+void uploadRelease(UploadWriter &w) {
+    uploadAbort(w);
+    if (w.flushDone) vSemaphoreDelete(w.flushDone);
+    w.flushDone = nullptr;
+}
+
+// Called with the path before uploadCommit() replaces it
+void uploadSetReplaceHook(void (*hook)(const char *path)) {
+    replaceHook = hook;
+}
+
+// Put a finished upload in place of path. FAT cannot rename over a file, so
+// this is not atomic: the old file is renamed aside, the upload renamed in,
+// then the old one removed. Nothing ever opens a half-written file, and a
+// failed rename puts the old file back. A reset between the two renames
+// leaves path missing and the old file at path UPLOAD_OLD_SUFFIX.
+bool uploadCommit(const char *tempPath, const char *path) {
+    if (replaceHook) replaceHook(path);
+    String oldPathName = String(path) + UPLOAD_OLD_SUFFIX;
+    const char *oldPath = oldPathName.c_str();
+    sdLock(SD_IO_BULK);
+    if (sd.exists(oldPath)) sd.remove(oldPath);
+    bool replacing = sd.exists(path);
+    bool ok = !replacing || sd.rename(path, oldPath);
+    if (ok) {
+        ok = sd.rename(tempPath, path);
+        if (!ok && replacing) sd.rename(oldPath, path);
+        else if (replacing) sd.remove(oldPath);
+    }
+    sdUnlock();
+    if (!ok) Serial.printf("Upload commit failed: %s -> %s\n", tempPath, path);
+    return ok;
+}
+
+UploadStats getUploadStats() {
+    portENTER_CRITICAL(&statsMux);
+    UploadStats copy = stats;
+    portEXIT_CRITICAL(&statsMux);
+    return copy;
+}
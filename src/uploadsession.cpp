@@ -0,0 +1,335 @@
+#include "uploadsession.h"
+#include "upload.h"
+
+#define SESSION_PATH_LEN (sizeof(UPLOAD_SESSION_DIR) + 16) // "/xxxxxxxx.part"
+
+// The chunk being received. One at a time: chunks of a session arrive in
+// order, and the card writes one stream fastest anyway.
+static UploadWriter chunkWriter;
+static UploadSessionRecord chunkSession;
+static bool chunkActive = false;
+static uint32_t chunkToken = 0;
+static uint64_t chunkFirst;
+static uint64_t chunkLength;
+static uint64_t chunkReceived;
+static uint64_t chunkSkip;          // Leading bytes verified by an earlier chunk, not written again
+static uint32_t chunkExpectedCrc;
+static uint32_t chunkCrc;
+static uint32_t chunkFileCrc;       // CRC32 of the file up to the bytes written so far
+static uint32_t chunkLastMs;
+
+// Orders sessions by use. It is carried on the card in the records: the first
+// scan after boot moves it past every stamp it finds.
+static uint32_t sessionClock = 0;
+static bool sessionClockLoaded = false;
+
+static uint32_t crcTable[256];
+
+uint32_t uploadCrc32(uint32_t crc, const uint8_t *data, size_t len) {
+    if (crcTable[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crcTable[i] = c;
+        }
+    }
+    crc = ~crc;
+    while (len--) crc = crcTable[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Same name, size and file CRC, same session: a client that lost its
+// connection finds it again
+static uint32_t sessionId(const char *path, uint64_t size, uint32_t fileCrc) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    while (*path) {
+        hash ^= (uint8_t)*path++;
+        hash *= 16777619u;
+    }
+    for (int i = 0; i < 8; i++) {
+        hash ^= (uint8_t)(size >> (i * 8));
+        hash *= 16777619u;
+    }
+    for (int i = 0; i < 4; i++) {
+        hash ^= (uint8_t)(fileCrc >> (i * 8));
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void sessionPath(uint32_t id, const char *ext, char *buf, size_t len) {
+    snprintf(buf, len, UPLOAD_SESSION_DIR "/%08lx%s", (unsigned long)id, ext);
+}
+
+static bool readRecord(const char *path, UploadSessionRecord *rec) {
+    sdLock(SD_IO_BULK);
+    FsFile file = sd.open(path, O_RDONLY);
+    bool ok = file && file.read(rec, sizeof(*rec)) == (int)sizeof(*rec);
+    if (file) file.close();
+    sdUnlock();
+    return ok && rec->magic == UPLOAD_SESSION_MAGIC && rec->offset <= rec->size &&
+           memchr(rec->path, '\0', sizeof(rec->path)) != nullptr;
+}
+
+static bool loadSession(uint32_t id, UploadSessionRecord *rec) {
+    char path[SESSION_PATH_LEN];
+    sessionPath(id, ".ses", path, sizeof(path));
+    return readRecord(path, rec) && rec->id == id;
+}
+
+static uint32_t scanSessions(const char *path, uint32_t keepId, uint32_t *oldestId);
+
+// Write a session record, stamped as just used
+static bool saveSession(UploadSessionRecord &rec) {
+    if (!sessionClockLoaded) scanSessions(nullptr, 0, nullptr);
+    rec.lastUsed = ++sessionClock;
+    char path[SESSION_PATH_LEN];
+    sessionPath(rec.id, ".ses", path, sizeof(path));
+    sdLock(SD_IO_BULK);
+    FsFile file = sd.open(path, O_WRONLY | O_CREAT | O_TRUNC);
+    bool ok = file && file.write(&rec, sizeof(rec)) == sizeof(rec);
+    if (file) ok = file.close() && ok;
+    sdUnlock();
+    return ok;
+}
+
+static void removeSession(uint32_t id) {
+    char path[SESSION_PATH_LEN];
+    sdLock(SD_IO_BULK);
+    sessionPath(id, ".ses", path, sizeof(path));
+    sd.remove(path);
+    sessionPath(id, UPLOAD_TEMP_SUFFIX, path, sizeof(path));
+    sd.remove(path);
+    sdUnlock();
+}
+
+static bool fail(UploadSessionResult *result, int status, const char *message) {
+    result->status = status;
+    result->message = message;
+    return false;
+}
+
+static void describe(UploadSessionResult *result, const UploadSessionRecord &rec) {
+    result->id = rec.id;
+    result->size = rec.size;
+    result->offset = rec.offset;
+    result->fileCrc = rec.fileCrc;
+    result->committed = false;
+    strlcpy(result->path, rec.path, sizeof(result->path));
+    result->status = 200;
+    result->message = nullptr;
+}
+
+// Sessions on the card for other files than path, and in oldestId the least
+// recently used of them. Drops the sessions for path other than keepId,
+// which a new upload of the same name replaces, and records that cannot be
+// read. A null path drops nothing and only loads the session clock.
+static uint32_t scanSessions(const char *path, uint32_t keepId, uint32_t *oldestId) {
+    uint32_t others = 0;
+    uint32_t oldestUse = 0;
+    uint32_t stale[UPLOAD_SESSION_MAX * 2];
+    uint32_t staleCount = 0;
+    char name[32];
+    char recPath[sizeof(UPLOAD_SESSION_DIR) + sizeof(name)];
+    UploadSessionRecord rec;
+
+    sdLock(SD_IO_BULK);
+    FsFile dir = sd.open(UPLOAD_SESSION_DIR, O_RDONLY);
+    FsFile entry;
+    while (dir && entry.openNext(&dir, O_RDONLY)) {
+        entry.getName(name, sizeof(name));
+        entry.close();
+        size_t len = strlen(name);
+        if (len < 4 || strcmp(name + len - 4, ".ses") != 0) continue;
+        snprintf(recPath, sizeof(recPath), UPLOAD_SESSION_DIR "/%s", name);
+        bool valid = readRecord(recPath, &rec);
+        if (valid && rec.lastUsed > sessionClock) sessionClock = rec.lastUsed;
+        if (path == nullptr) continue;
+        if (!valid) {
+            rec.id = strtoul(name, nullptr, 16); // Another format, or cut short
+        } else if (strcmp(rec.path, path) != 0) {
+            if (others++ == 0 || rec.lastUsed < oldestUse) {
+                oldestUse = rec.lastUsed;
+                *oldestId = rec.id;
+            }
+            continue;
+        } else if (rec.id == keepId) {
+            continue;
+        }
+        if (staleCount < sizeof(stale) / sizeof(stale[0])) stale[staleCount++] = rec.id;
+    }
+    if (dir) dir.close();
+    sdUnlock();
+    sessionClockLoaded = true;
+
+    for (uint32_t i = 0; i < staleCount; i++) removeSession(stale[i]);
+    return others;
+}
+
+// Open the session for uploading size bytes whose CRC32 is fileCrc to path,
+// or find the one already open
+bool uploadSessionOpen(const char *path, uint64_t size, uint32_t fileCrc, UploadSessionResult *result) {
+    UploadSessionRecord rec;
+    uint32_t id = sessionId(path, size, fileCrc);
+    if (chunkActive && chunkSession.id != id && strcmp(chunkSession.path, path) == 0) {
+        uploadAbort(chunkWriter); // An older session for this name, about to be removed
+        chunkActive = false;
+    }
+    uint32_t oldestId = 0;
+    uint32_t others = scanSessions(path, id, &oldestId);
+    if (loadSession(id, &rec)) {
+        saveSession(rec); // Just used, so not the next one dropped
+        describe(result, rec);
+        Serial.printf("Upload session %08lx resumed at %llu of %llu bytes: %s\n", (unsigned long)id,
+                      (unsigned long long)rec.offset, (unsigned long long)size, path);
+        return true;
+    }
+
+    if (others >= UPLOAD_SESSION_MAX) {
+        // Abandoned uploads must not block new ones for good
+        if (chunkActive && chunkSession.id == oldestId) {
+            uploadAbort(chunkWriter);
+            chunkActive = false;
+        }
+        removeSession(oldestId);
+        Serial.printf("Upload session %08lx dropped, the least recently used of %lu\n", (unsigned long)oldestId,
+                      (unsigned long)others);
+    }
+    memset(&rec, 0, sizeof(rec));
+    rec.magic = UPLOAD_SESSION_MAGIC;
+    rec.id = id;
+    rec.size = size;
+    rec.offset = 0;
+    rec.fileCrc = fileCrc;
+    rec.verifiedCrc = 0;
+    strlcpy(rec.path, path, sizeof(rec.path));
+
+    sdLock(SD_IO_BULK);
+    if (!sd.exists(UPLOAD_SESSION_DIR)) sd.mkdir(UPLOAD_SESSION_DIR);
+    sdUnlock();
+    removeSession(id); // A .part left without its record
+    if (!saveSession(rec)) return fail(result, 507, "SD card error or full");
+    describe(result, rec);
+    Serial.printf("Upload session %08lx opened for %llu bytes: %s\n", (unsigned long)id,
+                  (unsigned long long)size, path);
+    return true;
+}
+
+bool uploadSessionGet(uint32_t id, UploadSessionResult *result) {
+    UploadSessionRecord rec;
+    if (!loadSession(id, &rec)) return fail(result, 404, "No such upload session");
+    describe(result, rec);
+    return true;
+}
+
+bool uploadSessionCancel(uint32_t id) {
+    UploadSessionRecord rec;
+    if (!loadSession(id, &rec)) return false;
+    if (chunkActive && chunkSession.id == id) {
+        uploadAbort(chunkWriter);
+        chunkActive = false;
+    }
+    removeSession(id);
+    Serial.printf("Upload session %08lx cancelled: %s\n", (unsigned long)id, rec.path);
+    return true;
+}
+
+// Start receiving bytes [first, last] of a session's file of size bytes,
+// whose CRC32 should be crc. The chunk may overlap what is already verified,
+// as a resent chunk does, but not start past it.
+bool uploadChunkBegin(uint32_t id, uint64_t first, uint64_t last, uint64_t size, uint32_t crc,
+                      UploadSessionResult *result) {
+    result->chunk = 0;
+    result->kbps = 0;
+    if (chunkActive) {
+        // A chunk whose connection died is given up once it falls silent,
+        // or at once when its session sends the next one
+        if (chunkSession.id != id && millis() - chunkLastMs < UPLOAD_CHUNK_IDLE_MS)
+            return fail(result, 409, "Another upload is sending a chunk");
+        uploadAbort(chunkWriter);
+        chunkActive = false;
+    }
+
+    UploadSessionRecord rec;
+    if (!loadSession(id, &rec)) return fail(result, 404, "No such upload session");
+    describe(result, rec);
+    if (size != rec.size || last < first || last >= rec.size) return fail(result, 416, "Content-Range does not fit the upload");
+    if (first > rec.offset) return fail(result, 409, "Chunk starts past the verified offset");
+
+    chunkSession = rec;
+    chunkFirst = first;
+    chunkLength = last - first + 1;
+    chunkSkip = rec.offset - first < chunkLength ? rec.offset - first : chunkLength;
+    chunkReceived = 0;
+    chunkExpectedCrc = crc;
+    chunkCrc = 0;
+    chunkFileCrc = rec.verifiedCrc;
+    chunkLastMs = millis();
+    if (chunkSkip < chunkLength) {
+        char part[SESSION_PATH_LEN];
+        sessionPath(id, UPLOAD_TEMP_SUFFIX, part, sizeof(part));
+        if (!uploadResume(chunkWriter, part, rec.offset)) return fail(result, chunkWriter.errorStatus, chunkWriter.error);
+    }
+    chunkActive = true;
+    result->chunk = ++chunkToken;
+    return true;
+}
+
+void uploadChunkWrite(uint32_t chunk, const uint8_t *data, size_t len) {
+    if (!chunkActive || chunk != chunkToken) return;
+    chunkLastMs = millis();
+    chunkCrc = uploadCrc32(chunkCrc, data, len);
+    uint64_t start = chunkReceived;
+    chunkReceived += len;
+    if (chunkReceived > chunkLength || chunkReceived <= chunkSkip) return;
+    size_t skip = start < chunkSkip ? chunkSkip - start : 0;
+    chunkFileCrc = uploadCrc32(chunkFileCrc, data + skip, len - skip); // Exactly the bytes past the verified offset
+    uploadWrite(chunkWriter, data + skip, len - skip);
+}
+
+// The chunk's body is complete: verify it, record the new offset and commit
+// the file once it is whole
+bool uploadChunkEnd(uint32_t chunk, UploadSessionResult *result) {
+    if (!chunkActive || chunk != chunkToken) return fail(result, 409, "Chunk was taken over by a newer one");
+    chunkActive = false;
+    UploadSessionRecord &rec = chunkSession;
+    describe(result, rec);
+    result->chunk = chunk;
+
+    bool wrote = chunkSkip < chunkLength;
+    if (wrote && !uploadFinish(chunkWriter)) return fail(result, chunkWriter.errorStatus, chunkWriter.error);
+    result->kbps = wrote ? chunkWriter.kbps : 0;
+    if (chunkReceived != chunkLength) return fail(result, 400, "Chunk length does not match Content-Range");
+    if (chunkCrc != chunkExpectedCrc) {
+        Serial.printf("Upload session %08lx: CRC mismatch in bytes %llu-%llu, resend from %llu\n",
+                      (unsigned long)rec.id, (unsigned long long)chunkFirst,
+                      (unsigned long long)(chunkFirst + chunkLength - 1), (unsigned long long)rec.offset);
+        return fail(result, 422, "CRC32 mismatch");
+    }
+
+    if (chunkFirst + chunkLength > rec.offset) {
+        rec.offset = chunkFirst + chunkLength;
+        rec.verifiedCrc = chunkFileCrc;
+        if (!saveSession(rec)) return fail(result, 507, "SD card error or full");
+    }
+    result->offset = rec.offset;
+    if (rec.offset < rec.size) return true;
+
+    // Every chunk matched its own CRC, but not necessarily the file the client meant
+    if (rec.verifiedCrc != rec.fileCrc) {
+        Serial.printf("Upload session %08lx: file CRC %08lx, expected %08lx, dropped: %s\n", (unsigned long)rec.id,
+                      (unsigned long)rec.verifiedCrc, (unsigned long)rec.fileCrc, rec.path);
+        removeSession(rec.id);
+        result->offset = 0;
+        return fail(result, 422, "CRC32 of the whole file does not match, upload it again");
+    }
+
+    char part[SESSION_PATH_LEN];
+    sessionPath(rec.id, UPLOAD_TEMP_SUFFIX, part, sizeof(part));
+    if (!uploadCommit(part, rec.path)) return fail(result, 500, "Could not replace the existing file");
+    removeSession(rec.id);
+    result->committed = true;
+    Serial.printf("Upload session %08lx complete: %s\n", (unsigned long)rec.id, rec.path);
+    return true;
+}